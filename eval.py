@@ -8,9 +8,10 @@ import os
 
 
 WORKING_DIR = './render_engine'
-EXEC_REL_PATH = '../x64/Release/render_engine.exe'
+EXEC_REL_PATH = '../x64/Release/render_engine.exe' if os.name == 'nt' else '../build/render_engine'
 LOG_FILE_DIR = 'D:/cs348k_eval/clusters2/'
 LOG_FILENAME = '{1}_nlights={0:05d}.json'
+HEADLESS = False    # Render offscreen via EGL, for machines without a display.
 
 os.chdir(WORKING_DIR)
 
@@ -36,6 +37,8 @@ if __name__ == '__main__':
         log_file = Path(LOG_FILE_DIR) / LOG_FILENAME.format(nlights, pipeline)
         working_dir = f'{Path(WORKING_DIR).absolute()}'.replace('\\', '/')
         command = f'"{EXEC_REL_PATH}" --lights {nlights} --pipeline {pipeline} --eval --log-file "{log_file}"'
+        if HEADLESS:
+            command += ' --headless'
         print(command)
         subp = subprocess.Popen(
             command,
@@ -0,0 +1,101 @@
+/*
+* Benchmark: CPU clustered or tiled light culling (LightCuller_CPU).
+* Scatters point lights through the view frustum and times culling them against
+* the default eval cluster grid on the engine's thread pool.
+* --tiled times cullTiles on the X*Y tiles instead of cullClusters.
+* 
+* Usage: bench_lightculling [--lights N] [--numTiles X Y] [--numClustersZ Z] [--frames F] [--tiled]
+*/
+
+#include "core/renderengine.h"
+#include "graphics/pipeline/lightculler_cpu.h"
+#include "objects/go_camera.h"
+#include "objects/go_light.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+static void argsError() {
+    std::cout << "Usage: bench_lightculling [--lights N] [--numTiles X Y] [--numClustersZ Z] [--frames F] [--tiled]\n";
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+
+    size_t num_lights = 2000;
+    glm::ivec3 numTiles = glm::ivec3(48, 27, 24);
+    size_t num_frames = 200;
+    bool tiled = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--lights" && i + 1 < argc)
+            num_lights = std::stoul(argv[++i]);
+        else if (arg == "--numTiles" && i + 2 < argc) {
+            numTiles.x = std::stoi(argv[++i]);
+            numTiles.y = std::stoi(argv[++i]);
+        }
+        else if (arg == "--numClustersZ" && i + 1 < argc)
+            numTiles.z = std::stoi(argv[++i]);
+        else if (arg == "--frames" && i + 1 < argc)
+            num_frames = std::stoul(argv[++i]);
+        else if (arg == "--tiled")
+            tiled = true;
+        else
+            argsError();
+    }
+
+    RenderEngine engine(Graphics::Backend::NONE, true);
+
+    Ref<GO_Camera> camera = engine.createObject<GO_Camera>();
+    camera->setPerspective(glm::radians(70.0f), 1920.0f / 1080.0f, 0.1f, 100.0f);
+
+    srand(1);
+    auto random = []() { return float(rand()) / float(RAND_MAX); };
+    std::vector<Ref<GO_Light>> lightRefs;
+    std::vector<GO_Light*> lights;
+    for (size_t i = 0; i < num_lights; i++) {
+        Ref<GO_Light> light = engine.createObject<GO_Light>();
+        float depth = 0.5f + 30.0f * random();
+        light->setPosition(depth * (2.0f * random() - 1.0f), 0.6f * depth * (2.0f * random() - 1.0f), -depth);
+        light->color = 6.0f * glm::normalize(glm::vec3(random(), random(), random()));
+        lightRefs.push_back(light);
+        lights.push_back(light.get());
+    }
+
+    LightCuller_CPU culler;
+    std::vector<GLint> tileLightMapping;
+    std::vector<GLint> lightsIndex;
+    ThreadPool& pool = *engine.getThreadPool();
+
+    auto cull = [&]() {
+        if (tiled)
+            culler.cullTiles(pool, camera.get(), lights, numTiles, tileLightMapping, lightsIndex);
+        else
+            culler.cullClusters(pool, camera.get(), lights, numTiles, tileLightMapping, lightsIndex);
+    };
+
+    // Warm up so scratch buffers and cluster bounds are allocated outside the timing.
+    cull();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t frame = 0; frame < num_frames; frame++) {
+        cull();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double total_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    std::cout << "lights: " << num_lights << "\n";
+    if (tiled)
+        std::cout << "tiles: " << numTiles.x << "x" << numTiles.y << "\n";
+    else
+        std::cout << "clusters: " << numTiles.x << "x" << numTiles.y << "x" << numTiles.z << "\n";
+    std::cout << "threads: " << pool.getNumThreads() << "\n";
+    std::cout << "indices: " << lightsIndex.size() << "\n";
+    std::cout << "ms/frame: " << total_ms / (double)num_frames << "\n";
+
+    return 0;
+}
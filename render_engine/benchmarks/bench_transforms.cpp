@@ -0,0 +1,92 @@
+/*
+* Benchmark: CPU-side scene traversal.
+* Builds a hierarchy of objects, moves every object each frame (as the light
+* components in main.cpp do), updates the scene's transforms (as the engine's
+* frame loop does), and then reads back every world matrix in depth-first order
+* (as the pipelines' render queues do).
+* 
+* Usage: bench_transforms [--objects N] [--branching B] [--frames F]
+*/
+
+#include "core/renderengine.h"
+#include "objects/gameobject.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+static void argsError() {
+    std::cout << "Usage: bench_transforms [--objects N] [--branching B] [--frames F]\n";
+    exit(1);
+}
+
+static void traverse(GameObject* obj, glm::vec4& sink) {
+    sink += obj->getModelMatrix()[3];
+    for (auto& child : obj->getChildren()) {
+        traverse(child.get(), sink);
+    }
+}
+
+int main(int argc, char* argv[]) {
+
+    size_t num_objects = 10000;
+    size_t branching = 4;
+    size_t num_frames = 500;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+            argsError();
+        if (arg == "--objects")
+            num_objects = std::stoul(argv[++i]);
+        else if (arg == "--branching")
+            branching = std::stoul(argv[++i]);
+        else if (arg == "--frames")
+            num_frames = std::stoul(argv[++i]);
+        else
+            argsError();
+    }
+    if (num_objects == 0 || branching == 0)
+        argsError();
+
+    // Only objects are needed, but the engine still opens a (headless) context.
+    RenderEngine engine(Graphics::Backend::NONE, true);
+    Ref<Scene> scene = engine.createScene();
+
+    std::vector<Ref<GameObject>> objects;
+    objects.reserve(num_objects);
+    for (size_t i = 0; i < num_objects; i++) {
+        Ref<GameObject> obj = engine.createObject<GameObject>();
+        obj->setPosition(0.01f * (float)(i % 97), 0.0f, 0.0f);
+        if (i == 0) {
+            scene->addObject(obj);
+        }
+        else {
+            obj->setParent(objects[(i - 1) / branching], false);
+        }
+        objects.push_back(obj);
+    }
+
+    glm::vec4 sink(0.0f);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t frame = 0; frame < num_frames; frame++) {
+        for (auto& obj : objects) {
+            obj->deltaPosition(0.0f, 0.001f, 0.0f);
+        }
+        scene->updateTransforms();
+        traverse(objects[0].get(), sink);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double total_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    std::cout << "objects: " << num_objects << "\n";
+    std::cout << "branching: " << branching << "\n";
+    std::cout << "frames: " << num_frames << "\n";
+    std::cout << "ms/frame: " << total_ms / (double)num_frames << "\n";
+    // Keeps the traversal from being optimized away.
+    std::cout << "checksum: " << sink.y << "\n";
+
+    return 0;
+}
@@ -1,4 +1,4 @@
-#include "components/KeyboardController.h"
+#include "components/keyboardcontroller.h"
 #include "core/renderengine.h"
 #include "core/scene.h"
 #include "io/inputcontext.h"
@@ -3,7 +3,7 @@
 #include "core/scene.h"
 #include "depsgraph/depsgraph.h"
 #include "io/inputcontext.h"
-#include "objects/GameObject.h"
+#include "objects/gameobject.h"
 
 #include "GLFW/glfw3.h"
 
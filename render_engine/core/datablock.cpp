@@ -3,6 +3,81 @@
 #include <iostream>
 
 
+void DatablockHeader::destroy() {
+	Datablock* object = this->object;
+	this->object = nullptr;
+	// The Refs' weak count is still held while the destructor runs, in case it releases
+	// WeakRefs to itself.
+	object->~Datablock();
+	this->releaseWeak();
+}
+
+void DatablockHeader::free() {
+	DatablockPool* pool = this->pool;
+	this->~DatablockHeader();
+	pool->free(this);
+}
+
+
+
+DatablockPool::DatablockPool(size_t blockSize) {
+	// Every block must hold the free list's next pointer, and keep the next block aligned.
+	constexpr size_t alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+	blockSize = std::max(blockSize, sizeof(void*));
+	this->blockSize = (blockSize + alignment - 1) / alignment * alignment;
+}
+
+DatablockPool::~DatablockPool() {
+	for (void* chunk : this->chunks) {
+		::operator delete(chunk);
+	}
+}
+
+void* DatablockPool::allocate() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	if (this->freeList == nullptr) {
+		char* chunk = (char*)::operator new(this->blockSize * blocksPerChunk);
+		this->chunks.push_back(chunk);
+		// Linked in reverse, so blocks are handed out in address order.
+		for (size_t i = blocksPerChunk; i-- > 0;) {
+			void* block = chunk + i * this->blockSize;
+			*(void**)block = this->freeList;
+			this->freeList = block;
+		}
+	}
+	void* block = this->freeList;
+	this->freeList = *(void**)block;
+	this->numAllocated++;
+	return block;
+}
+
+void DatablockPool::free(void* block) {
+	bool last;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		*(void**)block = this->freeList;
+		this->freeList = block;
+		last = (--this->numAllocated == 0 && this->orphaned);
+	}
+	if (last) {
+		delete this;
+	}
+}
+
+void DatablockPool::orphan() {
+	bool last;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->orphaned = true;
+		last = (this->numAllocated == 0);
+	}
+	if (last) {
+		delete this;
+	}
+}
+
+
+
 Datablock::Datablock(DatablockID id) : datablockID(id) {}
 
 DatablockID Datablock::getID() {
@@ -10,15 +85,24 @@ DatablockID Datablock::getID() {
 }
 
 Ref<Datablock> Datablock::getRef() {
-	Ref<Datablock> r = this->datablockSelf.elevate();
-	if (!r) {
+	if (!this->datablockHeader || !this->datablockHeader->tryAddStrong()) {
 		// Calling on a dead datablock. This should never happen.
 		// TODO: Revise when error handling is improved.
 		std::cout << "Fatal error: Called getRef() on a dead Datablock.";
 		throw 0;
 	}
-	return r;
+	return Ref<Datablock>::take(this, this->datablockHeader);
 }
 WeakRef<Datablock> Datablock::getWeakRef() {
-	return this->datablockSelf;
-}
\ No newline at end of file
+	WeakRef<Datablock> wr;
+	if (this->datablockHeader && this->datablockHeader->alive()) {
+		this->datablockHeader->addWeak();
+		wr.datablock = this;
+		wr.header = this->datablockHeader;
+	}
+	return wr;
+}
+
+bool Datablock::isDeleted() const {
+	return !this->datablockHeader || this->datablockHeader->isDeleted();
+}
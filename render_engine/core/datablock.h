@@ -1,8 +1,14 @@
 #pragma once
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 
@@ -32,6 +38,20 @@
 *		datablock.
 * In addition to the above smart references, direct pointers to the underlying datablock
 * can be used. This should only be used when a counted reference is known to exist.
+*
+* Each datablock is allocated from a pool owned by its DatablockManager, behind a
+* DatablockHeader that holds its reference counts, so Refs and WeakRefs are a pair of
+* pointers and counting needs no separate control block. The counts are atomic, so Refs
+* and WeakRefs may be copied, elevated and released on any thread. The DatablockManagers
+* themselves are still main-thread only.
+*
+* Garbage collection is incremental: DatablockManager::garbageCollect() sweeps for
+* datablocks only the manager still references, until a deadline, and marks them deleted.
+* The strong count and the deleted mark share one atomic word, so a WeakRef elevating on
+* a worker thread either gets its reference in before the mark (and the datablock is not
+* garbage) or fails. Marked datablocks are only destroyed by a later freeGarbage(),
+* normally at the next frame boundary, so a direct pointer handed to a worker stays valid
+* for the rest of the frame even if its datablock is collected meanwhile.
 * 
 * Within the game engine code, the specific usages of reference-counted Refs are all
 * well-defined. See the respective header files of each datablock type for how these
@@ -55,6 +75,110 @@ template<typename Type>
 class WeakRef;
 
 class Datablock;
+class DatablockPool;
+
+
+
+/*
+* Precedes every datablock in its pool block.
+* The datablock is destroyed when the last Ref is released, and the block returned to its
+* pool once the last WeakRef is released too. As with std::shared_ptr, all Refs together
+* hold one weak count, which is released once the datablock is destroyed.
+*/
+struct DatablockHeader {
+	// Set in strongState when the DatablockManager removes the datablock; WeakRefs no
+	// longer elevate. The rest of the bits are the strong count.
+	static constexpr uint32_t DeletedBit = 1u << 31;
+	static constexpr uint32_t CountMask = DeletedBit - 1;
+
+	std::atomic<uint32_t> strongState{ 0 };
+	std::atomic<uint32_t> weakCount{ 1 };
+	Datablock* object = nullptr;
+	DatablockPool* pool = nullptr;
+
+	void addStrong() {
+		this->strongState.fetch_add(1, std::memory_order_relaxed);
+	}
+	// Adds a strong reference only if the datablock is alive. Used to elevate WeakRefs.
+	bool tryAddStrong() {
+		uint32_t state = this->strongState.load(std::memory_order_relaxed);
+		do {
+			if ((state & DeletedBit) || (state & CountMask) == 0) {
+				return false;
+			}
+		} while (!this->strongState.compare_exchange_weak(state, state + 1,
+			std::memory_order_acq_rel, std::memory_order_relaxed));
+		return true;
+	}
+	void releaseStrong() {
+		if ((this->strongState.fetch_sub(1, std::memory_order_acq_rel) & CountMask) == 1) {
+			this->destroy();
+		}
+	}
+	// Marks the datablock deleted if the caller holds the only strong reference.
+	// Fails if any other reference exists or is being elevated at the same time.
+	bool tryMarkDeleted() {
+		uint32_t expected = 1;
+		return this->strongState.compare_exchange_strong(expected, 1 | DeletedBit,
+			std::memory_order_acq_rel);
+	}
+	void addWeak() {
+		this->weakCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	void releaseWeak() {
+		if (this->weakCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			this->free();
+		}
+	}
+	bool alive() const {
+		uint32_t state = this->strongState.load(std::memory_order_acquire);
+		return (state & CountMask) > 0 && !(state & DeletedBit);
+	}
+	bool isDeleted() const {
+		return (this->strongState.load(std::memory_order_acquire) & DeletedBit) != 0;
+	}
+
+private:
+	// Runs the datablock's destructor, then releases the weak count held by the Refs.
+	void destroy();
+	void free();
+};
+
+
+
+/*
+* Fixed-size blocks for the datablocks of one size class, allocated in chunks.
+* A pool outlives its DatablockManager while any of its blocks are still referenced,
+* and deletes itself once the last one is freed. Blocks may be freed from any thread,
+* since the last WeakRef may be released on a worker.
+*/
+class DatablockPool {
+public:
+
+	DatablockPool(size_t blockSize);
+	DatablockPool(const DatablockPool& other) = delete;
+	DatablockPool& operator=(const DatablockPool& other) = delete;
+
+	void* allocate();
+	void free(void* block);
+
+	// Called by the owning DatablockManager when it is destroyed.
+	void orphan();
+
+private:
+
+	~DatablockPool();
+
+	static constexpr size_t blocksPerChunk = 64;
+
+	size_t blockSize;
+	std::vector<void*> chunks;
+	void* freeList = nullptr;		// Each free block starts with a pointer to the next.
+	size_t numAllocated = 0;
+	bool orphaned = false;
+	std::mutex mutex;
+
+};
 
 
 
@@ -64,28 +188,55 @@ public:
 
 	Ref() {}
 	Ref(std::nullptr_t) {}
-	Ref(const Ref<Type>& ref) { *this = ref; }
-	Ref(Ref<Type>&& ref) { *this = ref; }
+	Ref(const Ref<Type>& ref) : datablock(ref.datablock), header(ref.header) {
+		if (this->header) {
+			this->header->addStrong();
+		}
+	}
+	Ref(Ref<Type>&& ref) : datablock(ref.datablock), header(ref.header) {
+		ref.datablock = nullptr;
+		ref.header = nullptr;
+	}
 	template<typename FromType>
 	Ref(const Ref<FromType>& ref) { *this = ref; }
 	template<typename FromType>
-	Ref(Ref<FromType>&& ref) { *this = ref; }
+	Ref(Ref<FromType>&& ref) { *this = std::move(ref); }
+
+	~Ref() {
+		if (this->header) {
+			this->header->releaseStrong();
+		}
+	}
 
 	Ref<Type>& operator=(const Ref<Type>& ref) {
-		this->datablock = ref.datablock;
+		if (ref.header) {
+			ref.header->addStrong();
+		}
+		this->reset(ref.datablock, ref.header);
 		return *this;
 	}
 	Ref<Type>& operator=(Ref<Type>&& ref) {
-		this->datablock = std::move(ref.datablock);
+		if (this != &ref) {
+			this->reset(ref.datablock, ref.header);
+			ref.datablock = nullptr;
+			ref.header = nullptr;
+		}
 		return *this;
 	}
 	template<typename FromType>
 	Ref<Type>& operator=(const Ref<FromType>& ref) {
-		return *this = ref.cast<Type>();
+		return *this = ref.template cast<Type>();
 	}
 	template<typename FromType>
 	Ref<Type>& operator=(Ref<FromType>&& ref) {
-		return *this = std::move(ref.cast<Type>());
+		static_assert(std::is_base_of_v<Type, FromType> || std::is_base_of_v<FromType, Type>,
+			"datablock.h: Ref::operator=(): One of either Type or FromType must derive from the other"
+		);
+		// Steal the count instead of adding one.
+		this->reset(static_cast<Type*>(ref.datablock), ref.header);
+		ref.datablock = nullptr;
+		ref.header = nullptr;
+		return *this;
 	}
 
 	Type* operator->() const {
@@ -93,7 +244,7 @@ public:
 	}
 
 	Type* get() const {
-		return this->datablock.get();
+		return this->datablock;
 	}
 
 	operator bool() const {
@@ -120,9 +271,7 @@ public:
 		static_assert(std::is_base_of_v<Type, ToType> || std::is_base_of_v<ToType, Type>,
 			"datablock.h: Ref::cast(): One of either Type or ToType must derive from the other"
 		);
-		Ref<ToType> r;
-		r.datablock = std::static_pointer_cast<ToType>(this->datablock);
-		return r;
+		return Ref<ToType>::adopt(static_cast<ToType*>(this->datablock), this->header);
 	}
 
 	Ref<Type>&& move() {
@@ -136,41 +285,48 @@ public:
 
 private:
 
-	std::shared_ptr<Type> datablock = nullptr;
+	Type* datablock = nullptr;
+	DatablockHeader* header = nullptr;
 
-	template<typename... Args>
-	static Ref<Type> create(DatablockID id, Args... args) {
+	// Takes a new counted reference to datablock (which may be null).
+	static Ref<Type> adopt(Type* datablock, DatablockHeader* header) {
 		Ref<Type> r;
-		r.datablock = std::make_shared<Type>(id, args...);
-		r->datablockSelf = r.cast<Datablock>().weak();
+		if (datablock && header) {
+			header->addStrong();
+			r.datablock = datablock;
+			r.header = header;
+		}
 		return r;
 	}
 
+	// Takes over a reference already counted for datablock, e.g. by tryAddStrong().
+	static Ref<Type> take(Type* datablock, DatablockHeader* header) {
+		Ref<Type> r;
+		r.datablock = datablock;
+		r.header = header;
+		return r;
+	}
+
+	// Releases the current reference and takes over one already counted for datablock.
+	void reset(Type* datablock, DatablockHeader* header) {
+		DatablockHeader* old = this->header;
+		this->datablock = datablock;
+		this->header = header;
+		if (old) {
+			old->releaseStrong();
+		}
+	}
+
 	/*
 	* Returns whether this is the last remaining reference for this datablock, i.e. whether
 	* the datablock is only referenced by the DatablockManager itself. If this returns true,
-	* it's safe to remove/destroy the datablock, and the datablock is atomically marked as
-	* deleted (by setting datablockSelf to a null WeakRef).
+	* it's safe to remove/destroy the datablock, and the datablock is marked as deleted.
 	*/
 	bool checkGarbage() const {
-		/* Despite the controversy around use_count() in a multithreaded setting, we observe
-		that datablocks cannot be made relevant again from the DatablockManager alone, so only
-		WeakRefs are still relevant. In this case, it is safe to remove the DatablockManager's
-		reference even if a WeakRef elevates between now and then, because WeakRef elevations
-		cannot assume the datablock still exists in the DatablockManager. */
-
-		// TODO: MULTITHREADING: Make this operation atomic, such that no new Refs can be
-		// created between when use_count() is called and when the datablock is marked as
-		// "deleted." This mostly refers to elevating WeakRefs, but also double check we can't
-		// copy Refs directly out of the DatablockManager.
-		if (!this->datablock) {
-			return true;
-		}
-		bool g = (this->datablock.use_count() == 1);
-		if (g) {
-			this->datablock->datablockSelf = nullptr;
-		}
-		return g;
+		// The DatablockManager cannot make a datablock relevant again by itself, and WeakRefs
+		// elevate through the same atomic word the mark is set in, so a count of one that
+		// gets marked is final.
+		return !this->header || this->header->tryMarkDeleted();
 	}
 
 	template<typename T>
@@ -179,6 +335,7 @@ private:
 	friend class WeakRef;
 	template<typename T>
 	friend class DatablockManager;
+	friend class Datablock;
 };
 
 
@@ -189,16 +346,36 @@ public:
 
 	WeakRef() {}
 	WeakRef(std::nullptr_t) {}
-	WeakRef(const WeakRef<Type>& ref) { *this = ref; }
-	WeakRef(WeakRef<Type>&& ref) { *this = ref; }
+	WeakRef(const WeakRef<Type>& ref) : datablock(ref.datablock), header(ref.header) {
+		if (this->header) {
+			this->header->addWeak();
+		}
+	}
+	WeakRef(WeakRef<Type>&& ref) : datablock(ref.datablock), header(ref.header) {
+		ref.datablock = nullptr;
+		ref.header = nullptr;
+	}
+
+	~WeakRef() {
+		if (this->header) {
+			this->header->releaseWeak();
+		}
+	}
 
 	WeakRef<Type>& operator=(const WeakRef<Type>& ref) {
-		this->weakptr = ref.weakptr;
+		if (ref.header) {
+			ref.header->addWeak();
+		}
+		this->reset(ref.datablock, ref.header);
 		return *this;
 	}
 
 	WeakRef<Type>& operator=(WeakRef<Type>&& ref) {
-		this->weakptr = std::move(ref.weakptr);
+		if (this != &ref) {
+			this->reset(ref.datablock, ref.header);
+			ref.datablock = nullptr;
+			ref.header = nullptr;
+		}
 		return *this;
 	}
 
@@ -211,36 +388,47 @@ public:
 	* if you intend to access the underlying datablock; just call elevate().
 	*/
 	bool exists() const {
-		Ref<Type> r;
-		r.datablock = this->weakptr.lock();
-		return r.datablock && (this == (WeakRef<Type>*)&r.datablock->datablockSelf ||
-			r.datablock->datablockSelf.exists());
+		return this->header && this->header->alive();
 	}
 
 	/*
 	* Elevates the underlying reference to a counted reference, or returns a null Ref
-	* if the object has already been marked as deleted.
+	* if the object has already been marked as deleted. Safe on any thread.
 	*/
 	Ref<Type> elevate() const {
-		Ref<Type> r;
-		r.datablock = this->weakptr.lock();
-		if (r.datablock && r.datablock->datablockSelf.exists()) {
-			return r;
+		if (this->header && this->header->tryAddStrong()) {
+			return Ref<Type>::take(this->datablock, this->header);
 		}
 		return nullptr;
 	}
 
 	static WeakRef<Type> fromRef(const Ref<Type>& ref) {
 		WeakRef<Type> wr;
-		wr.weakptr = std::weak_ptr<Type>(ref.datablock);
+		if (ref.header) {
+			ref.header->addWeak();
+			wr.datablock = ref.datablock;
+			wr.header = ref.header;
+		}
 		return wr;
 	}
 
 
 private:
 
-	std::weak_ptr<Type> weakptr;
+	// Only dereferenced through elevate(), so it may dangle once the datablock is destroyed.
+	Type* datablock = nullptr;
+	DatablockHeader* header = nullptr;
 
+	void reset(Type* datablock, DatablockHeader* header) {
+		DatablockHeader* old = this->header;
+		this->datablock = datablock;
+		this->header = header;
+		if (old) {
+			old->releaseWeak();
+		}
+	}
+
+	friend class Datablock;
 };
 
 
@@ -258,26 +446,48 @@ public:
 	// Returns a null WeakRef is this datablock has been deleted.
 	virtual WeakRef<Datablock> getWeakRef() final;
 
+	// Whether the DatablockManager has collected this datablock. Safe to call from any thread.
+	bool isDeleted() const;
+
 
 private:
 
 	DatablockID datablockID;
 
 	/*
-	* A Datablock is marked as "deleted" when its datablockSelf is set to nullptr.
-	* When this happens, it means the datablock has been removed from the DatablockManager
-	* and it should not longer be considered usable.
+	* Set by the DatablockManager right after construction. A Datablock is marked as
+	* "deleted" (DatablockHeader::isDeleted()) when it has been removed from the DatablockManager,
+	* and it should no longer be considered usable.
 	*/
-	WeakRef<Datablock> datablockSelf;
+	DatablockHeader* datablockHeader = nullptr;
 
 	template<typename T>
 	friend class Ref;
 	template<typename T>
 	friend class WeakRef;
+	template<typename T>
+	friend class DatablockManager;
 };
 
 
 
+/*
+* Owns every datablock of one base type, in a slot map.
+*
+* Datablocks are kept densely in one vector for iteration. Each one also owns a slot, which
+* records where in that vector it is, and its ID names the slot: the slot index (plus one,
+* so no ID is DatablockNull) in the low 32 bits, and the slot's generation in the high 32.
+* Lookup by ID, creation and removal are all O(1). Removal moves the last datablock into the
+* gap and bumps the slot's generation, so IDs of removed datablocks are detected as stale
+* even after their slot is reused. Datablocks created in fresh slots get IDs 1, 2, 3, ...
+*
+* Memory comes from one DatablockPool per block size, so each datablock and its header
+* are a single allocation from a free list.
+*
+* Garbage is collected in two steps, both of which can be spread over many frames:
+* garbageCollect() moves unreferenced datablocks out of the slot map into a queue, and
+* freeGarbage() destroys the queued datablocks. Both stop once their deadline passes.
+*/
 template<typename BaseType>
 class DatablockManager {
 public:
@@ -287,14 +497,42 @@ public:
 			"DatablockManager can only manage classes derived from Datablock"
 		);
 	}
+	DatablockManager(const DatablockManager& other) = delete;
+	DatablockManager& operator=(const DatablockManager& other) = delete;
+	~DatablockManager() {
+		// Datablocks still referenced elsewhere keep their pools alive.
+		this->garbage.clear();
+		this->datablocks.clear();
+		for (auto& [blockSize, pool] : this->pools) {
+			pool->orphan();
+		}
+	}
 
 	template<typename CreateType = BaseType, typename... Args>
 	Ref<CreateType> create(Args... args) {
 		static_assert(std::is_base_of_v<BaseType, CreateType>,
 			"DatablockManager::create: CreateType must derive from BaseType"
 		);
-		Ref<CreateType> r = Ref<CreateType>::create(this->genNewID(), args...);
+		static_assert(alignof(CreateType) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+			"DatablockManager::create: CreateType is over-aligned"
+		);
+		uint32_t slot = this->allocSlot();
+
+		constexpr size_t offset = getObjectOffset(alignof(CreateType));
+		DatablockPool*& pool = this->pools[offset + sizeof(CreateType)];
+		if (pool == nullptr) {
+			pool = new DatablockPool(offset + sizeof(CreateType));
+		}
+		void* block = pool->allocate();
+		DatablockHeader* header = new (block) DatablockHeader();
+		CreateType* datablock = new ((char*)block + offset) CreateType(this->getSlotID(slot), args...);
+		header->object = datablock;
+		header->pool = pool;
+		datablock->datablockHeader = header;
+		Ref<CreateType> r = Ref<CreateType>::adopt(datablock, header);
+		this->slots[slot].dense = (uint32_t)this->datablocks.size();
 		this->datablocks.push_back(r);
+		this->denseSlots.push_back(slot);
 		return r;
 	}
 
@@ -303,27 +541,69 @@ public:
 		static_assert(std::is_base_of_v<BaseType, CreateType>,
 			"DatablockManager::createBase: CreateType must derive from BaseType"
 		);
-		return this->create(args...).cast<BaseType>();
+		return this->create(args...).template cast<BaseType>();
 	}
 
+	// Returns a null Ref if no datablock has this ID (any more).
 	Ref<BaseType> getByID(DatablockID id) {
-		auto loc = std::find_if(this->datablocks.begin(), this->datablocks.end(), [=](Ref<BaseType>& d) {
-			return d->getID() == id;
-		});
-		if (loc == this->datablocks.end()) {
+		uint32_t slot = (uint32_t)(id & 0xFFFFFFFF) - 1;
+		if (slot >= this->slots.size()) {
+			return nullptr;
+		}
+		const Slot& s = this->slots[slot];
+		if (s.dense == FreeSlot || s.generation != (uint32_t)(id >> 32)) {
 			return nullptr;
 		}
-		return *loc;
+		return this->datablocks[s.dense];
+	}
+
+	/*
+	* Sweeps for datablocks that are only referenced by this manager until deadline passes,
+	* resuming where the previous call stopped. Returns true once the sweep reaches the end;
+	* the next call then starts a new one. Garbage is marked deleted and removed from the
+	* slot map right away, but is only destroyed by freeGarbage().
+	*/
+	bool garbageCollect(std::chrono::steady_clock::time_point deadline) {
+		for (size_t n = 1; this->sweepIndex < this->datablocks.size(); n++) {
+			if (n % sweepCheckInterval == 0 && std::chrono::steady_clock::now() >= deadline) {
+				return false;
+			}
+			uint32_t i = (uint32_t)this->sweepIndex;
+			if (this->datablocks[i].checkGarbage()) {
+				// Fill the gap with the last datablock, so check index i again.
+				this->garbage.push_back(std::move(this->datablocks[i]));
+				this->remove(i);
+			}
+			else {
+				this->sweepIndex++;
+			}
+		}
+		this->sweepIndex = 0;
+		return true;
+	}
+
+	/*
+	* Destroys garbage found by garbageCollect() until deadline passes, but always at least
+	* one datablock so the queue drains eventually. Returns true if the queue is empty.
+	*/
+	bool freeGarbage(std::chrono::steady_clock::time_point deadline) {
+		while (!this->garbage.empty()) {
+			this->garbage.pop_back();
+			if (std::chrono::steady_clock::now() >= deadline) {
+				break;
+			}
+		}
+		return this->garbage.empty();
 	}
 
+	// Collects and frees all current garbage at once.
 	void garbageCollect() {
-		this->datablocks.erase(
-			std::remove_if(this->datablocks.begin(), this->datablocks.end(),
-				[](const Ref<BaseType>& r) { return r.checkGarbage(); }),
-			this->datablocks.end()
-		);
+		this->sweepIndex = 0;
+		this->garbageCollect(std::chrono::steady_clock::time_point::max());
+		this->freeGarbage(std::chrono::steady_clock::time_point::max());
 	}
 
+	// The order changes whenever a datablock is removed.
 	const std::vector<Ref<BaseType>>& iterate() {
 		return this->datablocks;
 	}
@@ -331,14 +611,60 @@ public:
 
 private:
 
-	// TODO: Consider alternative data structures.
+	static constexpr uint32_t FreeSlot = UINT32_MAX;
+	// How many datablocks garbageCollect() checks between looking at the clock.
+	static constexpr size_t sweepCheckInterval = 64;
+
+	struct Slot {
+		uint32_t generation = 0;		// Bumped each time the slot is freed.
+		uint32_t dense = FreeSlot;		// Index into datablocks, or FreeSlot.
+	};
+
+	// Declared first, so they are destroyed after datablocks.
+	std::unordered_map<size_t, DatablockPool*> pools;		// Block size -> pool.
+
 	std::vector<Ref<BaseType>> datablocks;
+	std::vector<uint32_t> denseSlots;		// The slot of each datablock.
+	std::vector<Slot> slots;
+	std::vector<uint32_t> freeSlots;
 
+	size_t sweepIndex = 0;					// Where garbageCollect() resumes.
+	std::vector<Ref<BaseType>> garbage;		// Collected, waiting for freeGarbage().
+
+
+	// Where a datablock of the given alignment starts within its block.
+	static constexpr size_t getObjectOffset(size_t alignment) {
+		return (sizeof(DatablockHeader) + alignment - 1) / alignment * alignment;
+	}
 
-	DatablockID genNewID() {
-		// nextID is unique on a per-BaseType basis.
-		static DatablockID nextID = DatablockNull + 1;
-		return nextID++;
+	uint32_t allocSlot() {
+		if (!this->freeSlots.empty()) {
+			uint32_t slot = this->freeSlots.back();
+			this->freeSlots.pop_back();
+			return slot;
+		}
+		this->slots.emplace_back();
+		return (uint32_t)(this->slots.size() - 1);
+	}
+
+	DatablockID getSlotID(uint32_t slot) const {
+		return ((DatablockID)this->slots[slot].generation << 32) | ((DatablockID)slot + 1);
+	}
+
+	// Removes the datablock at index dense of datablocks, and frees its slot.
+	void remove(uint32_t dense) {
+		uint32_t slot = this->denseSlots[dense];
+		uint32_t last = (uint32_t)(this->datablocks.size() - 1);
+		if (dense != last) {
+			this->datablocks[dense] = std::move(this->datablocks[last]);
+			this->denseSlots[dense] = this->denseSlots[last];
+			this->slots[this->denseSlots[dense]].dense = dense;
+		}
+		this->datablocks.pop_back();
+		this->denseSlots.pop_back();
+		this->slots[slot].generation++;
+		this->slots[slot].dense = FreeSlot;
+		this->freeSlots.push_back(slot);
 	}
 
 
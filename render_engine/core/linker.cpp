@@ -2,20 +2,24 @@
 * This file exists for the purpose of specifying libraries for the linker and for
 * compiling header-only libraries such as STB.
 * 
-* CURRENTLY ONLY MSVC IS SUPPORTED.
+* Under MSVC, libraries are linked through the pragmas below. Other toolchains
+* get their libraries from CMakeLists.txt instead.
 */
 
 #include <cstdint>
 
 
 // Hint to NVIDIA and AMD GPUs that we prefer a high-performance GPU, if multiple
-// GPUs are available.
+// GPUs are available. These exports only mean anything to Windows drivers.
+#ifdef _WIN32
 extern "C" {
 	__declspec(dllexport) uint32_t NvOptimusEnablement = 1;
 	__declspec(dllexport) int AmdPowerXpressRequestHighPerformance = 1;
 }
+#endif
 
 
+#ifdef _MSC_VER
 #ifdef _DEBUG
 #pragma comment(lib, "assimp-vc142-mtd.lib")
 #pragma comment(lib, "zlibstaticd.lib")
@@ -29,10 +33,13 @@ extern "C" {
 #pragma comment(lib, "glew32s.lib")
 
 #pragma comment(lib, "OpenGL32.lib")
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
+#ifdef _MSC_VER
 #define __STDC_LIB_EXT1__		// silence warning about sprintf being unsafe
+#endif
 #include "stb/stb_image_write.h"
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "core/renderengine.h"
 #include "graphics/graphics.h"
 #include "io/callbacks_glfw.h"
+#include "utils/platform.h"
 
 #include "GLFW/glfw3.h"
 #include "GLFW/glfw3native.h"
@@ -9,9 +10,9 @@
 
 #include <atomic>
 #include <chrono>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
-#include <windows.h>
 
 
 // TODO: TEMP until a logging system is made.
@@ -22,16 +23,16 @@ static void glfwError(int error_code, const char* desc) {
 
 RenderEngine::RenderEngine() : RenderEngine(Graphics::Backend::NONE) {}
 
-RenderEngine::RenderEngine(Graphics::Backend backend) : inputContext(*this) {
+RenderEngine::RenderEngine(Graphics::Backend backend, bool headless) : inputContext(*this) {
 	static bool glfwInitialized = false;
-	if (!glfwInitialized) {
+	if (!glfwInitialized && !headless) {
 		glfwSetErrorCallback(glfwError);
 		if (!glfwInit()) {
 			return;
 		}
 		glfwInitialized = true;
 	}
-	this->graphics = Graphics::openGraphics(this, backend);
+	this->graphics = Graphics::openGraphics(this, backend, headless);
 	// TODO: Error handling
 	if (this->graphics) {
 		this->graphics->initPrimitives();
@@ -64,6 +65,7 @@ void RenderEngine::launch(
 		glfwSetInputMode(this->graphics->getWindow(), GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
 	}
 	Callbacks_GLFW::registerWindow(this->graphics->getWindow(), this);
+	this->graphics->prepare(this->activeScene.get());
 
 	auto lasttime = std::chrono::high_resolution_clock::now();
 
@@ -78,10 +80,12 @@ void RenderEngine::launch(
 
 		if (this->activeScene) {
 			this->activeScene->evaluateComponents(deltaTime);
+			this->activeScene->updateTransforms();
 		}
 
 		// TODO (in the long run): Consider double buffering this data, if feasible.
 		this->graphics->render(this->activeScene.get());
+		this->collectGarbage();
 		done = !this->graphics->pollEvents() || done;
 	}
 
@@ -108,22 +112,28 @@ json RenderEngine::launch_eval(
 
 	this->windowTitle = windowTitle;
 	this->graphics->createWindow(this->windowTitle, width, height, fullscreen);
-	if (glfwRawMouseMotionSupported()) {
-		glfwSetInputMode(this->graphics->getWindow(), GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
+	if (!this->graphics->isHeadless()) {
+		if (glfwRawMouseMotionSupported()) {
+			glfwSetInputMode(this->graphics->getWindow(), GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
+		}
+		Callbacks_GLFW::registerWindow(this->graphics->getWindow(), this);
 	}
-	Callbacks_GLFW::registerWindow(this->graphics->getWindow(), this);
 	if (this->activeScene && this->activeScene->getActiveCamera()) {
 		this->activeScene->getActiveCamera()->setAspect(
 			this->graphics->getWidth() / (float)this->graphics->getHeight()
 		);
 	}
+	this->graphics->prepare(this->activeScene.get());
 
 	std::vector<float> loggedFrametimes;
 	if (log) {
 		loggedFrametimes.reserve(numCamMats+1);
 	}
 
-	Sleep(1000);
+	// Give a new window time to appear before timing starts. Headless has no window to wait on.
+	if (!this->graphics->isHeadless()) {
+		Utils::Platform::sleep(1000);
+	}
 
 
 	auto lasttime = std::chrono::high_resolution_clock::now();
@@ -145,6 +155,7 @@ json RenderEngine::launch_eval(
 			if (GO_Camera* cam = this->activeScene->getActiveCamera().get()) {
 				cam->setLocalMatrix(camMats[viewIdx]);
 			}
+			this->activeScene->updateTransforms();
 		}
 
 		this->graphics->render(this->activeScene.get());
@@ -165,6 +176,7 @@ json RenderEngine::launch_eval(
 			delete[] data;
 		}
 
+		this->collectGarbage();
 		done = !this->graphics->pollEvents() || done;
 	}
 
@@ -187,10 +199,48 @@ InputContext* RenderEngine::getInputContext() {
 	return &this->inputContext;
 }
 
+ThreadPool* RenderEngine::getThreadPool() {
+	return &this->threadPool;
+}
+
 Depsgraph* RenderEngine::getDepsgraph() {
 	return &this->depsgraph;
 }
 
+void RenderEngine::collectGarbage() {
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + this->gcBudget;
+
+	// Everything queued here was collected at least one frame ago, so no pointer handed
+	// to a worker thread before it was marked can still be in use.
+	this->scenes.freeGarbage(deadline);
+	this->objects.freeGarbage(deadline);
+	this->meshes.freeGarbage(deadline);
+	this->materials.freeGarbage(deadline);
+	this->textures.freeGarbage(deadline);
+
+	// Sweep the managers in turn, each picking up where the last call stopped.
+	// Objects come before the meshes and materials they may be the last to reference.
+	constexpr int numStages = 5;
+	for (int i = 0; i < numStages && std::chrono::steady_clock::now() < deadline; i++) {
+		bool done = false;
+		switch (this->gcStage) {
+		case 0: done = this->scenes.garbageCollect(deadline); break;
+		case 1: done = this->objects.garbageCollect(deadline); break;
+		case 2: done = this->meshes.garbageCollect(deadline); break;
+		case 3: done = this->materials.garbageCollect(deadline); break;
+		case 4: done = this->textures.garbageCollect(deadline); break;
+		}
+		if (!done) {
+			break;
+		}
+		this->gcStage = (this->gcStage + 1) % numStages;
+	}
+}
+
+void RenderEngine::setGarbageCollectBudget(std::chrono::microseconds budget) {
+	this->gcBudget = budget;
+}
+
 std::string RenderEngine::getWindowTitle() {
 	return this->windowTitle;
 }
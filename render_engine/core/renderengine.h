@@ -5,7 +5,9 @@
 #include "graphics/graphics.h"
 #include "graphics/texture.h"
 #include "io/inputcontext.h"
+#include "utils/threadpool.h"
 
+#include <chrono>
 #include <filesystem>
 #include <functional>
 #include <string>
@@ -28,7 +30,12 @@ class RenderEngine {
 public:
 
 	RenderEngine();
-	RenderEngine(Graphics::Backend backend);
+	/*
+	* If headless is true, the engine renders offscreen without ever opening a
+	* window or initializing GLFW. This is intended for launch_eval() on machines
+	* without a display.
+	*/
+	RenderEngine(Graphics::Backend backend, bool headless = false);
 	RenderEngine(const RenderEngine&) = delete;
 	RenderEngine(RenderEngine&&) = delete;
 	RenderEngine& operator=(const RenderEngine&) = delete;
@@ -60,6 +67,7 @@ public:
 
 	Graphics* getGraphics();
 	InputContext* getInputContext();
+	ThreadPool* getThreadPool();
 
 	std::string getWindowTitle();
 	void setWindowTitle(std::string title);
@@ -115,6 +123,20 @@ public:
 	Depsgraph* getDepsgraph();
 
 
+	/*
+	* ===== GARBAGE COLLECTION =====
+	*/
+
+	/*
+	* Collects and frees datablocks that are no longer referenced, for at most the
+	* garbage collection budget. Called at the end of every frame by launch() and
+	* launch_eval(); a sweep that doesn't fit is resumed on the next call, so dropping
+	* many datablocks at once (e.g. unloading an asset) never stalls a single frame.
+	*/
+	void collectGarbage();
+	void setGarbageCollectBudget(std::chrono::microseconds budget);
+
+
 
 private:
 
@@ -141,6 +163,11 @@ private:
 
 	Depsgraph depsgraph;
 
+	/*
+	* Worker threads for data-parallel per-frame work, such as CPU light culling.
+	*/
+	ThreadPool threadPool;
+
 	/*
 	* Datablock Managers.
 	* These containers help maintain datablock IDs, manage memory (de)allocation, and
@@ -154,6 +181,10 @@ private:
 	DatablockManager<Material> materials;
 	DatablockManager<Texture> textures;
 
+	std::chrono::microseconds gcBudget = std::chrono::microseconds(500);
+	// The manager collectGarbage() is currently sweeping, in the order declared above.
+	int gcStage = 0;
+
 	/*
 	* ===== Current Context Information =====
 	*/
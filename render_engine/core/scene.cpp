@@ -5,6 +5,7 @@
 Scene::Scene(SceneID id, RenderEngine* engine) : Datablock(id), thisEngine(engine) {
 	if (this->thisEngine) {
 		this->root = this->thisEngine->createObject<GameObject>();
+		this->transforms.setRoot(this->root.get());
 	}
 }
 
@@ -47,6 +48,15 @@ void Scene::evaluateComponents(float deltaTime) {
 }
 
 
+void Scene::updateTransforms() {
+	this->transforms.update(this->thisEngine ? this->thisEngine->getThreadPool() : nullptr);
+}
+
+TransformHierarchy* Scene::getTransformHierarchy() {
+	return &this->transforms;
+}
+
+
 
 RenderEngine* Scene::getEngine() {
 	return this->thisEngine;
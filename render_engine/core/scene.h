@@ -1,5 +1,6 @@
 #pragma once
 #include "core/datablock.h"
+#include "core/transformhierarchy.h"
 #include "objects/gameobject.h"
 #include "objects/go_light.h"
 #include "objects/go_camera.h"
@@ -49,6 +50,13 @@ public:
 	*/
 	void evaluateComponents(float deltaTime);
 
+	/*
+	* Brings the world matrix of every object in this scene up to date in one sweep.
+	* Called once per frame, after components are evaluated and before rendering.
+	*/
+	void updateTransforms();
+	TransformHierarchy* getTransformHierarchy();
+
 
 	RenderEngine* getEngine();
 
@@ -64,6 +72,9 @@ private:
 
 	Ref<GameObject> root;
 
+	// Declared after root, so objects are detached before the root is released.
+	TransformHierarchy transforms;
+
 	WeakRef<GO_Camera> activeCamera;
 	
 };
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include "core/transformhierarchy.h"
+#include "objects/gameobject.h"
+#include "utils/threadpool.h"
+
+#include <algorithm>
+
+
+TransformHierarchy::~TransformHierarchy() {
+	for (GameObject* object : this->objects) {
+		if (object && object->transformHierarchy == this) {
+			object->transformHierarchy = nullptr;
+		}
+	}
+}
+
+
+void TransformHierarchy::setRoot(GameObject* root) {
+	this->root = root;
+	this->orderDirty = true;
+}
+
+void TransformHierarchy::invalidate() {
+	this->orderDirty = true;
+}
+
+void TransformHierarchy::detach(GameObject* object) {
+	if (object->transformHierarchy == this) {
+		this->objects[object->transformIndex] = nullptr;
+		object->transformHierarchy = nullptr;
+	}
+	for (const Ref<GameObject>& child : object->getChildren()) {
+		this->detach(child.get());
+	}
+	this->orderDirty = true;
+}
+
+void TransformHierarchy::markDirty(uint32_t index) {
+	// A rebuild recomputes everything anyway.
+	if (this->orderDirty || index >= this->objects.size()) {
+		return;
+	}
+	this->dirty[index] = 1;
+	if (this->dirtyBegin >= this->dirtyEnd) {
+		this->dirtyBegin = index;
+		this->dirtyEnd = this->subtreeEnds[index];
+	}
+	else {
+		this->dirtyBegin = std::min(this->dirtyBegin, index);
+		this->dirtyEnd = std::max(this->dirtyEnd, this->subtreeEnds[index]);
+	}
+}
+
+
+void TransformHierarchy::update(ThreadPool* threadPool) {
+	if (this->orderDirty) {
+		this->rebuild();
+	}
+	uint32_t begin = this->dirtyBegin;
+	uint32_t end = this->dirtyEnd;
+	if (begin >= end) {
+		return;
+	}
+	// Everything recomputed by this update shares one version.
+	uint64_t version = GameObject::newModelVersion();
+
+	if (threadPool && threadPool->getNumThreads() > 1 && end - begin >= parallelThreshold) {
+		// Every batch depends on the root, so it goes first.
+		uint32_t start = begin;
+		if (start == 0) {
+			this->sweep(0, 1, version);
+			start = 1;
+		}
+		// Split the rest between the root's children, grouping small subtrees together.
+		this->batches.clear();
+		uint32_t batchStart = start;
+		for (uint32_t child = 1; child < end; child = this->subtreeEnds[child]) {
+			uint32_t split = std::min(this->subtreeEnds[child], end);
+			if (split > batchStart && (split - batchStart >= minBatchSize || split == end)) {
+				this->batches.push_back({ batchStart, split });
+				batchStart = split;
+			}
+		}
+		threadPool->parallelFor(this->batches.size(), [this, version](size_t i) {
+			this->sweep(this->batches[i].first, this->batches[i].second, version);
+		});
+	}
+	else {
+		this->sweep(begin, end, version);
+	}
+
+	std::fill(this->dirty.begin() + begin, this->dirty.begin() + end, (uint8_t)0);
+	this->dirtyBegin = 0;
+	this->dirtyEnd = 0;
+}
+
+const glm::mat4& TransformHierarchy::getWorldMatrix(uint32_t index) const {
+	return this->worldMatrices[index];
+}
+
+uint64_t TransformHierarchy::getWorldVersion(uint32_t index) const {
+	return this->worldVersions[index];
+}
+
+size_t TransformHierarchy::size() const {
+	return this->objects.size();
+}
+
+
+void TransformHierarchy::rebuild() {
+	// Objects that left were already detached, so only the current tree needs visiting.
+	this->objects.clear();
+	this->parents.clear();
+	this->subtreeEnds.clear();
+	if (this->root) {
+		this->append(this->root, -1);
+	}
+	size_t numObjects = this->objects.size();
+	this->localMatrices.resize(numObjects);
+	this->worldMatrices.resize(numObjects);
+	this->worldVersions.resize(numObjects);
+	this->dirty.assign(numObjects, 1);
+	this->dirtyBegin = 0;
+	this->dirtyEnd = (uint32_t)numObjects;
+	this->orderDirty = false;
+}
+
+void TransformHierarchy::append(GameObject* object, int32_t parent) {
+	uint32_t index = (uint32_t)this->objects.size();
+	object->transformHierarchy = this;
+	object->transformIndex = index;
+	this->objects.push_back(object);
+	this->parents.push_back(parent);
+	this->subtreeEnds.push_back(0);
+	for (const Ref<GameObject>& child : object->getChildren()) {
+		this->append(child.get(), (int32_t)index);
+	}
+	this->subtreeEnds[index] = (uint32_t)this->objects.size();
+}
+
+void TransformHierarchy::sweep(uint32_t begin, uint32_t end, uint64_t version) {
+	for (uint32_t i = begin; i < end; i++) {
+		int32_t parent = this->parents[i];
+		if (this->dirty[i]) {
+			this->localMatrices[i] = this->objects[i]->getLocalMatrix();
+		}
+		else if (parent < 0 || !this->dirty[parent]) {
+			continue;
+		}
+		// Flagged, so its children are recomputed too.
+		this->dirty[i] = 1;
+		this->worldMatrices[i] = (parent < 0) ? this->localMatrices[i] :
+			this->worldMatrices[parent] * this->localMatrices[i];
+		this->worldVersions[i] = version;
+	}
+}
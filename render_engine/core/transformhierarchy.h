@@ -0,0 +1,90 @@
+#pragma once
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+class GameObject;
+class ThreadPool;
+
+
+/*
+* The world matrices of every object in a scene, kept in flat arrays (structure of arrays)
+* in depth-first order. Every object comes after its parent, and each subtree is one
+* contiguous range, so all world matrices can be brought up to date with a single forward
+* sweep instead of recursive lookups through parents.
+*
+* Objects report changes to their local transform with markDirty(), which is O(1): it flags
+* the object and widens the dirty range to cover its subtree. update() then sweeps only that
+* range, recomputing each object that was flagged or whose parent was. The subtrees of the
+* root's children don't depend on each other, so large sweeps are split between them and
+* run on a ThreadPool.
+*
+* The order is rebuilt on the next update() after any object is reparented or destroyed.
+* Each Scene owns one; see Scene::updateTransforms().
+*/
+class TransformHierarchy {
+public:
+
+	TransformHierarchy() = default;
+	TransformHierarchy(const TransformHierarchy& other) = delete;
+	TransformHierarchy& operator=(const TransformHierarchy& other) = delete;
+	~TransformHierarchy();
+
+	void setRoot(GameObject* root);
+
+	// Called when an object in the hierarchy gains a child.
+	void invalidate();
+	// Called when an object, and so its subtree, leaves the hierarchy (it is reparented
+	// or destroyed). The objects' world matrices are no longer tracked until the next
+	// update() finds them under the root again.
+	void detach(GameObject* object);
+	// Called when the local transform of the object at index changes.
+	void markDirty(uint32_t index);
+
+	/*
+	* Brings every world matrix up to date. If threadPool is given, sweeps of at least
+	* parallelThreshold objects are spread across it. Must not be called from a
+	* threadPool job; call it before handing objects to worker threads instead.
+	*/
+	void update(ThreadPool* threadPool = nullptr);
+
+	// As of the last update().
+	const glm::mat4& getWorldMatrix(uint32_t index) const;
+	// Changes whenever the world matrix at index does. See GameObject::getModelMatrix().
+	uint64_t getWorldVersion(uint32_t index) const;
+
+	size_t size() const;
+
+
+private:
+
+	static constexpr uint32_t parallelThreshold = 4096;
+	static constexpr uint32_t minBatchSize = 1024;
+
+	GameObject* root = nullptr;
+	bool orderDirty = true;
+
+	std::vector<GameObject*> objects;		// Null once destroyed, until the next rebuild.
+	std::vector<int32_t> parents;			// -1 for the root.
+	std::vector<uint32_t> subtreeEnds;		// One past the last descendant.
+	std::vector<glm::mat4> localMatrices;
+	std::vector<glm::mat4> worldMatrices;
+	std::vector<uint64_t> worldVersions;
+	std::vector<uint8_t> dirty;
+
+	// The range update() has to sweep. Empty when begin == end.
+	uint32_t dirtyBegin = 0;
+	uint32_t dirtyEnd = 0;
+
+	// Ranges of whole subtrees of the root, swept in parallel.
+	std::vector<std::pair<uint32_t, uint32_t>> batches;
+
+	void rebuild();
+	void append(GameObject* object, int32_t parent);
+	// Recomputes what is dirty in [begin, end), stamping it with version.
+	void sweep(uint32_t begin, uint32_t end, uint64_t version);
+
+};
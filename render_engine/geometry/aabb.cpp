@@ -0,0 +1,47 @@
+#include "geometry/aabb.h"
+
+
+AABB::AABB() {}
+AABB::AABB(glm::vec3 min, glm::vec3 max) {
+	this->min = min;
+	this->max = max;
+}
+
+bool AABB::isEmpty() const {
+	return this->min.x > this->max.x || this->min.y > this->max.y || this->min.z > this->max.z;
+}
+
+glm::vec3 AABB::getCenter() const {
+	return 0.5f * (this->min + this->max);
+}
+glm::vec3 AABB::getExtents() const {
+	return 0.5f * (this->max - this->min);
+}
+float AABB::getSurfaceArea() const {
+	if (this->isEmpty()) {
+		return 0.0f;
+	}
+	glm::vec3 d = this->max - this->min;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+void AABB::expand(glm::vec3 point) {
+	this->min = glm::min(this->min, point);
+	this->max = glm::max(this->max, point);
+}
+void AABB::expand(const AABB& other) {
+	this->min = glm::min(this->min, other.min);
+	this->max = glm::max(this->max, other.max);
+}
+
+AABB AABB::transformed(const glm::mat4& mat) const {
+	if (this->isEmpty()) {
+		return AABB();
+	}
+	// Transform the center, and project the extents onto each world axis (Arvo's method).
+	glm::vec3 center = glm::vec3(mat * glm::vec4(this->getCenter(), 1.0f));
+	glm::vec3 extents = this->getExtents();
+	glm::mat3 absMat = glm::mat3(glm::abs(glm::vec3(mat[0])), glm::abs(glm::vec3(mat[1])), glm::abs(glm::vec3(mat[2])));
+	glm::vec3 worldExtents = absMat * extents;
+	return AABB(center - worldExtents, center + worldExtents);
+}
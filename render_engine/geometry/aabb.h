@@ -0,0 +1,36 @@
+#pragma once
+#include "geometry/primitive.h"
+
+#include "glm/glm.hpp"
+
+#include <cmath>
+
+
+/*
+* Axis-aligned bounding box, defined by its minimum and maximum corners.
+* A default-constructed box is empty (min > max) and grows to fit anything expanded into it.
+*/
+class AABB : public Primitive {
+public:
+
+	glm::vec3 min = glm::vec3(INFINITY);
+	glm::vec3 max = glm::vec3(-INFINITY);
+
+
+	AABB();
+	AABB(glm::vec3 min, glm::vec3 max);
+
+	bool isEmpty() const;
+
+	glm::vec3 getCenter() const;
+	// Half the side lengths.
+	glm::vec3 getExtents() const;
+	float getSurfaceArea() const;
+
+	void expand(glm::vec3 point);
+	void expand(const AABB& other);
+
+	// The box enclosing this box after transformation by mat (which may not be axis-aligned).
+	AABB transformed(const glm::mat4& mat) const;
+
+};
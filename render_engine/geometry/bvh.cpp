@@ -0,0 +1,138 @@
+#include "geometry/bvh.h"
+
+#include <algorithm>
+
+
+void BVH::build(const std::vector<AABB>& boxes) {
+	this->clear();
+	this->boxes = boxes;
+	if (boxes.empty()) {
+		return;
+	}
+
+	this->boxIndices.resize(boxes.size());
+	this->centroids.resize(boxes.size());
+	for (uint32_t i = 0; i < (uint32_t)boxes.size(); i++) {
+		this->boxIndices[i] = i;
+		this->centroids[i] = boxes[i].isEmpty() ? glm::vec3(0.0f) : boxes[i].getCenter();
+	}
+
+	// A binary tree with n leaves has at most 2n - 1 nodes.
+	this->nodes.reserve(2 * boxes.size());
+	this->nodes.emplace_back();
+	this->buildNode(0, 0, (uint32_t)boxes.size(), boxes);
+}
+
+void BVH::buildNode(uint32_t nodeIndex, uint32_t begin, uint32_t end, const std::vector<AABB>& boxes) {
+	AABB bounds;
+	AABB centroidBounds;
+	for (uint32_t i = begin; i < end; i++) {
+		bounds.expand(boxes[this->boxIndices[i]]);
+		centroidBounds.expand(this->centroids[this->boxIndices[i]]);
+	}
+	this->nodes[nodeIndex].bounds = bounds;
+
+	glm::vec3 size = centroidBounds.max - centroidBounds.min;
+	if (end - begin <= MAX_LEAF_SIZE || (size.x <= 0.0f && size.y <= 0.0f && size.z <= 0.0f)) {
+		this->nodes[nodeIndex].first = begin;
+		this->nodes[nodeIndex].count = end - begin;
+		return;
+	}
+
+	int axis = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z ? 1 : 2);
+	uint32_t mid = begin + (end - begin) / 2;
+	std::nth_element(this->boxIndices.begin() + begin, this->boxIndices.begin() + mid, this->boxIndices.begin() + end,
+		[this, axis](uint32_t a, uint32_t b) {
+			return this->centroids[a][axis] < this->centroids[b][axis];
+		}
+	);
+
+	uint32_t children = (uint32_t)this->nodes.size();
+	this->nodes[nodeIndex].first = children;
+	this->nodes[nodeIndex].count = 0;
+	this->nodes.emplace_back();
+	this->nodes.emplace_back();
+	this->buildNode(children, begin, mid, boxes);
+	this->buildNode(children + 1, mid, end, boxes);
+}
+
+void BVH::refit(const std::vector<AABB>& boxes) {
+	this->boxes = boxes;
+	// Children come after their parents, so walking backwards visits them first.
+	for (size_t n = this->nodes.size(); n-- > 0;) {
+		Node& node = this->nodes[n];
+		AABB bounds;
+		if (node.count > 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; i++) {
+				bounds.expand(boxes[this->boxIndices[i]]);
+			}
+		}
+		else {
+			bounds.expand(this->nodes[node.first].bounds);
+			bounds.expand(this->nodes[node.first + 1].bounds);
+		}
+		node.bounds = bounds;
+	}
+}
+
+void BVH::clear() {
+	this->nodes.clear();
+	this->boxIndices.clear();
+	this->boxes.clear();
+}
+
+size_t BVH::getNumBoxes() const {
+	return this->boxes.size();
+}
+
+AABB BVH::getBounds() const {
+	return this->nodes.empty() ? AABB() : this->nodes[0].bounds;
+}
+
+template<typename Visit>
+void BVH::visitFrustum(const Frustum& frustum, Visit visit) const {
+	if (this->nodes.empty()) {
+		return;
+	}
+
+	// (node, whether it is already known to be entirely inside the frustum)
+	this->stack.clear();
+	this->stack.push_back({ 0, false });
+	while (!this->stack.empty()) {
+		auto [n, inside] = this->stack.back();
+		this->stack.pop_back();
+		const Node& node = this->nodes[n];
+
+		if (!inside) {
+			Frustum::Containment c = frustum.classify(node.bounds);
+			if (c == Frustum::Containment::Outside) {
+				continue;
+			}
+			inside = (c == Frustum::Containment::Inside);
+		}
+
+		if (node.count > 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; i++) {
+				// A leaf's bounds can be much larger than each of its boxes, so test them individually.
+				uint32_t box = this->boxIndices[i];
+				if (inside || node.count == 1 || frustum.intersects(this->boxes[box])) {
+					visit(box);
+				}
+			}
+		}
+		else {
+			this->stack.push_back({ node.first + 1, inside });
+			this->stack.push_back({ node.first, inside });
+		}
+	}
+}
+
+void BVH::cullFrustum(const Frustum& frustum, std::vector<uint8_t>& visible) const {
+	visible.assign(this->boxes.size(), 0);
+	this->visitFrustum(frustum, [&visible](uint32_t box) { visible[box] = 1; });
+}
+
+void BVH::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& indices) const {
+	indices.clear();
+	this->visitFrustum(frustum, [&indices](uint32_t box) { indices.push_back(box); });
+}
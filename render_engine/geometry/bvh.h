@@ -0,0 +1,61 @@
+#pragma once
+#include "geometry/aabb.h"
+#include "geometry/frustum.h"
+
+#include <cstdint>
+#include <vector>
+
+
+/*
+* A bounding volume hierarchy over a list of boxes, used to cull them against a frustum
+* without testing each one. Boxes are referred to by their index in the list.
+*
+* build() splits each node at the median centroid along its longest axis. When the boxes
+* move but the list keeps the same length and order, refit() updates the node bounds
+* bottom-up in linear time instead; the tree gets looser, but stays correct.
+*/
+class BVH {
+public:
+
+	static constexpr uint32_t MAX_LEAF_SIZE = 4;
+
+	void build(const std::vector<AABB>& boxes);
+	// boxes must have as many entries as the list given to the last build().
+	void refit(const std::vector<AABB>& boxes);
+	void clear();
+
+	size_t getNumBoxes() const;
+	// Bounds of everything in the tree (empty if there is nothing).
+	AABB getBounds() const;
+
+	// Resizes visible to getNumBoxes(), and sets each entry to 1 if the box intersects frustum, 0 if not.
+	void cullFrustum(const Frustum& frustum, std::vector<uint8_t>& visible) const;
+	// Sets indices to the boxes that intersect frustum, in no particular order. Unlike
+	// cullFrustum(), takes time in the number of boxes found rather than getNumBoxes().
+	void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& indices) const;
+
+private:
+
+	// A leaf if count > 0, holding boxIndices[first, first + count).
+	// Otherwise an inner node, whose children are nodes[first] and nodes[first + 1].
+	// Children always come after their parent.
+	struct Node {
+		AABB bounds;
+		uint32_t first = 0;
+		uint32_t count = 0;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> boxIndices;
+	std::vector<AABB> boxes;
+
+	// Scratch for build() and cullFrustum().
+	std::vector<glm::vec3> centroids;
+	mutable std::vector<std::pair<uint32_t, bool>> stack;
+
+	void buildNode(uint32_t nodeIndex, uint32_t begin, uint32_t end, const std::vector<AABB>& boxes);
+	// Calls visit(boxIndex) for each box that intersects frustum.
+	template<typename Visit>
+	void visitFrustum(const Frustum& frustum, Visit visit) const;
+
+};
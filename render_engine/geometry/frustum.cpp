@@ -0,0 +1,52 @@
+#include "geometry/frustum.h"
+
+
+Frustum::Frustum() {
+	// Contains everything.
+	for (glm::vec4& plane : this->planes) {
+		plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+Frustum::Frustum(const glm::mat4& viewProjMat) {
+	// Gribb & Hartmann: each clip plane is the last row of the matrix plus or minus another row.
+	glm::mat4 m = glm::transpose(viewProjMat);
+	this->planes[0] = m[3] + m[0];		// Left
+	this->planes[1] = m[3] - m[0];		// Right
+	this->planes[2] = m[3] + m[1];		// Bottom
+	this->planes[3] = m[3] - m[1];		// Top
+	this->planes[4] = m[3] + m[2];		// Near
+	this->planes[5] = m[3] - m[2];		// Far
+	for (glm::vec4& plane : this->planes) {
+		float len = glm::length(glm::vec3(plane));
+		if (len > 0.0f) {
+			plane /= len;
+		}
+	}
+}
+
+Frustum::Containment Frustum::classify(const AABB& box) const {
+	if (box.isEmpty()) {
+		return Containment::Outside;
+	}
+	glm::vec3 center = box.getCenter();
+	glm::vec3 extents = box.getExtents();
+	Containment result = Containment::Inside;
+	for (const glm::vec4& plane : this->planes) {
+		glm::vec3 n = glm::vec3(plane);
+		// Signed distance of the center, and the box's half-width along the normal.
+		float dist = glm::dot(n, center) + plane.w;
+		float radius = glm::dot(glm::abs(n), extents);
+		if (dist < -radius) {
+			return Containment::Outside;
+		}
+		if (dist < radius) {
+			result = Containment::Intersecting;
+		}
+	}
+	return result;
+}
+
+bool Frustum::intersects(const AABB& box) const {
+	return this->classify(box) != Containment::Outside;
+}
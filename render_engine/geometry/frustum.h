@@ -0,0 +1,32 @@
+#pragma once
+#include "geometry/primitive.h"
+#include "geometry/aabb.h"
+
+#include "glm/glm.hpp"
+
+
+/*
+* The volume seen through a view-projection matrix, as six inward-facing planes.
+* Works for both perspective and orthographic projections.
+*/
+class Frustum : public Primitive {
+public:
+
+	enum class Containment {
+		Outside,
+		Intersecting,
+		Inside,
+	};
+
+	// Each plane is (normal, d), with dot(normal, p) + d >= 0 inside. Normals are unit length.
+	glm::vec4 planes[6];
+
+
+	Frustum();
+	// Extracts the planes of viewProjMat's clip volume, in the space viewProjMat transforms from.
+	Frustum(const glm::mat4& viewProjMat);
+
+	Containment classify(const AABB& box) const;
+	bool intersects(const AABB& box) const;
+
+};
@@ -14,6 +14,7 @@ Graphics::~Graphics() {
 		delete this->pipeline;
 		this->pipeline = nullptr;
 	}
+	this->releaseGPUObjects();
 }
 
 
@@ -32,16 +33,17 @@ Graphics::Backend Graphics::getPreferredBackend() {
 	return Graphics::Backend::NONE;
 }
 
-Graphics* Graphics::openGraphics(RenderEngine* engine, Graphics::Backend backend) {
+Graphics* Graphics::openGraphics(RenderEngine* engine, Graphics::Backend backend, bool headless) {
 	if (backend == Graphics::Backend::NONE) {
-		backend = getPreferredBackend();
+		// Probing the preferred backend needs a window, which headless instances can't open.
+		backend = headless ? Graphics::Backend::OPENGL : getPreferredBackend();
 	}
 	Graphics* r = nullptr;
 	switch (backend) {
 	case Graphics::Backend::OPENGL:
 	{
-		Graphics_OpenGL* g = new Graphics_OpenGL();
-		if (g->getWindow()) {
+		Graphics_OpenGL* g = new Graphics_OpenGL(headless);
+		if (g->hasContext()) {
 			r = (Graphics*)g;
 		}
 		else {
@@ -65,6 +67,14 @@ Graphics::Backend Graphics::getBackend() {
 	return this->backend;
 }
 
+bool Graphics::isHeadless() {
+	return this->headless;
+}
+
+RenderEngine* Graphics::getEngine() {
+	return this->thisEngine;
+}
+
 std::string Graphics::getBackendString() {
 	return "None";
 }
@@ -79,18 +89,31 @@ GLFWwindow* Graphics::getWindow() {
 
 // TODO: Cache?
 size_t Graphics::getWidth() {
+	if (this->headless) {
+		return this->headlessWidth;
+	}
 	int w, h;
 	glfwGetFramebufferSize(this->window, &w, &h);
 	return (size_t)w;
 }
 
 size_t Graphics::getHeight() {
+	if (this->headless) {
+		return this->headlessHeight;
+	}
 	int w, h;
 	glfwGetFramebufferSize(this->window, &w, &h);
 	return (size_t)h;
 }
 
+void Graphics::prepare(Scene* scene) {
+	if (this->pipeline) {
+		this->pipeline->prepare(scene);
+	}
+}
+
 void Graphics::render(Scene* scene) {
+	this->releaseGPUObjects();
 	if (this->pipeline) {
 		this->pipeline->render(scene);
 	}
@@ -134,6 +157,33 @@ RenderPipeline* Graphics::getRenderPipeline() {
 }
 
 
+void Graphics::releaseMesh(GPUMesh* gpuMesh) {
+	std::lock_guard<std::mutex> lock(this->releasedMutex);
+	this->releasedMeshes.push_back(gpuMesh);
+}
+
+void Graphics::releaseTexture(GPUTexture* gpuTexture) {
+	std::lock_guard<std::mutex> lock(this->releasedMutex);
+	this->releasedTextures.push_back(gpuTexture);
+}
+
+void Graphics::releaseGPUObjects() {
+	std::vector<GPUMesh*> meshes;
+	std::vector<GPUTexture*> textures;
+	{
+		std::lock_guard<std::mutex> lock(this->releasedMutex);
+		meshes.swap(this->releasedMeshes);
+		textures.swap(this->releasedTextures);
+	}
+	for (GPUMesh* gpuMesh : meshes) {
+		delete gpuMesh;
+	}
+	for (GPUTexture* gpuTexture : textures) {
+		delete gpuTexture;
+	}
+}
+
+
 
 GPUTexture::GPUTexture(Texture* thisTexture) {
 	this->thisTexture = thisTexture;
@@ -5,7 +5,9 @@
 
 #include "glm/glm.hpp"
 
+#include <mutex>
 #include <string>
+#include <vector>
 
 
 struct GLFWwindow;
@@ -37,14 +39,25 @@ public:
 	/*
 	* Returns a new Graphics instance using the given backend, or nullptr on error.
 	* If the given backend is NONE, the preferred backend for this platform is used.
+	* If headless is true, the instance renders offscreen and never opens a window.
 	*/
-	static Graphics* openGraphics(RenderEngine* engine, Graphics::Backend backend);
+	static Graphics* openGraphics(RenderEngine* engine, Graphics::Backend backend, bool headless = false);
 
 	/*
 	* Returns the enum associated with the backend of this Graphics instance.
 	*/
 	Graphics::Backend getBackend();
 
+	/*
+	* Returns whether this Graphics instance renders offscreen, without a window.
+	*/
+	bool isHeadless();
+
+	/*
+	* Returns the engine that owns this Graphics instance.
+	*/
+	RenderEngine* getEngine();
+
 	/*
 	* Returns the name of the backend of this Graphics instance. This may be more
 	* specific than the enum, i.e. it may include a version number.
@@ -79,6 +92,20 @@ public:
 	virtual GPUMesh* createMesh() = 0;
 	virtual GPUTexture* createTexture(Texture* thisTexture) = 0;
 
+	/*
+	* GPU objects must be deleted on the render thread, while the context is current, but
+	* the Meshes and Textures that own them can be destroyed by garbage collection at any
+	* point. These hand a GPU object over (from any thread) to be deleted at the start of
+	* the next render(), or when the context is destroyed.
+	*/
+	void releaseMesh(GPUMesh* gpuMesh);
+	void releaseTexture(GPUTexture* gpuTexture);
+
+	/*
+	* Deletes every GPU object released so far. Render thread only.
+	*/
+	void releaseGPUObjects();
+
 
 
 	/*
@@ -90,6 +117,9 @@ public:
 	* If a render pipeline has not been selected with setRenderPipeline() before
 	* this call, DefaultRenderPipeline is selected.
 	* 
+	* When headless, no window is created. Instead, an offscreen framebuffer of the
+	* given size is allocated as the render target, and fullscreen is ignored.
+	* 
 	* The "virtual" keyword makes it so classes that inherit from this class can
 	* override this method.
 	*/
@@ -106,7 +136,7 @@ public:
 	virtual void destroyWindow() = 0;
 
 	/*
-	* Returns the pointer to the GLFW window.
+	* Returns the pointer to the GLFW window, or nullptr when headless.
 	*/
 	GLFWwindow* getWindow();
 
@@ -125,6 +155,11 @@ public:
 	*/
 	virtual void swapBuffers() = 0;
 
+	/*
+	* Does the current render pipeline's per-scene setup ahead of the first render().
+	*/
+	void prepare(Scene* scene);
+
 	/*
 	* Render the given scene to the window.
 	*/
@@ -176,6 +211,21 @@ protected:
 	*/
 	GLFWwindow* window = nullptr;
 
+	/*
+	* Headless instances have no window, so the size of the offscreen render target
+	* is tracked here instead.
+	*/
+	bool headless = false;
+	size_t headlessWidth = 0;
+	size_t headlessHeight = 0;
+
+	/*
+	* GPU objects waiting for releaseGPUObjects().
+	*/
+	std::mutex releasedMutex;
+	std::vector<GPUMesh*> releasedMeshes;
+	std::vector<GPUTexture*> releasedTextures;
+
 
 };
 
@@ -5,28 +5,48 @@
 #include "graphics/pipeline/rp_forward_opengl.h"
 #include "graphics/pipeline/rp_none_opengl.h"
 #include "io/callbacks_glfw.h"
+#include "utils/platform.h"
 
+#include <cstdio>
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <mutex>
 
-// TODO: Shader errors currently rely on MessageBox from Windows.h.
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// TODO: Shader errors are reported through Utils::Platform::errorMessage.
 // When a proper logging system has been implemented, switch to that.
-#include <Windows.h>
 
 
-Graphics_OpenGL::Graphics_OpenGL() {
+Graphics_OpenGL::Graphics_OpenGL(bool headless) {
 	this->backend = Graphics::Backend::OPENGL;
+	this->headless = headless;
 
-	glfwDefaultWindowHints();
-	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+	if (headless) {
+		if (!this->createHeadlessContext()) {
+			return;
+		}
+		// Core profile contexts need this for GLEW to load every entry point.
+		glewExperimental = GL_TRUE;
+	}
+	else {
+		glfwDefaultWindowHints();
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
-	this->window = glfwCreateWindow(512, 512, "Hello World!", NULL, NULL);
-	if (!this->window) {
-		return;
+		this->window = glfwCreateWindow(512, 512, "Hello World!", NULL, NULL);
+		if (!this->window) {
+			return;
+		}
+		glfwMakeContextCurrent(this->window);
 	}
-	glfwMakeContextCurrent(this->window);
 
 	// TODO: Track whether GLEW is initialized?
 	glewInit();
@@ -37,6 +57,9 @@ Graphics_OpenGL::Graphics_OpenGL() {
 	auto renderer = glGetString(GL_RENDERER);
 	this->gpuName = std::string((char*)vendor) + " " + std::string((char*)renderer);
 
+	// Relative to the working directory, like the shader sources.
+	Shader_OpenGL::setBinaryCacheDir("shader_cache");
+
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
 	glEnable(GL_TEXTURE_2D);
@@ -46,10 +69,163 @@ Graphics_OpenGL::Graphics_OpenGL() {
 }
 
 Graphics_OpenGL::~Graphics_OpenGL() {
-	glfwTerminate();
+	// While the context still exists.
+	this->releaseGPUObjects();
+	if (this->headless) {
+		this->deleteTargetFramebuffer();
+		this->destroyHeadlessContext();
+	}
+	else {
+		glfwTerminate();
+	}
 	this->window = nullptr;
 };
 
+bool Graphics_OpenGL::hasContext() {
+	return this->window || this->eglContext;
+}
+
+GLuint Graphics_OpenGL::getTargetFramebuffer() {
+	return this->targetFBO;
+}
+
+bool Graphics_OpenGL::createHeadlessContext() {
+#ifdef __linux__
+	// Prefer Mesa's surfaceless platform, which needs no display server at all.
+	EGLDisplay display = EGL_NO_DISPLAY;
+	const char* clientExts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (clientExts && getPlatformDisplay && std::strstr(clientExts, "EGL_MESA_platform_surfaceless")) {
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+	if (display == EGL_NO_DISPLAY) {
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+		std::cout << "ERROR: Failed to initialize EGL display" << std::endl;
+		return false;
+	}
+	this->eglDisplay = display;
+
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		std::cout << "ERROR: EGL does not support desktop OpenGL" << std::endl;
+		this->destroyHeadlessContext();
+		return false;
+	}
+
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+	EGLConfig config = nullptr;
+	EGLint numConfigs = 0;
+	if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs < 1) {
+		std::cout << "ERROR: No suitable EGL config" << std::endl;
+		this->destroyHeadlessContext();
+		return false;
+	}
+
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+	if (context == EGL_NO_CONTEXT) {
+		std::cout << "ERROR: Failed to create an OpenGL 4.3 EGL context" << std::endl;
+		this->destroyHeadlessContext();
+		return false;
+	}
+	this->eglContext = context;
+
+	// Everything is drawn to targetFBO, so no real surface is needed.
+	// Fall back to a 1x1 pbuffer where surfaceless contexts aren't supported.
+	EGLSurface surface = EGL_NO_SURFACE;
+	const char* displayExts = eglQueryString(display, EGL_EXTENSIONS);
+	if (!displayExts || !std::strstr(displayExts, "EGL_KHR_surfaceless_context")) {
+		const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+		this->eglSurface = surface;
+	}
+	if (!eglMakeCurrent(display, surface, surface, context)) {
+		std::cout << "ERROR: Failed to make the EGL context current" << std::endl;
+		this->destroyHeadlessContext();
+		return false;
+	}
+	return true;
+#else
+	std::cout << "ERROR: Headless rendering requires EGL, which is unavailable on this platform" << std::endl;
+	return false;
+#endif
+}
+
+void Graphics_OpenGL::destroyHeadlessContext() {
+#ifdef __linux__
+	if (!this->eglDisplay) {
+		return;
+	}
+	EGLDisplay display = (EGLDisplay)this->eglDisplay;
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (this->eglSurface) {
+		eglDestroySurface(display, (EGLSurface)this->eglSurface);
+	}
+	if (this->eglContext) {
+		eglDestroyContext(display, (EGLContext)this->eglContext);
+	}
+	eglTerminate(display);
+#endif
+	this->eglDisplay = nullptr;
+	this->eglContext = nullptr;
+	this->eglSurface = nullptr;
+}
+
+void Graphics_OpenGL::resizeTargetFramebuffer(size_t width, size_t height) {
+	this->deleteTargetFramebuffer();
+	this->headlessWidth = width;
+	this->headlessHeight = height;
+
+	glGenFramebuffers(1, &this->targetFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, this->targetFBO);
+
+	glGenRenderbuffers(1, &this->targetColorRB);
+	glBindRenderbuffer(GL_RENDERBUFFER, this->targetColorRB);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, (GLsizei)width, (GLsizei)height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->targetColorRB);
+
+	// Same format as the pipelines' depth buffers, since the deferred pipeline blits depth into it.
+	glGenRenderbuffers(1, &this->targetDepthRB);
+	glBindRenderbuffer(GL_RENDERBUFFER, this->targetDepthRB);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, (GLsizei)width, (GLsizei)height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->targetDepthRB);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cout << "ERROR: Offscreen framebuffer incomplete" << std::endl;
+	}
+	// Left bound, since pipelines that never switch framebuffers draw to whatever is bound.
+}
+
+void Graphics_OpenGL::deleteTargetFramebuffer() {
+	if (this->targetFBO) {
+		glDeleteFramebuffers(1, &this->targetFBO);
+		this->targetFBO = 0;
+	}
+	if (this->targetColorRB) {
+		glDeleteRenderbuffers(1, &this->targetColorRB);
+		this->targetColorRB = 0;
+	}
+	if (this->targetDepthRB) {
+		glDeleteRenderbuffers(1, &this->targetDepthRB);
+		this->targetDepthRB = 0;
+	}
+}
+
 std::string Graphics_OpenGL::getBackendString() {
 	return "OpenGL " + std::to_string(this->GLmajorVersion) +
 		"." + std::to_string(this->GLminorVersion);
@@ -89,6 +265,9 @@ void Graphics_OpenGL::setRenderPipeline(RenderPipelineType pipelineType) {
 }
 
 void Graphics_OpenGL::resizeFramebuffer(size_t width, size_t height) {
+	if (this->headless) {
+		this->resizeTargetFramebuffer(width, height);
+	}
 	glViewport(0, 0, (GLsizei)width, (GLsizei)height);
 	if (this->pipeline) {
 		this->pipeline->resizeFramebuffer(width, height);
@@ -96,7 +275,7 @@ void Graphics_OpenGL::resizeFramebuffer(size_t width, size_t height) {
 }
 
 GPUMesh* Graphics_OpenGL::createMesh() {
-	return new GPUMesh_OpenGL();
+	return new GPUMesh_OpenGL(this->meshArena);
 }
 GPUTexture* Graphics_OpenGL::createTexture(Texture* thisTexture) {
 	return new GPUTexture_OpenGL(thisTexture);
@@ -108,6 +287,17 @@ bool Graphics_OpenGL::createWindow(
 	size_t height,
 	bool fullscreen
 ) {
+	if (this->headless) {
+		if (!this->pipeline) {
+			this->setRenderPipeline(DefaultRenderPipeline);
+			if (!this->pipeline) {
+				return false;
+			}
+		}
+		this->resizeFramebuffer(width, height);
+		return true;
+	}
+
 	glfwSetWindowTitle(this->window, window_title.c_str());
 	glfwSetWindowSize(this->window, (int)width, (int)height);
 	glViewport(0, 0, (GLsizei)width, (GLsizei)height);
@@ -153,24 +343,55 @@ bool Graphics_OpenGL::createWindow(
 }
 
 void Graphics_OpenGL::destroyWindow() {
+	if (this->headless) {
+		return;
+	}
 	glfwHideWindow(this->window);
 }
 
 
 bool Graphics_OpenGL::pollEvents() {
+	if (this->headless) {
+		return true;
+	}
 	glfwPollEvents();
 	return !glfwWindowShouldClose(this->window);
 }
 
 void Graphics_OpenGL::swapBuffers() {
+	// Headless output stays in targetFBO to be read back, so there is nothing to present.
+	// Still wait for the GPU so frame times measure the same work as a real swap.
+	if (this->headless) {
+		glFinish();
+		return;
+	}
 	glfwSwapBuffers(this->window);
 }
 
+bool Graphics_OpenGL::enableMultiDrawIndirect() {
+	if (this->meshArena) {
+		return true;
+	}
+	// gl_BaseInstanceARB is how shaders find each command's first object.
+	if (!GLEW_VERSION_4_3 || !GLEW_ARB_shader_draw_parameters) {
+		return false;
+	}
+	this->meshArena = std::make_shared<MeshArena_OpenGL>();
+	return true;
+}
+
+bool Graphics_OpenGL::isMultiDrawIndirectEnabled() {
+	return (bool)this->meshArena;
+}
+
 
 /*
 * ===== GPUMesh =====
 */
 
+GPUMesh_OpenGL::GPUMesh_OpenGL(std::shared_ptr<MeshArena_OpenGL> arena)
+	: arena(std::move(arena)) {}
+
 GPUMesh_OpenGL::~GPUMesh_OpenGL() {
 	this->deleteVAO();
 }
@@ -182,20 +403,63 @@ bool GPUMesh_OpenGL::uploadFrom(const Mesh& mesh) {
 }
 
 void GPUMesh_OpenGL::draw() {
-	if (!this->VAO) {
+	GLuint vao = this->getVAO();
+	if (!vao) {
 		return;
 	}
-	glBindVertexArray(this->VAO);
+	glBindVertexArray(vao);
 	// TODO: Bind textures.
-	glDrawElements(GL_TRIANGLES, (GLsizei)this->numIdxs, GL_UNSIGNED_INT, 0);
+	this->drawBound();
 	glBindVertexArray(0);
 }
 
+void GPUMesh_OpenGL::drawBound(GLsizei instanceCount, GLuint baseInstance) {
+	GLint baseVertex = 0;
+	size_t firstIndex = 0;
+	if (this->arenaAllocated) {
+		baseVertex = this->arenaRange.baseVertex;
+		firstIndex = this->arenaRange.firstIndex;
+	}
+	glDrawElementsInstancedBaseVertexBaseInstance(
+		GL_TRIANGLES, (GLsizei)this->numIdxs, GL_UNSIGNED_INT,
+		(const void*)(firstIndex * sizeof(VertexIndex)),
+		instanceCount, baseVertex, baseInstance
+	);
+}
+
+GLuint GPUMesh_OpenGL::getVAO() {
+	if (this->arenaAllocated) {
+		return this->arena->getVAO();
+	}
+	return this->VAO;
+}
+
+bool GPUMesh_OpenGL::isInArena() {
+	return this->arenaAllocated;
+}
+
+DrawElementsIndirectCommand GPUMesh_OpenGL::getIndirectCommand(GLuint instanceCount, GLuint baseInstance) {
+	DrawElementsIndirectCommand cmd;
+	cmd.count = this->arenaRange.numIdxs;
+	cmd.instanceCount = instanceCount;
+	cmd.firstIndex = this->arenaRange.firstIndex;
+	cmd.baseVertex = this->arenaRange.baseVertex;
+	cmd.baseInstance = baseInstance;
+	return cmd;
+}
+
 bool GPUMesh_OpenGL::setupVAO(
 	size_t numVerts, size_t numIdxs, const Vertex* verts, const VertexIndex* idxs
 ) {
 	this->deleteVAO();
 
+	if (this->arena) {
+		this->arenaRange = this->arena->allocate(numVerts, numIdxs, verts, idxs);
+		this->arenaAllocated = true;
+		this->numIdxs = numIdxs;
+		return true;
+	}
+
 	glGenVertexArrays(1, &this->VAO);
 	glGenBuffers(1, &this->VBO);
 	glGenBuffers(1, &this->EBO);
@@ -233,6 +497,11 @@ bool GPUMesh_OpenGL::setupVAO(
 }
 
 void GPUMesh_OpenGL::deleteVAO() {
+	if (this->arenaAllocated) {
+		this->arena->free(this->arenaRange);
+		this->arenaRange = MeshArena_OpenGL::Range();
+		this->arenaAllocated = false;
+	}
 	if (glIsVertexArray(this->VAO)) {
 		glDeleteVertexArrays(1, &this->VAO);
 		this->VAO = 0;
@@ -249,6 +518,126 @@ void GPUMesh_OpenGL::deleteVAO() {
 }
 
 
+
+/*
+* ===== MeshArena =====
+*/
+
+MeshArena_OpenGL::MeshArena_OpenGL() {
+	glGenVertexArrays(1, &this->VAO);
+	glBindVertexArray(this->VAO);
+
+	// Separate attribute formats, so growing the vertex buffer only needs glBindVertexBuffer.
+	glVertexAttribFormat((GLuint)Graphics_OpenGL::VertAttribs::Position,
+		3, GL_FLOAT, GL_FALSE, offsetof(Vertex, position));
+	glVertexAttribFormat((GLuint)Graphics_OpenGL::VertAttribs::Normal,
+		3, GL_FLOAT, GL_FALSE, offsetof(Vertex, normal));
+	glVertexAttribFormat((GLuint)Graphics_OpenGL::VertAttribs::Tangent,
+		3, GL_FLOAT, GL_FALSE, offsetof(Vertex, tangent));
+	glVertexAttribFormat((GLuint)Graphics_OpenGL::VertAttribs::Bitangent,
+		3, GL_FLOAT, GL_FALSE, offsetof(Vertex, bitangent));
+	glVertexAttribFormat((GLuint)Graphics_OpenGL::VertAttribs::UV,
+		2, GL_FLOAT, GL_FALSE, offsetof(Vertex, uv));
+
+	for (Graphics_OpenGL::VertAttribs attrib : {
+		Graphics_OpenGL::VertAttribs::Position,
+		Graphics_OpenGL::VertAttribs::Normal,
+		Graphics_OpenGL::VertAttribs::Tangent,
+		Graphics_OpenGL::VertAttribs::Bitangent,
+		Graphics_OpenGL::VertAttribs::UV,
+	}) {
+		glVertexAttribBinding((GLuint)attrib, 0);
+		glEnableVertexAttribArray((GLuint)attrib);
+	}
+
+	glBindVertexArray(0);
+}
+
+MeshArena_OpenGL::~MeshArena_OpenGL() {
+	if (glIsVertexArray(this->VAO)) {
+		glDeleteVertexArrays(1, &this->VAO);
+	}
+	if (glIsBuffer(this->VBO)) {
+		glDeleteBuffers(1, &this->VBO);
+	}
+	if (glIsBuffer(this->EBO)) {
+		glDeleteBuffers(1, &this->EBO);
+	}
+}
+
+MeshArena_OpenGL::Range MeshArena_OpenGL::allocate(
+	size_t numVerts, size_t numIdxs, const Vertex* verts, const VertexIndex* idxs
+) {
+	if (this->vertCount + numVerts > this->vertCapacity) {
+		size_t newCapacity = std::max(this->vertCount + numVerts, this->vertCapacity * 2);
+		growBuffer(this->VBO, this->vertCount * sizeof(Vertex), newCapacity * sizeof(Vertex));
+		this->vertCapacity = newCapacity;
+		glBindVertexArray(this->VAO);
+		glBindVertexBuffer(0, this->VBO, 0, sizeof(Vertex));
+		glBindVertexArray(0);
+	}
+	if (this->idxCount + numIdxs > this->idxCapacity) {
+		size_t newCapacity = std::max(this->idxCount + numIdxs, this->idxCapacity * 2);
+		growBuffer(this->EBO, this->idxCount * sizeof(VertexIndex), newCapacity * sizeof(VertexIndex));
+		this->idxCapacity = newCapacity;
+		// The element buffer binding is VAO state.
+		glBindVertexArray(this->VAO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+		glBindVertexArray(0);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, this->VBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER,
+		this->vertCount * sizeof(Vertex), numVerts * sizeof(Vertex), verts);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, this->EBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER,
+		this->idxCount * sizeof(VertexIndex), numIdxs * sizeof(VertexIndex), idxs);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	Range range;
+	range.baseVertex = (GLint)this->vertCount;
+	range.firstIndex = (GLuint)this->idxCount;
+	range.numIdxs = (GLuint)numIdxs;
+	this->vertCount += numVerts;
+	this->idxCount += numIdxs;
+	this->numLiveRanges++;
+	return range;
+}
+
+void MeshArena_OpenGL::free(const Range& range) {
+	if (this->numLiveRanges == 0) {
+		return;
+	}
+	this->numLiveRanges--;
+	// Holes are not reused, but once nothing is left the whole arena can be refilled.
+	if (this->numLiveRanges == 0) {
+		this->vertCount = 0;
+		this->idxCount = 0;
+	}
+}
+
+GLuint MeshArena_OpenGL::getVAO() {
+	return this->VAO;
+}
+
+void MeshArena_OpenGL::growBuffer(GLuint& buffer, size_t usedBytes, size_t newBytes) {
+	GLuint newBuffer = 0;
+	glGenBuffers(1, &newBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+	if (buffer && usedBytes > 0) {
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	if (buffer) {
+		glDeleteBuffers(1, &buffer);
+	}
+	buffer = newBuffer;
+}
+
+
 /*
 * ===== GPUTexture =====
 */
@@ -322,6 +711,40 @@ GLenum GPUTexture_OpenGL::numChannelsToFormat(size_t numChannels) {
 
 
 
+// Names are kept in a deque so that interning never moves existing names.
+struct UniformRegistry {
+	std::mutex mutex;
+	std::unordered_map<std::string, size_t> ids;
+	std::deque<std::string> names;
+};
+static UniformRegistry& getUniformRegistry() {
+	static UniformRegistry registry;
+	return registry;
+}
+
+UniformID::UniformID(const std::string& name) {
+	UniformRegistry& registry = getUniformRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	auto it = registry.ids.find(name);
+	if (it == registry.ids.end()) {
+		it = registry.ids.emplace(name, registry.names.size()).first;
+		registry.names.push_back(name);
+	}
+	this->index = it->second;
+}
+UniformID::UniformID(const char* name) : UniformID(std::string(name)) {}
+
+size_t UniformID::getIndex() const {
+	return this->index;
+}
+std::string UniformID::getName() const {
+	UniformRegistry& registry = getUniformRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	return registry.names[this->index];
+}
+
+
+
 Shader_OpenGL::Shader_OpenGL() {}
 Shader_OpenGL::Shader_OpenGL(const Shader_OpenGL& shader) {
 	*this = shader;
@@ -331,14 +754,14 @@ Shader_OpenGL::Shader_OpenGL(Shader_OpenGL&& shader) {
 }
 Shader_OpenGL& Shader_OpenGL::operator=(const Shader_OpenGL& shader) {
 	this->programID = shader.programID;
-	this->uniforms = shader.uniforms;
+	this->uniformLocations = shader.uniformLocations;
 	return *this;
 }
 Shader_OpenGL& Shader_OpenGL::operator=(Shader_OpenGL&& shader) {
 	this->programID = shader.programID;
-	this->uniforms = std::move(shader.uniforms);
+	this->uniformLocations = std::move(shader.uniformLocations);
 	shader.programID = 0;
-	shader.uniforms.clear();
+	shader.uniformLocations.clear();
 	return operator=((const Shader_OpenGL&)shader);
 }
 
@@ -355,7 +778,7 @@ void Shader_OpenGL::readCompute(std::filesystem::path path) {
 
 	file.open(path);
 	if (!file.is_open()) {
-		MessageBoxA(NULL, "Could not find file", "Compute Shader", MB_OK | MB_ICONERROR);
+		Utils::Platform::errorMessage("Compute Shader", "Could not find file");
 	}
 	while (std::getline(file, line)) {
 		vertcode << line << "\n";
@@ -370,7 +793,7 @@ void Shader_OpenGL::read(std::filesystem::path vertPath) {
 
 	file.open(vertPath);
 	if (!file.is_open()) {
-		MessageBoxA(NULL, "Could not find file", "Vert Shader", MB_OK | MB_ICONERROR);
+		Utils::Platform::errorMessage("Vert Shader", "Could not find file");
 	}
 	while (std::getline(file, line)) {
 		vertcode << line << "\n";
@@ -386,7 +809,7 @@ void Shader_OpenGL::read(std::filesystem::path vertPath, std::filesystem::path f
 
 	file.open(vertPath);
 	if (!file.is_open()) {
-		MessageBoxA(NULL, "Could not find file", "Vert Shader", MB_OK | MB_ICONERROR);
+		Utils::Platform::errorMessage("Vert Shader", "Could not find file");
 	}
 	while (std::getline(file, line)) {
 		vertcode << line << "\n";
@@ -394,7 +817,7 @@ void Shader_OpenGL::read(std::filesystem::path vertPath, std::filesystem::path f
 	file.close();
 	file.open(fragPath);
 	if (!file.is_open()) {
-		MessageBoxA(NULL, "Could not find file", "Frag Shader", MB_OK | MB_ICONERROR);
+		Utils::Platform::errorMessage("Frag Shader", "Could not find file");
 	}
 	while (std::getline(file, line)) {
 		fragcode << line << "\n";
@@ -411,7 +834,7 @@ void Shader_OpenGL::read(std::filesystem::path vertPath, std::filesystem::path g
 
 	file.open(vertPath);
 	if (!file.is_open()) {
-		MessageBoxA(NULL, "Could not find file", "Vert Shader", MB_OK | MB_ICONERROR);
+		Utils::Platform::errorMessage("Vert Shader", "Could not find file");
 	}
 	while (std::getline(file, line)) {
 		vertcode << line << "\n";
@@ -419,7 +842,7 @@ void Shader_OpenGL::read(std::filesystem::path vertPath, std::filesystem::path g
 	file.close();
 	file.open(geomPath);
 	if (!file.is_open()) {
-		MessageBoxA(NULL, "Could not find file", "Geom Shader", MB_OK | MB_ICONERROR);
+		Utils::Platform::errorMessage("Geom Shader", "Could not find file");
 	}
 	while (std::getline(file, line)) {
 		geomcode << line << "\n";
@@ -427,7 +850,7 @@ void Shader_OpenGL::read(std::filesystem::path vertPath, std::filesystem::path g
 	file.close();
 	file.open(fragPath);
 	if (!file.is_open()) {
-		MessageBoxA(NULL, "Could not find file", "Frag Shader", MB_OK | MB_ICONERROR);
+		Utils::Platform::errorMessage("Frag Shader", "Could not find file");
 	}
 	while (std::getline(file, line)) {
 		fragcode << line << "\n";
@@ -440,6 +863,10 @@ void Shader_OpenGL::read(std::filesystem::path vertPath, std::filesystem::path g
 
 void Shader_OpenGL::compileCompute(std::string code) {
 	this->clear();
+	uint64_t key = getBinaryKey({ &code });
+	if (this->loadBinary(key)) {
+		return;
+	}
 	GLuint vs = glCreateShader(GL_COMPUTE_SHADER);
 	// We must extract the pointers so we can pass a multi-dim array.
 	const char* vc = code.c_str();
@@ -449,7 +876,9 @@ void Shader_OpenGL::compileCompute(std::string code) {
 	if (success) {
 		this->programID = glCreateProgram();
 		glAttachShader(this->programID, vs);
+		glProgramParameteri(this->programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 		glLinkProgram(this->programID);
+		this->saveBinary(key);
 	}
 	else {
 		this->programID = 0;
@@ -458,6 +887,10 @@ void Shader_OpenGL::compileCompute(std::string code) {
 }
 void Shader_OpenGL::compile(std::string vertCode) {
 	this->clear();
+	uint64_t key = getBinaryKey({ &vertCode });
+	if (this->loadBinary(key)) {
+		return;
+	}
 	GLuint vs = glCreateShader(GL_VERTEX_SHADER);
 	// We must extract the pointers so we can pass a multi-dim array.
 	const char* vc = vertCode.c_str();
@@ -467,7 +900,9 @@ void Shader_OpenGL::compile(std::string vertCode) {
 	if (success) {
 		this->programID = glCreateProgram();
 		glAttachShader(this->programID, vs);
+		glProgramParameteri(this->programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 		glLinkProgram(this->programID);
+		this->saveBinary(key);
 	}
 	else {
 		this->programID = 0;
@@ -476,6 +911,10 @@ void Shader_OpenGL::compile(std::string vertCode) {
 }
 void Shader_OpenGL::compile(std::string vertCode, std::string fragCode) {
 	this->clear();
+	uint64_t key = getBinaryKey({ &vertCode, &fragCode });
+	if (this->loadBinary(key)) {
+		return;
+	}
 	GLuint vs = glCreateShader(GL_VERTEX_SHADER);
 	GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
 	// We must extract the pointers so we can pass a multi-dim array.
@@ -491,7 +930,9 @@ void Shader_OpenGL::compile(std::string vertCode, std::string fragCode) {
 		this->programID = glCreateProgram();
 		glAttachShader(this->programID, vs);
 		glAttachShader(this->programID, fs);
+		glProgramParameteri(this->programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 		glLinkProgram(this->programID);
+		this->saveBinary(key);
 	}
 	else {
 		this->programID = 0;
@@ -501,6 +942,10 @@ void Shader_OpenGL::compile(std::string vertCode, std::string fragCode) {
 }
 void Shader_OpenGL::compile(std::string vertCode, std::string geomCode, std::string fragCode) {
 	this->clear();
+	uint64_t key = getBinaryKey({ &vertCode, &geomCode, &fragCode });
+	if (this->loadBinary(key)) {
+		return;
+	}
 	GLuint vs = glCreateShader(GL_VERTEX_SHADER);
 	GLuint gs = glCreateShader(GL_GEOMETRY_SHADER);
 	GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
@@ -522,7 +967,9 @@ void Shader_OpenGL::compile(std::string vertCode, std::string geomCode, std::str
 		glAttachShader(this->programID, vs);
 		glAttachShader(this->programID, gs);
 		glAttachShader(this->programID, fs);
+		glProgramParameteri(this->programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 		glLinkProgram(this->programID);
+		this->saveBinary(key);
 	}
 	else {
 		this->programID = 0;
@@ -537,55 +984,211 @@ void Shader_OpenGL::clear() {
 		glDeleteProgram(this->programID);
 	}
 	this->programID = 0;
-	this->uniforms.clear();
+	this->uniformLocations.clear();
+}
+
+
+std::filesystem::path Shader_OpenGL::binaryCacheDir;
+std::string Shader_OpenGL::binaryCacheDriver;
+
+// Header of a program binary cache file, followed by length bytes of binary.
+struct ProgramBinaryHeader {
+	uint32_t magic;
+	uint32_t length;
+	uint64_t key;
+	GLenum format;
+};
+static constexpr uint32_t PROGRAM_BINARY_MAGIC = 0x42504C47;	// "GLPB"
+
+void Shader_OpenGL::setBinaryCacheDir(std::filesystem::path dir) {
+	GLint numFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	if (numFormats <= 0) {
+		dir.clear();
+	}
+	binaryCacheDir = dir;
+	binaryCacheDriver.clear();
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		const GLubyte* str = glGetString(name);
+		binaryCacheDriver += str ? std::string((const char*)str) : std::string();
+		binaryCacheDriver += '\n';
+	}
+}
+std::filesystem::path Shader_OpenGL::getBinaryCacheDir() {
+	return binaryCacheDir;
+}
+
+uint64_t Shader_OpenGL::getBinaryKey(std::initializer_list<const std::string*> sources) {
+	if (binaryCacheDir.empty()) {
+		return 0;
+	}
+	// 64-bit FNV-1a. Each string is followed by a 0 byte, so stage boundaries are part of the hash.
+	uint64_t hash = 14695981039346656037ull;
+	auto hashString = [&hash](const std::string& str) {
+		for (char c : str) {
+			hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+		}
+		hash *= 1099511628211ull;
+	};
+	hashString(binaryCacheDriver);
+	for (const std::string* source : sources) {
+		hashString(*source);
+	}
+	return hash;
+}
+
+std::filesystem::path Shader_OpenGL::getBinaryPath(uint64_t key) {
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+	return binaryCacheDir / name;
+}
+
+bool Shader_OpenGL::loadBinary(uint64_t key) {
+	if (binaryCacheDir.empty()) {
+		return false;
+	}
+	std::ifstream file(getBinaryPath(key), std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	ProgramBinaryHeader header;
+	if (!file.read((char*)&header, sizeof(header)) ||
+		header.magic != PROGRAM_BINARY_MAGIC || header.key != key) {
+		return false;
+	}
+	std::vector<char> binary(header.length);
+	if (!file.read(binary.data(), binary.size())) {
+		return false;
+	}
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked == GL_FALSE) {
+		glDeleteProgram(program);
+		return false;
+	}
+	this->programID = program;
+	return true;
+}
+
+void Shader_OpenGL::saveBinary(uint64_t key) {
+	if (binaryCacheDir.empty() || this->programID == 0) {
+		return;
+	}
+	GLint linked = GL_FALSE;
+	GLint length = 0;
+	glGetProgramiv(this->programID, GL_LINK_STATUS, &linked);
+	glGetProgramiv(this->programID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (linked == GL_FALSE || length <= 0) {
+		return;
+	}
+	std::vector<char> binary((size_t)length);
+	ProgramBinaryHeader header = { PROGRAM_BINARY_MAGIC, 0, key, GL_NONE };
+	glGetProgramBinary(this->programID, length, &length, &header.format, binary.data());
+	header.length = (uint32_t)length;
+
+	// Written to a temporary file first, so a crash mid-write never leaves a truncated binary.
+	std::error_code error;
+	std::filesystem::create_directories(binaryCacheDir, error);
+	std::filesystem::path path = getBinaryPath(key);
+	std::filesystem::path tempPath = path;
+	tempPath += ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			return;
+		}
+		file.write((const char*)&header, sizeof(header));
+		file.write(binary.data(), header.length);
+		if (!file) {
+			return;
+		}
+	}
+	std::filesystem::rename(tempPath, path, error);
 }
 
 GLuint Shader_OpenGL::getID() {
 	return this->programID;
 }
 
-GLuint Shader_OpenGL::getUniformLocation(std::string name) {
-	if (this->uniforms.count(name)) {
-		return this->uniforms[name];
+GLint Shader_OpenGL::getUniformLocation(UniformID id) {
+	size_t index = id.getIndex();
+	if (index >= this->uniformLocations.size()) {
+		this->uniformLocations.resize(index + 1, UNRESOLVED_LOCATION);
 	}
-	else {
-		GLuint loc = glGetUniformLocation(this->programID, name.c_str());
-		this->uniforms[name] = loc;
-		return loc;
+	GLint& loc = this->uniformLocations[index];
+	if (loc == UNRESOLVED_LOCATION) {
+		loc = glGetUniformLocation(this->programID, id.getName().c_str());
 	}
+	return loc;
+}
+GLint Shader_OpenGL::getUniformLocation(std::string name) {
+	return this->getUniformLocation(UniformID(name));
+}
+
+void Shader_OpenGL::setUniform1f(UniformID id, GLfloat value) {
+	glUniform1f(this->getUniformLocation(id), value);
+}
+void Shader_OpenGL::setUniform2f(UniformID id, glm::vec2 value) {
+	glUniform2f(this->getUniformLocation(id), value.x, value.y);
+}
+void Shader_OpenGL::setUniform3f(UniformID id, glm::vec3 value) {
+	glUniform3f(this->getUniformLocation(id), value.x, value.y, value.z);
+}
+void Shader_OpenGL::setUniform4f(UniformID id, glm::vec4 value) {
+	glUniform4f(this->getUniformLocation(id), value.x, value.y, value.z, value.w);
+}
+void Shader_OpenGL::setUniform1i(UniformID id, GLint value) {
+	glUniform1i(this->getUniformLocation(id), value);
+}
+void Shader_OpenGL::setUniform2i(UniformID id, glm::ivec2 value) {
+	glUniform2i(this->getUniformLocation(id), value.x, value.y);
+}
+void Shader_OpenGL::setUniform3i(UniformID id, glm::ivec3 value) {
+	glUniform3i(this->getUniformLocation(id), value.x, value.y, value.z);
+}
+void Shader_OpenGL::setUniform4i(UniformID id, glm::ivec4 value) {
+	glUniform4i(this->getUniformLocation(id), value.x, value.y, value.z, value.w);
+}
+void Shader_OpenGL::setUniformMat4(UniformID id, const glm::mat4& value) {
+	glUniformMatrix4fv(this->getUniformLocation(id), 1, GL_FALSE, &value[0][0]);
+}
+void Shader_OpenGL::setUniformTex(UniformID id, GLuint texID, GLuint index, GLenum type) {
+	glActiveTexture(GL_TEXTURE0 + index);
+	glBindTexture(type, texID);
+	glUniform1i(this->getUniformLocation(id), (GLint)index);
 }
 
 void Shader_OpenGL::setUniform1f(std::string name, GLfloat value) {
-	glUniform1f(this->getUniformLocation(name), value);
+	this->setUniform1f(UniformID(name), value);
 }
 void Shader_OpenGL::setUniform2f(std::string name, glm::vec2 value) {
-	glUniform2f(this->getUniformLocation(name), value.x, value.y);
+	this->setUniform2f(UniformID(name), value);
 }
 void Shader_OpenGL::setUniform3f(std::string name, glm::vec3 value) {
-	glUniform3f(this->getUniformLocation(name), value.x, value.y, value.z);
+	this->setUniform3f(UniformID(name), value);
 }
 void Shader_OpenGL::setUniform4f(std::string name, glm::vec4 value) {
-	glUniform4f(this->getUniformLocation(name), value.x, value.y, value.z, value.w);
+	this->setUniform4f(UniformID(name), value);
 }
 void Shader_OpenGL::setUniform1i(std::string name, GLint value) {
-	glUniform1i(this->getUniformLocation(name), value);
+	this->setUniform1i(UniformID(name), value);
 }
 void Shader_OpenGL::setUniform2i(std::string name, glm::ivec2 value) {
-	glUniform2i(this->getUniformLocation(name), value.x, value.y);
+	this->setUniform2i(UniformID(name), value);
 }
 void Shader_OpenGL::setUniform3i(std::string name, glm::ivec3 value) {
-	glUniform3i(this->getUniformLocation(name), value.x, value.y, value.z);
+	this->setUniform3i(UniformID(name), value);
 }
 void Shader_OpenGL::setUniform4i(std::string name, glm::ivec4 value) {
-	glUniform4i(this->getUniformLocation(name), value.x, value.y, value.z, value.w);
+	this->setUniform4i(UniformID(name), value);
 }
 void Shader_OpenGL::setUniformMat4(std::string name, glm::mat4 value) {
-	glUniformMatrix4fv(this->getUniformLocation(name), 1, GL_FALSE, &value[0][0]);
+	this->setUniformMat4(UniformID(name), value);
 }
 void Shader_OpenGL::setUniformTex(std::string name, GLuint texID, GLuint index, GLenum type) {
-	glActiveTexture(GL_TEXTURE0 + index);
-	glBindTexture(type, texID);
-	glUniform1i(this->getUniformLocation(name), (GLint)index);
+	this->setUniformTex(UniformID(name), texID, index, type);
 }
 
 bool Shader_OpenGL::checkShaderErrors(GLuint shader, std::string type) {
@@ -597,13 +1200,123 @@ bool Shader_OpenGL::checkShaderErrors(GLuint shader, std::string type) {
 		if (loglength > 0) {
 			char* logtext = new char[loglength];
 			glGetShaderInfoLog(shader, loglength, NULL, logtext);
-			MessageBoxA(NULL, logtext, (type + " | Compilation Error").c_str(), MB_OK | MB_ICONERROR);
+			Utils::Platform::errorMessage(type + " | Compilation Error", logtext);
 			delete[] logtext;
 		}
 		else {
-			MessageBoxA(NULL, "Unknown error", (type + " | Error").c_str(), MB_OK | MB_ICONERROR);
+			Utils::Platform::errorMessage(type + " | Error", "Unknown error");
 		}
 		return false;
 	}
 	return true;
 }
+
+
+
+
+RingBuffer_OpenGL::RingBuffer_OpenGL(GLenum target, GLuint binding)
+	: target(target), binding(binding) {}
+
+RingBuffer_OpenGL::~RingBuffer_OpenGL() {
+	this->clear();
+}
+
+
+void* RingBuffer_OpenGL::beginWrite(size_t size) {
+	if (this->bufferID == 0 || size > this->capacity) {
+		this->reserve(std::max(size, 2 * this->capacity));
+	}
+	// Every command reading the previous region was issued last frame, so fence it now.
+	if (this->persistent && this->writeSize != 0) {
+		if (this->fences[this->region] != nullptr) {
+			glDeleteSync(this->fences[this->region]);
+		}
+		this->fences[this->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	this->region = (this->region + 1) % NUM_REGIONS;
+	this->writeSize = size;
+
+	if (!this->persistent) {
+		this->staging.resize(size);
+		return this->staging.data();
+	}
+	GLsync fence = this->fences[this->region];
+	if (fence != nullptr) {
+		// Only blocks if the GPU is more than NUM_REGIONS - 1 frames behind.
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+		glDeleteSync(fence);
+		this->fences[this->region] = nullptr;
+	}
+	return this->mapped + this->region * this->regionStride;
+}
+
+void RingBuffer_OpenGL::endWrite() {
+	GLintptr offset = (GLintptr)(this->region * this->regionStride);
+	if (!this->persistent) {
+		glBindBuffer(this->target, this->bufferID);
+		glBufferSubData(this->target, offset, (GLsizeiptr)this->writeSize, this->staging.data());
+		glBindBuffer(this->target, 0);
+	}
+	glBindBufferRange(this->target, this->binding, this->bufferID, offset, (GLsizeiptr)this->writeSize);
+}
+
+
+void RingBuffer_OpenGL::clear() {
+	for (GLsync& fence : this->fences) {
+		if (fence != nullptr) {
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+	if (this->bufferID != 0) {
+		if (this->mapped != nullptr) {
+			glBindBuffer(this->target, this->bufferID);
+			glUnmapBuffer(this->target);
+			glBindBuffer(this->target, 0);
+		}
+		glDeleteBuffers(1, &this->bufferID);
+	}
+	this->bufferID = 0;
+	this->mapped = nullptr;
+	this->capacity = 0;
+	this->regionStride = 0;
+	this->writeSize = 0;
+}
+
+
+void RingBuffer_OpenGL::reserve(size_t size) {
+	// The GPU may still be reading the old buffer, but deleting it is deferred by the driver.
+	this->clear();
+
+	GLint alignment = 1;
+	if (this->target == GL_SHADER_STORAGE_BUFFER) {
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	}
+	else if (this->target == GL_UNIFORM_BUFFER) {
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	}
+	alignment = std::max(alignment, 1);
+	this->capacity = std::max(size, (size_t)256);
+	this->regionStride = (this->capacity + alignment - 1) / alignment * alignment;
+	GLsizeiptr totalSize = (GLsizeiptr)(this->regionStride * NUM_REGIONS);
+
+	this->persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+	glGenBuffers(1, &this->bufferID);
+	glBindBuffer(this->target, this->bufferID);
+	if (this->persistent) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(this->target, totalSize, (void*)0, flags);
+		this->mapped = (uint8_t*)glMapBufferRange(this->target, 0, totalSize, flags);
+		if (this->mapped == nullptr) {
+			// Fall back to uploads rather than failing outright.
+			glDeleteBuffers(1, &this->bufferID);
+			glGenBuffers(1, &this->bufferID);
+			glBindBuffer(this->target, this->bufferID);
+			this->persistent = false;
+		}
+	}
+	if (!this->persistent) {
+		glBufferData(this->target, totalSize, (void*)0, GL_DYNAMIC_DRAW);
+	}
+	glBindBuffer(this->target, 0);
+}
@@ -8,7 +8,12 @@
 #include "GLFW/glfw3native.h"
 
 #include <filesystem>
+#include <memory>
 #include <unordered_map>
+#include <vector>
+
+
+class MeshArena_OpenGL;
 
 
 class Graphics_OpenGL : public Graphics {
@@ -22,9 +27,17 @@ public:
 		UV = 4,
 	};
 
-	Graphics_OpenGL();
+	// If headless, the context is created through EGL and no window is ever opened.
+	Graphics_OpenGL(bool headless = false);
 	virtual ~Graphics_OpenGL() override;
 
+	// Returns whether a context was successfully created.
+	bool hasContext();
+
+	// The framebuffer pipelines should draw their final output to.
+	// This is the default framebuffer (0) when windowed, or an offscreen FBO when headless.
+	GLuint getTargetFramebuffer();
+
 	virtual std::string getBackendString() override;
 	virtual std::string getGPUNameString() override;
 
@@ -48,11 +61,90 @@ public:
 
 	virtual void swapBuffers() override;
 
+	// Meshes uploaded after this call share one vertex/index arena (and VAO), which lets
+	// render queues submit them with glMultiDrawElementsIndirect.
+	// Requires GL 4.3 and ARB_shader_draw_parameters; returns false (and changes nothing) otherwise.
+	bool enableMultiDrawIndirect();
+	bool isMultiDrawIndirectEnabled();
+
 private:
 
 	GLint GLmajorVersion = 0;
 	GLint GLminorVersion = 0;
 	std::string gpuName;
+
+
+	// Headless only. Stored as void* to keep EGL headers out of this header.
+	void* eglDisplay = nullptr;
+	void* eglContext = nullptr;
+	void* eglSurface = nullptr;
+	bool createHeadlessContext();
+	void destroyHeadlessContext();
+
+	// Headless only. The offscreen render target, recreated on resize.
+	GLuint targetFBO = 0;
+	GLuint targetColorRB = 0;
+	GLuint targetDepthRB = 0;
+	void resizeTargetFramebuffer(size_t width, size_t height);
+	void deleteTargetFramebuffer();
+
+	// Shared by every mesh created while multi-draw indirect is enabled, so it outlives the Graphics.
+	std::shared_ptr<MeshArena_OpenGL> meshArena;
+};
+
+
+
+/*
+* The command layout read by glMultiDrawElementsIndirect.
+*/
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+
+
+/*
+* One large vertex buffer and index buffer holding many meshes, all drawn through the same VAO.
+* Allocation is append-only; the space is only reclaimed once every range has been freed.
+*/
+class MeshArena_OpenGL {
+public:
+
+	struct Range {
+		GLint baseVertex = 0;
+		GLuint firstIndex = 0;
+		GLuint numIdxs = 0;
+	};
+
+	MeshArena_OpenGL();
+	MeshArena_OpenGL(const MeshArena_OpenGL& other) = delete;
+	MeshArena_OpenGL& operator=(const MeshArena_OpenGL& other) = delete;
+	~MeshArena_OpenGL();
+
+	// Copies the mesh data to the end of the arena, growing the buffers if needed.
+	Range allocate(size_t numVerts, size_t numIdxs, const Vertex* verts, const VertexIndex* idxs);
+	void free(const Range& range);
+
+	GLuint getVAO();
+
+private:
+
+	GLuint VAO = 0;
+	GLuint VBO = 0;
+	GLuint EBO = 0;
+	size_t vertCapacity = 0;
+	size_t vertCount = 0;
+	size_t idxCapacity = 0;
+	size_t idxCount = 0;
+	size_t numLiveRanges = 0;
+
+	// Replaces buffer with a larger one holding the first usedBytes of its contents.
+	static void growBuffer(GLuint& buffer, size_t usedBytes, size_t newBytes);
+
 };
 
 
@@ -60,6 +152,8 @@ private:
 class GPUMesh_OpenGL : public GPUMesh {
 public:
 
+	// If arena is non-null, the mesh data is stored in it instead of in buffers of its own.
+	GPUMesh_OpenGL(std::shared_ptr<MeshArena_OpenGL> arena = nullptr);
 	virtual ~GPUMesh_OpenGL() override;
 
 	virtual bool uploadFrom(const Mesh& mesh) override;
@@ -67,6 +161,16 @@ public:
 	// TODO: ONLY SUPPORTS TRIANGLES.
 	virtual void draw() override;
 
+	// Issues the draw call without binding the VAO, for callers that batch draws by VAO.
+	// getVAO() must already be bound. Draws instanceCount instances (gl_InstanceID),
+	// starting from baseInstance (gl_BaseInstanceARB).
+	void drawBound(GLsizei instanceCount = 1, GLuint baseInstance = 0);
+	GLuint getVAO();
+
+	// Whether the mesh lives in a MeshArena_OpenGL and can be drawn with getIndirectCommand().
+	bool isInArena();
+	DrawElementsIndirectCommand getIndirectCommand(GLuint instanceCount, GLuint baseInstance);
+
 private:
 
 	GLuint VAO = 0;
@@ -74,6 +178,10 @@ private:
 	GLuint EBO = 0;
 	size_t numIdxs = 0;
 
+	std::shared_ptr<MeshArena_OpenGL> arena;
+	MeshArena_OpenGL::Range arenaRange;
+	bool arenaAllocated = false;
+
 	bool setupVAO(size_t numVerts, size_t numIdxs, const Vertex* verts, const VertexIndex* idxs);
 	void deleteVAO();
 
@@ -106,9 +214,37 @@ private:
 
 
 
+/*
+* A uniform name interned to a small integer that is shared by all shaders.
+* Create these once (e.g. as statics) and pass them to Shader_OpenGL::setUniform*,
+* which then finds the location by indexing an array instead of hashing the name.
+*/
+class UniformID {
+public:
+
+	explicit UniformID(const std::string& name);
+	explicit UniformID(const char* name);
+
+	size_t getIndex() const;
+	std::string getName() const;
+
+private:
+
+	size_t index;
+
+};
+
+
+
 /*
 * An OpenGL shader.
 * There is no generic Shader class because each backend handles shaders in a different way.
+*
+* If a binary cache directory is set, every program linked by compile() is also saved there
+* with glGetProgramBinary, and later compiles of the same sources load it with glProgramBinary
+* instead. Files are named by a hash of the sources and the driver (vendor, renderer and
+* version), so editing a shader or updating the driver just misses the cache. Binaries the
+* driver rejects are compiled from source and overwritten.
 */
 class Shader_OpenGL {
 public:
@@ -145,13 +281,31 @@ public:
 	// Deletes the current shader program, if any.
 	void clear();
 
+	// Enables the program binary cache in dir, or disables it if dir is empty.
+	// Requires a current context; stays disabled if the driver has no binary formats.
+	static void setBinaryCacheDir(std::filesystem::path dir);
+	static std::filesystem::path getBinaryCacheDir();
+
 	GLuint getID();
 
 
-	// Returns the OpenGL-defined location of the specified uniform.
-	GLuint getUniformLocation(std::string name);
+	// Returns the OpenGL-defined location of the specified uniform, or -1 if it is unused.
+	GLint getUniformLocation(UniformID id);
+	GLint getUniformLocation(std::string name);
 
 	// The Shader must be bound with bind() before any uniforms can be set.
+	// Prefer the UniformID overloads in per-draw code; the string overloads intern the name on every call.
+
+	void setUniform1f(UniformID id, GLfloat value);
+	void setUniform2f(UniformID id, glm::vec2 value);
+	void setUniform3f(UniformID id, glm::vec3 value);
+	void setUniform4f(UniformID id, glm::vec4 value);
+	void setUniform1i(UniformID id, GLint value);
+	void setUniform2i(UniformID id, glm::ivec2 value);
+	void setUniform3i(UniformID id, glm::ivec3 value);
+	void setUniform4i(UniformID id, glm::ivec4 value);
+	void setUniformMat4(UniformID id, const glm::mat4& value);
+	void setUniformTex(UniformID id, GLuint texID, GLuint index = 0, GLenum type = GL_TEXTURE_2D);
 
 	void setUniform1f(std::string name, GLfloat value);
 	void setUniform2f(std::string name, glm::vec2 value);
@@ -168,10 +322,71 @@ private:
 
 	GLuint programID = 0;
 
-	// Stores <name, location>. Cleared automatically upon shader deletion.
-	std::unordered_map<std::string, GLuint> uniforms;
+	// Locations indexed by UniformID, or UNRESOLVED_LOCATION if not queried yet.
+	// Cleared automatically upon shader deletion.
+	std::vector<GLint> uniformLocations;
+	static constexpr GLint UNRESOLVED_LOCATION = -2;
 
 	// Returns false if an error is encountered, or true if successful.
 	bool checkShaderErrors(GLuint shader, std::string type);
 
-};
\ No newline at end of file
+	static std::filesystem::path binaryCacheDir;
+	static std::string binaryCacheDriver;		// Part of every key, so driver updates miss the cache.
+
+	// Hash of the driver and a program's sources, in stage order. 0 if the cache is disabled.
+	static uint64_t getBinaryKey(std::initializer_list<const std::string*> sources);
+	static std::filesystem::path getBinaryPath(uint64_t key);
+	// Replaces programID with the cached binary for key. Returns false if there is none or it failed to load.
+	bool loadBinary(uint64_t key);
+	// Saves the linked programID under key. Must be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+	void saveBinary(uint64_t key);
+
+};
+
+
+/*
+* A buffer that is rewritten every frame, split into several regions that are used
+* round-robin so the CPU never writes a region the GPU may still be reading.
+* Where GL 4.4 / ARB_buffer_storage is available, the buffer is persistently mapped
+* and data is written straight into GPU-visible memory, with a fence per region.
+* Otherwise, writes go to a CPU staging copy that is uploaded with glBufferSubData.
+*/
+class RingBuffer_OpenGL {
+public:
+
+	static constexpr size_t NUM_REGIONS = 3;
+
+	// target and binding are used with glBindBufferRange (e.g. GL_SHADER_STORAGE_BUFFER, 0).
+	RingBuffer_OpenGL(GLenum target, GLuint binding);
+	RingBuffer_OpenGL(const RingBuffer_OpenGL& other) = delete;
+	RingBuffer_OpenGL& operator=(const RingBuffer_OpenGL& other) = delete;
+	~RingBuffer_OpenGL();
+
+	// Returns memory for size bytes of this frame's data, waiting for the GPU if needed.
+	// The buffer grows geometrically if size exceeds the current capacity.
+	void* beginWrite(size_t size);
+	// Makes the data written since beginWrite visible and binds it to the binding point.
+	void endWrite();
+
+	// Deletes the buffer and any pending fences.
+	void clear();
+
+private:
+
+	GLenum target;
+	GLuint binding;
+
+	GLuint bufferID = 0;
+	bool persistent = false;
+	uint8_t* mapped = nullptr;					// Start of the buffer, if persistent.
+	std::vector<uint8_t> staging;				// This frame's data, if not persistent.
+	size_t capacity = 0;						// Usable size of each region, in bytes.
+	size_t regionStride = 0;					// capacity, rounded up to the binding offset alignment.
+
+	size_t region = NUM_REGIONS - 1;			// Region currently (or last) written.
+	size_t writeSize = 0;
+	GLsync fences[NUM_REGIONS] = {};
+
+	void reserve(size_t size);
+
+};
@@ -3,10 +3,16 @@
 
 
 Mesh::Mesh(MeshID id, RenderEngine* engine) :
-	Datablock(id), thisGraphics(engine->getGraphics()) {}
+	Datablock(id), thisEngine(engine), thisGraphics(engine->getGraphics()) {}
 Mesh::~Mesh() {
 	if (this->gpuMesh) {
-		delete this->gpuMesh;
+		// Deleted on the render thread, unless Graphics is already gone.
+		if (Graphics* graphics = this->thisEngine->getGraphics()) {
+			graphics->releaseMesh(this->gpuMesh);
+		}
+		else {
+			delete this->gpuMesh;
+		}
 		this->gpuMesh = nullptr;
 	}
 }
@@ -28,6 +34,7 @@ const std::vector<VertexIndex>& Mesh::getIndices() const {
 }
 
 void Mesh::uploadMesh() {
+	this->updateBounds();
 	if (!this->thisGraphics) {
 		return;
 	}
@@ -38,6 +45,17 @@ void Mesh::uploadMesh() {
 	this->gpuMesh->uploadFrom(*this);
 }
 
+const AABB& Mesh::getBoundingBox() const {
+	return this->bounds;
+}
+
+void Mesh::updateBounds() {
+	this->bounds = AABB();
+	for (const Vertex& v : this->vertices) {
+		this->bounds.expand(v.position);
+	}
+}
+
 void Mesh::assignMaterial(const Ref<Material>& material) {
 	this->material = material;
 }
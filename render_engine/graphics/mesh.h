@@ -1,5 +1,6 @@
 #pragma once
-#include "core/Datablock.h"
+#include "core/datablock.h"
+#include "geometry/aabb.h"
 #include "graphics/material.h"
 #include "graphics/vertex.h"
 
@@ -31,6 +32,9 @@ public:
 	
 	void uploadMesh();
 
+	// Bounding box of the vertices in object space, as of the last uploadMesh().
+	const AABB& getBoundingBox() const;
+
 	void assignMaterial(const Ref<Material>& material);
 	Ref<Material> getMaterial();
 
@@ -40,6 +44,7 @@ public:
 
 private:
 
+	RenderEngine* thisEngine;
 	Graphics* thisGraphics;
 	GPUMesh* gpuMesh = nullptr;
 
@@ -48,6 +53,9 @@ private:
 	std::vector<Vertex> vertices;
 	std::vector<VertexIndex> indices;
 
+	AABB bounds;
+	void updateBounds();
+
 	Ref<Material> material;
 
 };
\ No newline at end of file
@@ -0,0 +1,143 @@
+#include "graphics/pipeline/hiz_opengl.h"
+#include "graphics/pipeline/uniforms_opengl.h"
+
+#include <algorithm>
+
+
+HiZ_OpenGL::~HiZ_OpenGL() {
+	this->clear();
+}
+
+
+void HiZ_OpenGL::init() {
+	this->downsampleShader.readCompute(
+		"shaders/opengl/hiz_downsample.glsl"
+	);
+	this->cullShader.readCompute(
+		"shaders/opengl/hiz_cull.glsl"
+	);
+}
+
+
+void HiZ_OpenGL::build(GLuint depthTexture, GLsizei width, GLsizei height) {
+	if (width != this->width || height != this->height) {
+		this->resize(width, height);
+	}
+	if (this->pyramidTex == 0) {
+		return;
+	}
+
+	this->downsampleShader.bind();
+	GLsizei levelWidth = width;
+	GLsizei levelHeight = height;
+	for (GLint level = 0; level < this->numLevels; level++) {
+		this->downsampleShader.setUniform1i(Uniforms::copyDepth, level == 0);
+		if (level == 0) {
+			this->downsampleShader.setUniformTex(Uniforms::depthTexture, depthTexture, 0, GL_TEXTURE_2D);
+		}
+		else {
+			glBindImageTexture(0, this->pyramidTex, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		}
+		glBindImageTexture(1, this->pyramidTex, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute((GLuint)(levelWidth + 7) / 8, (GLuint)(levelHeight + 7) / 8, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+		levelWidth = std::max(levelWidth / 2, 1);
+		levelHeight = std::max(levelHeight / 2, 1);
+	}
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+	glBindImageTexture(1, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+}
+
+void HiZ_OpenGL::cull(const std::vector<AABB>& boxes, const glm::mat4& viewProjMat, std::vector<uint8_t>& visible) {
+	if (this->pyramidTex == 0 || boxes.empty()) {
+		return;
+	}
+	if (boxes.size() > this->capacity) {
+		this->capacity = std::max(boxes.size(), this->capacity * 2);
+		if (this->boxesSSBO == 0) {
+			glGenBuffers(1, &this->boxesSSBO);
+			glGenBuffers(1, &this->visibilitySSBO);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->boxesSSBO);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, this->capacity * 2 * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->visibilitySSBO);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, this->capacity * sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+	}
+
+	this->boxData.resize(2 * boxes.size());
+	for (size_t i = 0; i < boxes.size(); i++) {
+		this->boxData[2 * i + 0] = glm::vec4(boxes[i].min, 0.0f);
+		this->boxData[2 * i + 1] = glm::vec4(boxes[i].max, 0.0f);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->boxesSSBO);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, this->boxData.size() * sizeof(glm::vec4), this->boxData.data());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, boxesSSBOBinding, this->boxesSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, visibilitySSBOBinding, this->visibilitySSBO);
+
+	this->cullShader.bind();
+	this->cullShader.setUniform1i(Uniforms::numBoxes, (GLint)boxes.size());
+	this->cullShader.setUniformMat4(Uniforms::viewProjMat, viewProjMat);
+	this->cullShader.setUniformTex(Uniforms::hiZ, this->pyramidTex, 0, GL_TEXTURE_2D);
+	this->cullShader.setUniform1i(Uniforms::hiZLevels, this->numLevels);
+	glDispatchCompute((GLuint)(boxes.size() + 63) / 64, 1, 1);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	this->visibility.resize(boxes.size());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->visibilitySSBO);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, this->visibility.size() * sizeof(GLuint), this->visibility.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	for (size_t i = 0; i < boxes.size(); i++) {
+		if (this->visibility[i] == 0) {
+			visible[i] = 0;
+		}
+	}
+}
+
+void HiZ_OpenGL::clear() {
+	if (glIsTexture(this->pyramidTex)) {
+		glDeleteTextures(1, &this->pyramidTex);
+	}
+	if (glIsBuffer(this->boxesSSBO)) {
+		glDeleteBuffers(1, &this->boxesSSBO);
+	}
+	if (glIsBuffer(this->visibilitySSBO)) {
+		glDeleteBuffers(1, &this->visibilitySSBO);
+	}
+	this->pyramidTex = 0;
+	this->boxesSSBO = 0;
+	this->visibilitySSBO = 0;
+	this->capacity = 0;
+	this->width = 0;
+	this->height = 0;
+	this->numLevels = 0;
+}
+
+void HiZ_OpenGL::resize(GLsizei width, GLsizei height) {
+	if (glIsTexture(this->pyramidTex)) {
+		glDeleteTextures(1, &this->pyramidTex);
+	}
+	this->pyramidTex = 0;
+	this->width = width;
+	this->height = height;
+	this->numLevels = 0;
+	if (width <= 0 || height <= 0) {
+		return;
+	}
+
+	// Down to 1x1, so the coarsest level covers the whole screen.
+	GLsizei largest = std::max(width, height);
+	while (largest > 0) {
+		this->numLevels++;
+		largest /= 2;
+	}
+	glGenTextures(1, &this->pyramidTex);
+	glBindTexture(GL_TEXTURE_2D, this->pyramidTex);
+	glTexStorage2D(GL_TEXTURE_2D, this->numLevels, GL_R32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "graphics/graphics_opengl.h"
+#include "geometry/aabb.h"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+
+/*
+* Hierarchical-Z occlusion culling against a depth buffer that has already been drawn
+* (e.g. the forward pipeline's z-prepass).
+*
+* build() reduces the depth texture into a mip pyramid in which each texel holds the
+* farthest depth it covers. cull() then tests world-space boxes against it in a compute
+* shader: a box is hidden if its nearest depth is behind the farthest depth of every texel
+* its screen rectangle touches, read from the level where that is at most 2x2 texels.
+*
+* cull() reads the results back, so it waits for the GPU to finish the depth pass.
+* This only pays off when the pass it feeds is much more expensive, like forward shading.
+*/
+class HiZ_OpenGL {
+public:
+
+	static constexpr GLuint boxesSSBOBinding = 6;			// Must align with hiz_cull.glsl
+	static constexpr GLuint visibilitySSBOBinding = 7;		// Must align with hiz_cull.glsl
+
+	HiZ_OpenGL() = default;
+	HiZ_OpenGL(const HiZ_OpenGL& other) = delete;
+	HiZ_OpenGL& operator=(const HiZ_OpenGL& other) = delete;
+	~HiZ_OpenGL();
+
+	// Compiles the compute shaders. Must be called before build() or cull().
+	void init();
+
+	// depthTexture must be a width x height depth texture that is not being drawn to.
+	void build(GLuint depthTexture, GLsizei width, GLsizei height);
+
+	// Clears visible[i] for each box that is hidden in the last build(), seen through viewProjMat.
+	// Entries that are already 0 are left alone. visible must have one entry per box.
+	void cull(const std::vector<AABB>& boxes, const glm::mat4& viewProjMat, std::vector<uint8_t>& visible);
+
+	void clear();
+
+private:
+
+	Shader_OpenGL downsampleShader;
+	Shader_OpenGL cullShader;
+
+	GLuint pyramidTex = 0;
+	GLsizei width = 0;
+	GLsizei height = 0;
+	GLint numLevels = 0;
+
+	GLuint boxesSSBO = 0;
+	GLuint visibilitySSBO = 0;
+	size_t capacity = 0;				// In boxes, for both SSBOs.
+
+	// Scratch for cull().
+	std::vector<glm::vec4> boxData;
+	std::vector<GLuint> visibility;
+
+	void resize(GLsizei width, GLsizei height);
+
+};
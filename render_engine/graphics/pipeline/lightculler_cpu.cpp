@@ -0,0 +1,366 @@
+#include "graphics/pipeline/lightculler_cpu.h"
+#include "geometry/sphere.h"
+
+#include <algorithm>
+#include <cmath>
+
+// SSE2 is baseline on x86-64, so this only falls back to scalar code on other architectures.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIGHTCULLER_SSE
+#include <emmintrin.h>
+#endif
+
+
+void LightCuller_CPU::SphereBatch::clear() {
+	this->x.clear();
+	this->y.clear();
+	this->z.clear();
+	this->radius2.clear();
+	this->lightIdx.clear();
+}
+
+void LightCuller_CPU::SphereBatch::push(float x, float y, float z, float radius2, GLint lightIdx) {
+	this->x.push_back(x);
+	this->y.push_back(y);
+	this->z.push_back(z);
+	this->radius2.push_back(radius2);
+	this->lightIdx.push_back(lightIdx);
+}
+
+void LightCuller_CPU::SphereBatch::push(const SphereBatch& other, size_t i) {
+	this->push(other.x[i], other.y[i], other.z[i], other.radius2[i], other.lightIdx[i]);
+}
+
+size_t LightCuller_CPU::SphereBatch::size() const {
+	return this->lightIdx.size();
+}
+
+
+/*
+* Calls onHit(i) for every sphere i in the batch that intersects the AABB, in order.
+* The test is the squared distance from the sphere's center to the box, as in
+* clusterscull2.glsl, evaluated for four spheres at a time.
+*/
+template<typename OnHit>
+static void forEachSphereInAABB(const std::vector<float>& xs, const std::vector<float>& ys,
+	const std::vector<float>& zs, const std::vector<float>& radius2s,
+	glm::vec3 boxMin, glm::vec3 boxMax, OnHit onHit) {
+	size_t n = xs.size();
+	size_t i = 0;
+#ifdef LIGHTCULLER_SSE
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 minX = _mm_set1_ps(boxMin.x);
+	const __m128 minY = _mm_set1_ps(boxMin.y);
+	const __m128 minZ = _mm_set1_ps(boxMin.z);
+	const __m128 maxX = _mm_set1_ps(boxMax.x);
+	const __m128 maxY = _mm_set1_ps(boxMax.y);
+	const __m128 maxZ = _mm_set1_ps(boxMax.z);
+	for (; i + 4 <= n; i += 4) {
+		__m128 x = _mm_loadu_ps(xs.data() + i);
+		__m128 y = _mm_loadu_ps(ys.data() + i);
+		__m128 z = _mm_loadu_ps(zs.data() + i);
+		// Distance outside the box along each axis (0 if inside).
+		__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minX, x), _mm_sub_ps(x, maxX)), zero);
+		__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minY, y), _mm_sub_ps(y, maxY)), zero);
+		__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minZ, z), _mm_sub_ps(z, maxZ)), zero);
+		__m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		int mask = _mm_movemask_ps(_mm_cmple_ps(dist2, _mm_loadu_ps(radius2s.data() + i)));
+		if (mask == 0) {
+			continue;
+		}
+		for (int b = 0; b < 4; b++) {
+			if (mask & (1 << b)) {
+				onHit(i + b);
+			}
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		float dx = std::max(std::max(boxMin.x - xs[i], xs[i] - boxMax.x), 0.0f);
+		float dy = std::max(std::max(boxMin.y - ys[i], ys[i] - boxMax.y), 0.0f);
+		float dz = std::max(std::max(boxMin.z - zs[i], zs[i] - boxMax.z), 0.0f);
+		if (dx * dx + dy * dy + dz * dz <= radius2s[i]) {
+			onHit(i);
+		}
+	}
+}
+
+
+void LightCuller_CPU::updateClusterBounds(GO_Camera* camera, glm::ivec3 numTiles) {
+	const glm::mat4& proj = camera->getProjectionMatrix();
+	if (this->clustersRes == numTiles && this->clustersProj == proj) {
+		return;
+	}
+	this->clustersRes = numTiles;
+	this->clustersProj = proj;
+
+	size_t numClusters = (size_t)numTiles.x * numTiles.y * numTiles.z;
+	this->clusterMin.resize(numClusters);
+	this->clusterMax.resize(numClusters);
+	this->rowMin.resize((size_t)numTiles.y * numTiles.z);
+	this->rowMax.resize((size_t)numTiles.y * numTiles.z);
+
+	// View-space points on the near plane at each tile corner, as in clustersgen.glsl.
+	glm::mat4 invProj = glm::inverse(proj);
+	std::vector<glm::vec3> corners((size_t)(numTiles.x + 1) * (numTiles.y + 1));
+	for (GLint y = 0; y <= numTiles.y; y++) {
+		for (GLint x = 0; x <= numTiles.x; x++) {
+			glm::vec4 clip = glm::vec4(
+				2.0f * (float)x / (float)numTiles.x - 1.0f,
+				2.0f * (float)y / (float)numTiles.y - 1.0f,
+				-1.0f, 1.0f
+			);
+			glm::vec4 view = invProj * clip;
+			corners[(size_t)y * (numTiles.x + 1) + x] = glm::vec3(view) / view.w;
+		}
+	}
+
+	float zNear = camera->projectionParams.perspective.near;
+	float zFar = camera->projectionParams.perspective.far;
+	for (GLint z = 0; z < numTiles.z; z++) {
+		float tileNear = -zNear * std::pow(zFar / zNear, (float)z / (float)numTiles.z);
+		float tileFar = -zNear * std::pow(zFar / zNear, (float)(z + 1) / (float)numTiles.z);
+		for (GLint y = 0; y < numTiles.y; y++) {
+			size_t row = (size_t)y + (size_t)numTiles.y * z;
+			this->rowMin[row] = glm::vec3(INFINITY);
+			this->rowMax[row] = glm::vec3(-INFINITY);
+			for (GLint x = 0; x < numTiles.x; x++) {
+				glm::vec3 minPoint = corners[(size_t)y * (numTiles.x + 1) + x];
+				glm::vec3 maxPoint = corners[(size_t)(y + 1) * (numTiles.x + 1) + (x + 1)];
+				// Intersections of the rays from the eye with the slice's near and far planes.
+				glm::vec3 minNear = minPoint * (tileNear / minPoint.z);
+				glm::vec3 minFar = minPoint * (tileFar / minPoint.z);
+				glm::vec3 maxNear = maxPoint * (tileNear / maxPoint.z);
+				glm::vec3 maxFar = maxPoint * (tileFar / maxPoint.z);
+				size_t c = (size_t)x + (size_t)numTiles.x * row;
+				this->clusterMin[c] = glm::min(glm::min(minNear, minFar), glm::min(maxNear, maxFar));
+				this->clusterMax[c] = glm::max(glm::max(minNear, minFar), glm::max(maxNear, maxFar));
+				this->rowMin[row] = glm::min(this->rowMin[row], this->clusterMin[c]);
+				this->rowMax[row] = glm::max(this->rowMax[row], this->clusterMax[c]);
+			}
+		}
+	}
+}
+
+
+void LightCuller_CPU::cullClusters(
+	ThreadPool& pool,
+	GO_Camera* camera,
+	const std::vector<GO_Light*>& lights,
+	glm::ivec3 numTiles,
+	std::vector<GLint>& tileLightMapping,
+	std::vector<GLint>& lightsIndex
+) {
+	size_t numClusters = (size_t)numTiles.x * numTiles.y * numTiles.z;
+	tileLightMapping.resize(2 * numClusters);
+	lightsIndex.clear();
+	if (numClusters == 0) {
+		return;
+	}
+
+	this->updateClusterBounds(camera, numTiles);
+	if (this->slices.size() != (size_t)numTiles.z) {
+		this->slices.resize((size_t)numTiles.z);
+	}
+	for (Slice& slice : this->slices) {
+		slice.candidates.clear();
+	}
+	this->unculledLights.clear();
+
+	// Bin each light into the depth slices its bounding sphere overlaps.
+	// The slice of a view-space depth d is log2(d) * scale + bias, as in forward.frag.
+	float zNear = camera->projectionParams.perspective.near;
+	float zFar = camera->projectionParams.perspective.far;
+	float scale = (float)numTiles.z / std::log2(zFar / zNear);
+	float bias = -((float)numTiles.z * std::log2(zNear) / std::log2(zFar / zNear));
+	auto depthToSlice = [&](float depth) {
+		GLint z = (GLint)std::floor(std::log2(depth) * scale + bias);
+		return std::clamp(z, 0, numTiles.z - 1);
+	};
+	const glm::mat4& viewMatrix = camera->getViewMatrix();
+	for (GLint i = 0; i < (GLint)lights.size(); i++) {
+		GO_Light* light = lights[i];
+		if (light->type != GO_Light::Type::Point) {
+			this->unculledLights.push_back(i);
+			continue;
+		}
+		Sphere bs = light->getBoundingSphere();
+		glm::vec3 center = glm::vec3(viewMatrix * glm::vec4(bs.position, 1.0f));
+		float depth = -center.z;
+		if (depth + bs.radius < zNear || depth - bs.radius > zFar) {
+			continue;
+		}
+		GLint z0 = depthToSlice(std::max(depth - bs.radius, zNear));
+		GLint z1 = depthToSlice(std::min(depth + bs.radius, zFar));
+		for (GLint z = z0; z <= z1; z++) {
+			this->slices[z].candidates.push(center.x, center.y, center.z, bs.radius * bs.radius, i);
+		}
+	}
+
+	// Cull each slice independently. Offsets in tileLightMapping are slice-local for now.
+	pool.parallelFor((size_t)numTiles.z, [&](size_t z) {
+		Slice& slice = this->slices[z];
+		slice.lightsIndex.clear();
+		for (GLint y = 0; y < numTiles.y; y++) {
+			size_t row = (size_t)y + (size_t)numTiles.y * z;
+
+			// Narrow the candidates down to this row first, so each cluster tests fewer lights.
+			slice.rowCandidates.clear();
+			const SphereBatch& c = slice.candidates;
+			forEachSphereInAABB(c.x, c.y, c.z, c.radius2, this->rowMin[row], this->rowMax[row],
+				[&](size_t i) { slice.rowCandidates.push(c, i); });
+
+			const SphereBatch& r = slice.rowCandidates;
+			for (GLint x = 0; x < numTiles.x; x++) {
+				size_t cluster = (size_t)x + (size_t)numTiles.x * row;
+				size_t offset = slice.lightsIndex.size();
+				slice.lightsIndex.insert(slice.lightsIndex.end(),
+					this->unculledLights.begin(), this->unculledLights.end());
+				forEachSphereInAABB(r.x, r.y, r.z, r.radius2, this->clusterMin[cluster], this->clusterMax[cluster],
+					[&](size_t i) { slice.lightsIndex.push_back(r.lightIdx[i]); });
+				tileLightMapping[2 * cluster] = (GLint)offset;
+				tileLightMapping[2 * cluster + 1] = (GLint)(slice.lightsIndex.size() - offset);
+			}
+		}
+	});
+
+	// Concatenate the slices' lists and make their offsets global.
+	std::vector<size_t> sliceOffsets(this->slices.size());
+	size_t total = 0;
+	for (size_t z = 0; z < this->slices.size(); z++) {
+		sliceOffsets[z] = total;
+		total += this->slices[z].lightsIndex.size();
+	}
+	lightsIndex.resize(total);
+	size_t clustersPerSlice = (size_t)numTiles.x * numTiles.y;
+	pool.parallelFor(this->slices.size(), [&](size_t z) {
+		const std::vector<GLint>& src = this->slices[z].lightsIndex;
+		std::copy(src.begin(), src.end(), lightsIndex.begin() + sliceOffsets[z]);
+		for (size_t c = z * clustersPerSlice; c < (z + 1) * clustersPerSlice; c++) {
+			tileLightMapping[2 * c] += (GLint)sliceOffsets[z];
+		}
+	});
+}
+
+
+/*
+* Computes the NDC range [ndcMin, ndcMax] covered along one axis by a view-space sphere,
+* from the two planes through the eye that are tangent to it. a is the sphere's center
+* along the axis, depth is -z, and scale/offset are the projection's terms for the axis.
+* Assumes the eye is in front of the sphere (depth > radius).
+*/
+static void projectSphereAxis(float a, float depth, float radius, float scale, float offset,
+	float& ndcMin, float& ndcMax) {
+	float d2r2 = depth * depth - radius * radius;
+	float root = radius * std::sqrt(a * a + d2r2);
+	float slopeMin = (a * depth - root) / d2r2;
+	float slopeMax = (a * depth + root) / d2r2;
+	ndcMin = scale * slopeMin - offset;
+	ndcMax = scale * slopeMax - offset;
+	if (scale < 0.0f) {
+		std::swap(ndcMin, ndcMax);
+	}
+}
+
+
+void LightCuller_CPU::cullTiles(
+	ThreadPool& pool,
+	GO_Camera* camera,
+	const std::vector<GO_Light*>& lights,
+	glm::ivec3 numTiles,
+	std::vector<GLint>& tileLightMapping,
+	std::vector<GLint>& lightsIndex
+) {
+	size_t numTilesXY = (size_t)numTiles.x * numTiles.y;
+	tileLightMapping.resize(2 * numTilesXY);
+	lightsIndex.clear();
+	if (numTilesXY == 0) {
+		return;
+	}
+
+	// Project each light once to the rectangle of tiles it covers.
+	// Matrix lookups are lazy and not thread-safe, so this part stays on the calling thread.
+	this->tileRects.clear();
+	this->unculledLights.clear();
+	const glm::mat4& viewMatrix = camera->getViewMatrix();
+	const glm::mat4& proj = camera->getProjectionMatrix();
+	float zNear = camera->projectionParams.perspective.near;
+	float zFar = camera->projectionParams.perspective.far;
+	auto ndcToTile = [](float ndc, GLint res) {
+		GLint t = (GLint)std::floor((0.5f * ndc + 0.5f) * (float)res);
+		return std::clamp(t, 0, res - 1);
+	};
+	for (GLint i = 0; i < (GLint)lights.size(); i++) {
+		GO_Light* light = lights[i];
+		if (light->type != GO_Light::Type::Point) {
+			this->unculledLights.push_back(i);
+			continue;
+		}
+		Sphere bs = light->getBoundingSphere();
+		glm::vec3 center = glm::vec3(viewMatrix * glm::vec4(bs.position, 1.0f));
+		float depth = -center.z;
+		if (depth + bs.radius < zNear || depth - bs.radius > zFar) {
+			continue;
+		}
+		TileRect rect = { i, 0, 0, numTiles.x - 1, numTiles.y - 1 };
+		// If the eye is inside the sphere (or nearly), it can cover any part of the screen.
+		if (depth > bs.radius * 1.001f) {
+			glm::vec2 ndcMin, ndcMax;
+			projectSphereAxis(center.x, depth, bs.radius, proj[0][0], proj[2][0], ndcMin.x, ndcMax.x);
+			projectSphereAxis(center.y, depth, bs.radius, proj[1][1], proj[2][1], ndcMin.y, ndcMax.y);
+			if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f) {
+				continue;
+			}
+			rect.x0 = ndcToTile(ndcMin.x, numTiles.x);
+			rect.y0 = ndcToTile(ndcMin.y, numTiles.y);
+			rect.x1 = ndcToTile(ndcMax.x, numTiles.x);
+			rect.y1 = ndcToTile(ndcMax.y, numTiles.y);
+		}
+		this->tileRects.push_back(rect);
+	}
+
+	// Count the lights in each tile. Counts go straight into the count slots of tileLightMapping.
+	GLint numUnculled = (GLint)this->unculledLights.size();
+	pool.parallelFor((size_t)numTiles.y, [&](size_t y) {
+		GLint* row = tileLightMapping.data() + 2 * y * numTiles.x;
+		for (GLint x = 0; x < numTiles.x; x++) {
+			row[2 * x + 1] = numUnculled;
+		}
+		for (const TileRect& rect : this->tileRects) {
+			if ((GLint)y < rect.y0 || (GLint)y > rect.y1) {
+				continue;
+			}
+			for (GLint x = rect.x0; x <= rect.x1; x++) {
+				row[2 * x + 1]++;
+			}
+		}
+	});
+
+	// Prefix sum into offsets, then size lightsIndex once.
+	this->tileCursors.resize(numTilesXY);
+	size_t total = 0;
+	for (size_t t = 0; t < numTilesXY; t++) {
+		tileLightMapping[2 * t] = (GLint)total;
+		this->tileCursors[t] = (GLint)total;
+		total += (size_t)tileLightMapping[2 * t + 1];
+	}
+	lightsIndex.resize(total);
+
+	// Fill each row's lists, keeping lights in scene order within each group.
+	pool.parallelFor((size_t)numTiles.y, [&](size_t y) {
+		GLint* cursors = this->tileCursors.data() + y * numTiles.x;
+		for (GLint x = 0; x < numTiles.x; x++) {
+			std::copy(this->unculledLights.begin(), this->unculledLights.end(),
+				lightsIndex.begin() + cursors[x]);
+			cursors[x] += numUnculled;
+		}
+		for (const TileRect& rect : this->tileRects) {
+			if ((GLint)y < rect.y0 || (GLint)y > rect.y1) {
+				continue;
+			}
+			for (GLint x = rect.x0; x <= rect.x1; x++) {
+				lightsIndex[cursors[x]++] = rect.lightIdx;
+			}
+		}
+	});
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include "graphics/graphics_opengl.h"
+#include "objects/go_camera.h"
+#include "objects/go_light.h"
+#include "utils/threadpool.h"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+
+/*
+* CPU light culling shared by the forward and deferred OpenGL pipelines.
+*
+* Results use the same layout as the GPU culling shaders: for each tile/cluster,
+* tileLightMapping holds (offset, count) into lightsIndex, and lightsIndex holds
+* indices into scene->lights. Non-point lights are never culled, matching
+* clusterscull2.glsl.
+*
+* A LightCuller_CPU keeps its scratch buffers between frames, so each pipeline
+* should own one rather than creating one per frame.
+*/
+class LightCuller_CPU {
+public:
+
+	/*
+	* Culls lights against numTiles.x * numTiles.y * numTiles.z clusters, using the
+	* same exponential depth slicing as clustersgen.glsl. Cluster (x, y, z) is stored
+	* at index x + numTiles.x * (y + numTiles.y * z).
+	* Depth slices are distributed across the thread pool, and each slice tests its
+	* lights against the clusters' view-space AABBs several lights at a time (SSE).
+	*/
+	void cullClusters(
+		ThreadPool& pool,
+		GO_Camera* camera,
+		const std::vector<GO_Light*>& lights,
+		glm::ivec3 numTiles,
+		std::vector<GLint>& tileLightMapping,
+		std::vector<GLint>& lightsIndex
+	);
+
+	/*
+	* Culls lights against numTiles.x * numTiles.y screen tiles (numTiles.z is ignored).
+	* Tile (x, y) is stored at index x + numTiles.x * y, with y = 0 at the bottom of the
+	* screen, as with gl_FragCoord.
+	* Each light is projected once to the rectangle of tiles its bounding sphere covers.
+	* The lists are then built by counting, prefix-summing and filling, one tile row per
+	* task, so the cost follows the lights' screen coverage rather than tiles * lights.
+	*/
+	void cullTiles(
+		ThreadPool& pool,
+		GO_Camera* camera,
+		const std::vector<GO_Light*>& lights,
+		glm::ivec3 numTiles,
+		std::vector<GLint>& tileLightMapping,
+		std::vector<GLint>& lightsIndex
+	);
+
+private:
+
+	// View-space bounding spheres in SoA layout, so they can be tested in batches.
+	struct SphereBatch {
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+		std::vector<float> radius2;
+		std::vector<GLint> lightIdx;
+		void clear();
+		void push(float x, float y, float z, float radius2, GLint lightIdx);
+		void push(const SphereBatch& other, size_t i);
+		size_t size() const;
+	};
+
+	// Per-slice state. Each slice is only ever touched by one thread at a time.
+	struct Slice {
+		SphereBatch candidates;		// Lights whose depth range overlaps this slice.
+		SphereBatch rowCandidates;	// Candidates that overlap the current row of clusters.
+		std::vector<GLint> lightsIndex;		// Slice-local light lists, concatenated.
+	};
+	std::vector<Slice> slices;
+
+	// Lights that apply to every cluster (directional and spot lights).
+	std::vector<GLint> unculledLights;
+
+	// Inclusive range of tiles covered by a point light, for cullTiles.
+	struct TileRect {
+		GLint lightIdx;
+		GLint x0, y0, x1, y1;
+	};
+	std::vector<TileRect> tileRects;
+	std::vector<GLint> tileCursors;		// Next free slot in lightsIndex for each tile while filling.
+
+	// View-space cluster AABBs, and the AABB of each row of clusters within a slice.
+	// Only rebuilt when the resolution or projection changes.
+	std::vector<glm::vec3> clusterMin;
+	std::vector<glm::vec3> clusterMax;
+	std::vector<glm::vec3> rowMin;
+	std::vector<glm::vec3> rowMax;
+	glm::ivec3 clustersRes = glm::ivec3(0);
+	glm::mat4 clustersProj = glm::mat4(0.0f);
+	void updateClusterBounds(GO_Camera* camera, glm::ivec3 numTiles);
+
+};
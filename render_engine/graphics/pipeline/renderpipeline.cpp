@@ -7,4 +7,6 @@ void RenderPipeline::init() {}
 
 void RenderPipeline::resizeFramebuffer(size_t width, size_t height) {}
 
+void RenderPipeline::prepare(Scene* scene) {}
+
 void RenderPipeline::renderPrimitive(Rectangle rect, Ref<Material> material) {}
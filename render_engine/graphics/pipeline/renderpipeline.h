@@ -1,6 +1,6 @@
 #pragma once
 #include "geometry/rectangle.h"
-#include "graphics/Mesh.h"
+#include "graphics/mesh.h"
 
 #include <string>
 
@@ -49,6 +49,13 @@ public:
 	*/
 	virtual void resizeFramebuffer(size_t width, size_t height);
 
+	/*
+	* Called before the first frame of a scene, after resizeFramebuffer(), for setup that
+	* depends on the scene's contents (e.g. compiling the shader variants its materials use),
+	* so that it does not stall the first frame.
+	*/
+	virtual void prepare(Scene* scene);
+
 	virtual void render(Scene* scene) = 0;
 
 	virtual void renderMesh(Mesh* mesh) = 0;
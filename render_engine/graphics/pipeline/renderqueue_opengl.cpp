@@ -0,0 +1,347 @@
+#include "graphics/pipeline/renderqueue_opengl.h"
+#include "graphics/pipeline/uniforms_opengl.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+
+RenderQueue_OpenGL::RenderQueue_OpenGL() :
+	objectsSSBO(GL_SHADER_STORAGE_BUFFER, objectsSSBOBinding) {}
+
+RenderQueue_OpenGL::~RenderQueue_OpenGL() {
+	if (glIsBuffer(this->indirectBuffer)) {
+		glDeleteBuffers(1, &this->indirectBuffer);
+	}
+}
+
+
+void RenderQueue_OpenGL::build(GameObject* root) {
+	this->items.clear();
+	this->modelMatrices.clear();
+	if (root != nullptr) {
+		this->gather(root);
+	}
+
+	// Sort by state, then by mesh so arena meshes (which share a VAO) still form batches.
+	// Stable, so items that share all state keep their scene graph order.
+	this->sortOrder.resize(this->items.size());
+	std::iota(this->sortOrder.begin(), this->sortOrder.end(), 0);
+	std::stable_sort(this->sortOrder.begin(), this->sortOrder.end(), [this](uint32_t a, uint32_t b) {
+		const Item& itemA = this->items[a];
+		const Item& itemB = this->items[b];
+		if (itemA.stateKey != itemB.stateKey) {
+			return itemA.stateKey < itemB.stateKey;
+		}
+		return itemA.mesh->getID() < itemB.mesh->getID();
+	});
+	this->sortedItems.clear();
+	this->sortedMatrices.clear();
+	for (uint32_t i : this->sortOrder) {
+		this->sortedItems.push_back(this->items[i]);
+		this->sortedMatrices.push_back(this->modelMatrices[i]);
+	}
+	std::swap(this->items, this->sortedItems);
+	std::swap(this->modelMatrices, this->sortedMatrices);
+
+	SSBOObject* dst = (SSBOObject*)this->objectsSSBO.beginWrite(
+		std::max(this->items.size(), (size_t)1) * sizeof(SSBOObject));
+	this->batches.clear();
+	std::swap(this->prevWorldBoxes, this->worldBoxes);
+	this->worldBoxes.resize(this->items.size());
+	for (size_t i = 0; i < this->items.size(); i++) {
+		const glm::mat4& mMat = this->modelMatrices[i];
+		glm::mat3 normalMat = glm::transpose(glm::inverse(glm::mat3(mMat)));
+		dst[i].mMat = mMat;
+		dst[i].normalMat = glm::mat4(normalMat);
+
+		this->items[i].bounds = this->items[i].bounds.transformed(mMat);
+		this->worldBoxes[i] = this->items[i].bounds;
+
+		if (i > 0 && this->items[i].stateKey == this->items[i - 1].stateKey &&
+			this->items[i].gpuMesh == this->items[i - 1].gpuMesh) {
+			this->batches.back().count++;
+		}
+		else {
+			this->batches.push_back({ (uint32_t)i, 1 });
+		}
+	}
+	this->objectsSSBO.endWrite();
+
+	this->updateBVH();
+	this->updateStaticFrames();
+}
+
+void RenderQueue_OpenGL::updateBVH() {
+	// The items only need a new tree if they are not the same objects in the same order as last frame.
+	bool sameItems = this->bvhObjects.size() == this->items.size();
+	for (size_t i = 0; sameItems && i < this->items.size(); i++) {
+		sameItems = this->bvhObjects[i].first == this->items[i].object &&
+			this->bvhObjects[i].second == this->items[i].mesh;
+	}
+	this->itemsChanged = !sameItems;
+	if (sameItems) {
+		this->bvh.refit(this->worldBoxes);
+		return;
+	}
+	this->bvhObjects.clear();
+	for (const Item& item : this->items) {
+		this->bvhObjects.push_back({ item.object, item.mesh });
+	}
+	this->bvh.build(this->worldBoxes);
+}
+
+void RenderQueue_OpenGL::updateStaticFrames() {
+	if (this->itemsChanged) {
+		this->staticFrames.assign(this->items.size(), 0);
+	}
+	else {
+		for (size_t i = 0; i < this->items.size(); i++) {
+			if (this->modelMatrices[i] != this->prevModelMatrices[i]) {
+				this->staticFrames[i] = 0;
+			}
+			else if (this->staticFrames[i] < UINT32_MAX) {
+				this->staticFrames[i]++;
+			}
+		}
+	}
+	this->prevModelMatrices = this->modelMatrices;
+}
+
+void RenderQueue_OpenGL::gather(GameObject* obj) {
+	Mesh* mesh = obj->getMesh();
+	if (mesh != nullptr && mesh->getGPUMesh() != nullptr) {
+		GPUMesh_OpenGL* gpuMesh = (GPUMesh_OpenGL*)mesh->getGPUMesh();
+		Material* material = mesh->getMaterial().get();
+		uint64_t materialID = (material != nullptr) ? material->getID() : 0;
+		this->items.push_back({
+			gpuMesh,
+			mesh,
+			material,
+			obj,
+			mesh->getBoundingBox(),		// Transformed to world space in build().
+			((materialID & 0xFFFFFFFFull) << 32) | (uint64_t)gpuMesh->getVAO()
+		});
+		this->modelMatrices.push_back(obj->getModelMatrix());
+	}
+	for (auto& child : obj->getChildren()) {
+		this->gather(child.get());
+	}
+}
+
+
+void RenderQueue_OpenGL::draw(Shader_OpenGL& shader, const glm::mat4& viewMat, const glm::mat4& projMat,
+	BindMaterialFunc bindMaterial, Order order, const std::vector<uint8_t>* itemMask) {
+	struct SingleShader : public ShaderSelector {
+		Shader_OpenGL& shader;
+		SingleShader(Shader_OpenGL& shader) : shader(shader) {}
+		Shader_OpenGL& select(Material* material) override { return this->shader; }
+	};
+	SingleShader selector(shader);
+	this->draw(selector, viewMat, projMat, bindMaterial, order, itemMask);
+}
+
+void RenderQueue_OpenGL::draw(ShaderSelector& selector, const glm::mat4& viewMat, const glm::mat4& projMat,
+	BindMaterialFunc bindMaterial, Order order, const std::vector<uint8_t>* itemMask) {
+	glm::mat4 viewNormalMat = glm::inverse(glm::transpose(viewMat));
+	glm::mat4 viewProjMat = projMat * viewMat;
+
+	// Split each batch into runs of consecutive items that are in view.
+	this->bvh.cullFrustum(Frustum(viewProjMat), this->visible);
+	if (itemMask != nullptr) {
+		for (size_t i = 0; i < this->visible.size(); i++) {
+			this->visible[i] &= (*itemMask)[i];
+		}
+	}
+	this->runs.clear();
+	for (const Batch& batch : this->batches) {
+		bool inRun = false;
+		for (uint32_t i = batch.first; i < batch.first + batch.count; i++) {
+			if (!this->visible[i]) {
+				inRun = false;
+			}
+			else if (inRun) {
+				this->runs.back().count++;
+			}
+			else {
+				this->runs.push_back({ i, 1 });
+				inRun = true;
+			}
+		}
+	}
+
+	this->viewOrder.clear();
+	// View-space z of the world axes, for measuring the depth extent of the bounds.
+	glm::vec3 viewZ = glm::abs(glm::vec3(viewMat[0][2], viewMat[1][2], viewMat[2][2]));
+	for (uint32_t r = 0; r < (uint32_t)this->runs.size(); r++) {
+		uint64_t key = 0;
+		if (order == Order::FrontToBack) {
+			// Nearest distance to any instance's bounds. Non-negative floats sort the same as their bits.
+			const Batch& run = this->runs[r];
+			float depth = INFINITY;
+			for (uint32_t i = run.first; i < run.first + run.count; i++) {
+				const AABB& bounds = this->items[i].bounds;
+				float centerDepth = -(viewMat * glm::vec4(bounds.getCenter(), 1.0f)).z;
+				depth = std::min(depth, centerDepth - glm::dot(viewZ, bounds.getExtents()));
+			}
+			depth = std::max(depth, 0.0f);
+			uint32_t depthBits;
+			std::memcpy(&depthBits, &depth, sizeof(depthBits));
+			const Item& item = this->items[run.first];
+			uint64_t bucket = (item.material != nullptr && item.material->wireframe) ? 1 : 0;
+			key = (bucket << 32) | depthBits;
+		}
+		this->viewOrder.push_back({ key, r });
+	}
+	if (order == Order::FrontToBack) {
+		std::sort(this->viewOrder.begin(), this->viewOrder.end());
+	}
+
+	// Arena meshes are drawn with glMultiDrawElementsIndirect, one command per run, in view order.
+	this->commands.clear();
+	for (const auto& [key, r] : this->viewOrder) {
+		const Batch& run = this->runs[r];
+		GPUMesh_OpenGL* gpuMesh = this->items[run.first].gpuMesh;
+		if (gpuMesh->isInArena()) {
+			this->commands.push_back(gpuMesh->getIndirectCommand(run.count, run.first));
+		}
+	}
+	if (!this->commands.empty()) {
+		this->uploadCommands();
+	}
+
+	this->preparedShaders.clear();
+	Shader_OpenGL* boundShader = nullptr;
+	Material* boundMaterial = nullptr;
+	GLenum boundFill = GL_NONE;
+	GLuint boundVAO = 0;
+	// Items are sorted by material, so only ask the selector again when the material changes.
+	Material* selectedMaterial = nullptr;
+	Shader_OpenGL* selectedShader = nullptr;
+	auto select = [&](Material* material) {
+		if (selectedShader == nullptr || material != selectedMaterial) {
+			selectedShader = &selector.select(material);
+			selectedMaterial = material;
+		}
+		return selectedShader;
+	};
+	// Whether drawing the run at position v in viewOrder needs a shader, material or fill mode change.
+	auto needsRebind = [&](size_t v) {
+		const Item& item = this->items[this->runs[this->viewOrder[v].second].first];
+		if (select(item.material) != boundShader) {
+			return true;
+		}
+		if (bindMaterial != nullptr && item.material != nullptr && item.material != boundMaterial) {
+			return true;
+		}
+		return fillMode(item) != boundFill;
+	};
+
+	size_t nextCommand = 0;
+	for (size_t v = 0; v < this->viewOrder.size();) {
+		const Batch& run = this->runs[this->viewOrder[v].second];
+		const Item& item = this->items[run.first];
+		Shader_OpenGL* shader = select(item.material);
+		if (shader != boundShader) {
+			shader->bind();
+			boundShader = shader;
+			if (std::find(this->preparedShaders.begin(), this->preparedShaders.end(), shader) ==
+				this->preparedShaders.end()) {
+				shader->setUniformMat4(Uniforms::viewMat, viewMat);
+				shader->setUniformMat4(Uniforms::viewNormalMat, viewNormalMat);
+				shader->setUniformMat4(Uniforms::viewProjMat, viewProjMat);
+				selector.prepare(*shader);
+				this->preparedShaders.push_back(shader);
+			}
+			// Material uniforms belong to the program, so the new one needs them again.
+			boundMaterial = nullptr;
+		}
+		if (bindMaterial != nullptr && item.material != nullptr && item.material != boundMaterial) {
+			bindMaterial(*shader, item.material);
+			boundMaterial = item.material;
+		}
+		GLenum fill = fillMode(item);
+		if (fill != boundFill) {
+			glPolygonMode(GL_FRONT_AND_BACK, fill);
+			boundFill = fill;
+		}
+		GLuint vao = item.gpuMesh->getVAO();
+		if (vao == 0) {
+			v++;
+			continue;
+		}
+		if (vao != boundVAO) {
+			glBindVertexArray(vao);
+			boundVAO = vao;
+		}
+
+		if (item.gpuMesh->isInArena()) {
+			// Extend the multi-draw over every following arena run that needs no rebinding.
+			size_t end = v + 1;
+			while (end < this->viewOrder.size() &&
+				this->items[this->runs[this->viewOrder[end].second].first].gpuMesh->isInArena() &&
+				!needsRebind(end)) {
+				end++;
+			}
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+				(const void*)(nextCommand * sizeof(DrawElementsIndirectCommand)),
+				(GLsizei)(end - v), 0);
+			nextCommand += end - v;
+			v = end;
+			continue;
+		}
+
+		shader->setUniform1i(Uniforms::objectIndex, (GLint)run.first);
+		item.gpuMesh->drawBound((GLsizei)run.count, run.first);
+		v++;
+	}
+	glBindVertexArray(0);
+	if (!this->commands.empty()) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+}
+
+GLenum RenderQueue_OpenGL::fillMode(const Item& item) {
+	return (item.material != nullptr && item.material->wireframe) ? GL_LINE : GL_FILL;
+}
+
+void RenderQueue_OpenGL::uploadCommands() {
+	if (this->indirectBuffer == 0) {
+		glGenBuffers(1, &this->indirectBuffer);
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->indirectBuffer);
+	// Re-specifying the whole buffer orphans the storage a previous pass may still be reading.
+	glBufferData(GL_DRAW_INDIRECT_BUFFER,
+		this->commands.size() * sizeof(DrawElementsIndirectCommand),
+		this->commands.data(), GL_STREAM_DRAW);
+}
+
+const std::vector<RenderQueue_OpenGL::Item>& RenderQueue_OpenGL::getItems() {
+	return this->items;
+}
+const std::vector<glm::mat4>& RenderQueue_OpenGL::getModelMatrices() {
+	return this->modelMatrices;
+}
+const std::vector<RenderQueue_OpenGL::Batch>& RenderQueue_OpenGL::getBatches() {
+	return this->batches;
+}
+const std::vector<AABB>& RenderQueue_OpenGL::getWorldBounds() {
+	return this->worldBoxes;
+}
+AABB RenderQueue_OpenGL::getTotalBounds() {
+	return this->bvh.getBounds();
+}
+void RenderQueue_OpenGL::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& items) {
+	this->bvh.queryFrustum(frustum, items);
+}
+bool RenderQueue_OpenGL::getItemsChanged() {
+	return this->itemsChanged;
+}
+const std::vector<AABB>& RenderQueue_OpenGL::getPrevWorldBounds() {
+	return this->prevWorldBoxes;
+}
+const std::vector<uint32_t>& RenderQueue_OpenGL::getStaticFrames() {
+	return this->staticFrames;
+}
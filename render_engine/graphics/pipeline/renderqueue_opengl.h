@@ -0,0 +1,173 @@
+#pragma once
+#include "graphics/graphics_opengl.h"
+#include "graphics/material.h"
+#include "graphics/mesh.h"
+#include "geometry/aabb.h"
+#include "geometry/bvh.h"
+#include "objects/gameobject.h"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+
+/*
+* A flat list of everything to draw this frame, shared by every pass.
+*
+* build() walks the scene graph once per frame and gathers one Item per mesh,
+* and writes each item's model and normal matrices into an SSBO in a single upload.
+* Passes then iterate the items linearly with draw(), which sets the view/projection
+* once and only an index per item; the vertex shaders look the matrices up in the
+* ObjectTransforms buffer.
+*
+* Items are kept sorted by material and then VAO, and draw() only rebinds either when
+* it changes. A pass either uses a single shader, or a ShaderSelector that picks one per
+* material (e.g. a ShaderVariants_OpenGL variant), which then only changes with the material. Runs of items that share both
+* (e.g. many objects using one Mesh) are drawn as a single instanced draw call, with
+* gl_InstanceID offsetting into the ObjectTransforms buffer. Depth-only passes can
+* instead draw these batches front-to-back to get the most out of early depth testing.
+*
+* build() also keeps a BVH over the items' world bounds, refit each frame, or rebuilt when
+* the set of items changes. draw() uses it to skip items outside the view's frustum (which
+* works the same for the camera and for the shadow maps' orthographic volumes), and draws
+* only the visible runs of each batch.
+*
+* Each build() also counts how many builds in a row every item's world matrix has stayed
+* the same, so caches of static geometry (e.g. shadow maps) can tell what has moved.
+*
+* Meshes stored in the shared MeshArena_OpenGL (see Graphics_OpenGL::enableMultiDrawIndirect)
+* are submitted with glMultiDrawElementsIndirect instead, one command per batch, and one
+* call per run of batches that share a material and fill mode. Each command's baseInstance
+* is the batch's first item, which the shaders read as gl_BaseInstanceARB.
+*/
+class RenderQueue_OpenGL {
+public:
+
+	static constexpr GLuint objectsSSBOBinding = 5;		// Must align with the vertex shaders.
+
+	struct Item {
+		GPUMesh_OpenGL* gpuMesh;
+		Mesh* mesh;
+		Material* material;
+		GameObject* object;
+		AABB bounds;				// World space.
+		uint64_t stateKey;			// Material ID (high 32 bits), then VAO (low 32 bits). Arena meshes share a VAO.
+	};
+
+	enum class Order {
+		// Grouped by material and then VAO, to minimize state changes.
+		State,
+		// Nearest first, grouped only by fill mode (the only material state depth passes use).
+		// Depth passes should not pass bindMaterial, so arena batches merge into few multi-draws.
+		FrontToBack,
+	};
+
+	// Binds an item's material to shader. Material is never null.
+	using BindMaterialFunc = void(*)(Shader_OpenGL& shader, Material* material);
+
+	// Picks the shader each item is drawn with, for passes that use more than one.
+	class ShaderSelector {
+	public:
+		virtual ~ShaderSelector() = default;
+		// The shader to draw items using material (which may be null) with.
+		virtual Shader_OpenGL& select(Material* material) = 0;
+		// Called the first time each shader is bound in a draw(), to set the pass's uniforms.
+		virtual void prepare(Shader_OpenGL& shader) {}
+	};
+
+	RenderQueue_OpenGL();
+	RenderQueue_OpenGL(const RenderQueue_OpenGL& other) = delete;
+	RenderQueue_OpenGL& operator=(const RenderQueue_OpenGL& other) = delete;
+	~RenderQueue_OpenGL();
+
+	// A run of consecutive items that share a material and mesh, drawn as one instanced call.
+	struct Batch {
+		uint32_t first;
+		uint32_t count;
+	};
+
+	// Rebuilds the queue from the subtree at root and uploads its transforms.
+	void build(GameObject* root);
+
+	/*
+	* Draws every item within the frustum of projMat * viewMat with shader.
+	* If bindMaterial is given, it is called whenever the material changes between
+	* items (and is not null); depth-only passes can leave it out.
+	* The polygon mode follows each material's wireframe flag, and is GL_FILL afterwards.
+	* If itemMask is given, items whose entry is 0 are skipped too (e.g. occluded ones).
+	*/
+	void draw(Shader_OpenGL& shader, const glm::mat4& viewMat, const glm::mat4& projMat,
+		BindMaterialFunc bindMaterial = nullptr, Order order = Order::State,
+		const std::vector<uint8_t>* itemMask = nullptr);
+	// As above, but binds whichever shader selector picks for each item.
+	// The view uniforms are set on each shader before it is prepared.
+	void draw(ShaderSelector& selector, const glm::mat4& viewMat, const glm::mat4& projMat,
+		BindMaterialFunc bindMaterial = nullptr, Order order = Order::State,
+		const std::vector<uint8_t>* itemMask = nullptr);
+
+	// Items in draw (state) order, not scene graph order.
+	const std::vector<Item>& getItems();
+	// World matrix of each item, in the same order as getItems().
+	const std::vector<glm::mat4>& getModelMatrices();
+	const std::vector<Batch>& getBatches();
+	// World bounds of each item, in the same order as getItems().
+	const std::vector<AABB>& getWorldBounds();
+	// Bounds of every item together (empty if there are none).
+	AABB getTotalBounds();
+	// Sets items to the indices of the items whose world bounds intersect frustum, found
+	// through the BVH, in no particular order.
+	void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& items);
+	// Whether the items are not the same objects in the same order as the previous build().
+	bool getItemsChanged();
+	// World bounds of each item in the previous build(). Only meaningful if !getItemsChanged().
+	const std::vector<AABB>& getPrevWorldBounds();
+	// For each item, the number of builds in a row its world matrix has not changed (0 if it
+	// just moved, or if the items changed). In the same order as getItems().
+	const std::vector<uint32_t>& getStaticFrames();
+
+private:
+
+	// Matches struct ObjectTransform in the vertex shaders.
+	struct SSBOObject {
+		glm::mat4 mMat;
+		glm::mat4 normalMat;		// inverse(transpose(mMat)), in world space.
+	};
+
+	std::vector<Item> items;				// Sorted by stateKey. Index is the index into ObjectTransforms.
+	std::vector<glm::mat4> modelMatrices;
+	std::vector<Batch> batches;
+	RingBuffer_OpenGL objectsSSBO;
+
+	// Scratch for sorting items in build().
+	std::vector<uint32_t> sortOrder;
+	std::vector<Item> sortedItems;
+	std::vector<glm::mat4> sortedMatrices;
+	// World bounds of each item, and the tree over them.
+	std::vector<AABB> worldBoxes;
+	BVH bvh;
+	std::vector<std::pair<GameObject*, Mesh*>> bvhObjects;		// The items bvh was built for.
+	bool itemsChanged = true;
+	// The previous build's world matrices and bounds, and how long each item has stayed put.
+	std::vector<glm::mat4> prevModelMatrices;
+	std::vector<AABB> prevWorldBoxes;
+	std::vector<uint32_t> staticFrames;
+
+	// Scratch for per-view culling: visibility per item, then the visible parts of each batch.
+	std::vector<uint8_t> visible;
+	std::vector<Batch> runs;
+	// Scratch for per-view orders: (key, run index).
+	std::vector<std::pair<uint64_t, uint32_t>> viewOrder;
+	// Scratch for the shaders each draw() has bound so far.
+	std::vector<Shader_OpenGL*> preparedShaders;
+
+	// Indirect commands for the arena batches of the current draw(), in view order.
+	std::vector<DrawElementsIndirectCommand> commands;
+	GLuint indirectBuffer = 0;
+
+	void gather(GameObject* obj);
+	void updateBVH();
+	void updateStaticFrames();
+	void uploadCommands();
+	static GLenum fillMode(const Item& item);
+
+};
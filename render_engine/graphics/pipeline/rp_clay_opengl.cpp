@@ -1,4 +1,5 @@
 #include "graphics/pipeline/rp_clay_opengl.h"
+#include "graphics/pipeline/uniforms_opengl.h"
 #include "core/scene.h"
 #include "objects/gameobject.h"
 #include "objects/go_camera.h"
@@ -22,15 +23,15 @@ static void renderSubtree(
 	glm::mat4 mvMat = viewMat * obj->getModelMatrix();
 	// TODO: Get perspective matrix from active camera.
 	glm::mat4 mvpMat = projMat * mvMat;
-	shader.setUniformMat4("mvMat", mvMat);
-	shader.setUniformMat4("normalMat", glm::inverse(glm::transpose(mvMat)));
-	shader.setUniformMat4("mvpMat", mvpMat);
+	shader.setUniformMat4(Uniforms::mvMat, mvMat);
+	shader.setUniformMat4(Uniforms::normalMat, glm::inverse(glm::transpose(mvMat)));
+	shader.setUniformMat4(Uniforms::mvpMat, mvpMat);
 	// TODO: Get camera pos/dir.
-	shader.setUniform3f("cameraPos", glm::vec3(0.0f));
-	shader.setUniform3f("cameraDir", glm::vec3(0.0f, 0.0f, -1.0f));
-	shader.setUniform3f("clayColor", glm::vec3(1.0f, 0.4f, 0.2f));
-	shader.setUniform1f("claySpecularShininess", 6.0f);
-	shader.setUniform1f("claySpecular", 1.0f);
+	shader.setUniform3f(Uniforms::cameraPos, glm::vec3(0.0f));
+	shader.setUniform3f(Uniforms::cameraDir, glm::vec3(0.0f, 0.0f, -1.0f));
+	shader.setUniform3f(Uniforms::clayColor, glm::vec3(1.0f, 0.4f, 0.2f));
+	shader.setUniform1f(Uniforms::claySpecularShininess, 6.0f);
+	shader.setUniform1f(Uniforms::claySpecular, 1.0f);
 
 	obj->draw();
 	for (const Ref<GameObject>& child : obj->getChildren()) {
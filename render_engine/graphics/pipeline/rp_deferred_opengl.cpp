@@ -1,4 +1,6 @@
 #include "graphics/pipeline/rp_deferred_opengl.h"
+#include "graphics/pipeline/uniforms_opengl.h"
+#include "core/renderengine.h"
 #include "core/scene.h"
 #include "objects/gameobject.h"
 #include "objects/go_camera.h"
@@ -13,6 +15,11 @@
 
 
 
+static std::string lightDefines(uint64_t key) {
+	return "#define CULLING_METHOD " + std::to_string(key) + "\n";
+}
+
+
 RP_Deferred_OpenGL::RP_Deferred_OpenGL(Graphics& graphics) : RP_Deferred(graphics) {}
 
 
@@ -20,13 +27,15 @@ void RP_Deferred_OpenGL::init() {
 
 	std::cout << "RP_Deferred_OpenGL::init()\n";
 
-	this->gBufferShader.read(
+	this->gBufferShaders.read(
 		"shaders/opengl/deferred_gbuffer.vert", 
-		"shaders/opengl/deferred_gbuffer.frag"
+		"shaders/opengl/deferred_gbuffer.frag",
+		ShaderVariants_OpenGL::getMaterialDefines
 	);
-	this->lightShader.read(
+	this->lightShaders.read(
 		"shaders/opengl/deferred_light.vert",
-		"shaders/opengl/deferred_light.frag"
+		"shaders/opengl/deferred_light.frag",
+		lightDefines
 	);
 	this->rawShader.read(
 		"shaders/opengl/raw.vert",
@@ -36,6 +45,13 @@ void RP_Deferred_OpenGL::init() {
 		"shaders/opengl/post.vert",
 		"shaders/opengl/post.frag"
 	);
+	// Only used by some culling methods, but compiled up front so they never stall a frame.
+	this->clusterGenShader.readCompute(
+		"shaders/opengl/clustersgen.glsl"
+	);
+	this->clusterCullLightsShader.readCompute(
+		"shaders/opengl/clusterscull2.glsl"
+	);
 }
 
 void RP_Deferred_OpenGL::resizeFramebuffer(size_t width, size_t height) {
@@ -120,7 +136,7 @@ void RP_Deferred_OpenGL::resizeFramebuffer(size_t width, size_t height) {
 		std::cout << "Deferred renderer: Failed to initialize the gBuffer.\n";
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, ((Graphics_OpenGL*)this->thisGraphics)->getTargetFramebuffer());
 
 
 	// TEMP: until a gamma solution
@@ -142,86 +158,67 @@ void RP_Deferred_OpenGL::resizeFramebuffer(size_t width, size_t height) {
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
 		std::cout << "Deferred renderer: Failed to initialize preGamma buffer.\n";
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, ((Graphics_OpenGL*)this->thisGraphics)->getTargetFramebuffer());
 }
 
 
-static void bindMaterial(Shader_OpenGL& shader, Ref<Material> material) {
+void RP_Deferred_OpenGL::prepare(Scene* scene) {
+	this->lightShaders.get((uint64_t)this->culling);
+	if (!scene) return;
+	this->renderQueue.build(scene->getRoot().get());
+	for (const RenderQueue_OpenGL::Item& item : this->renderQueue.getItems()) {
+		this->gBufferShaders.get(ShaderVariants_OpenGL::getMaterialKey(item.material));
+	}
+}
+
+
+static void bindMaterial(Shader_OpenGL& shader, Material* material) {
 	// TODO: Support binding different types/more complex materials.
 	if (material) {
 		// Diffuse tex/color
-		shader.setUniform4f("colorDiffuse", material->getDiffuseColor());
+		shader.setUniform4f(Uniforms::colorDiffuse, material->getDiffuseColor());
 		if (material->getDiffuseTexture()) {
 			GPUTexture* gpuTex = material->getDiffuseTexture()->getGPUTexture();
-			shader.setUniformTex("textureDiffuse",
+			shader.setUniformTex(Uniforms::textureDiffuse,
 				((GPUTexture_OpenGL*)gpuTex)->getGLTexID(),
 				0, GL_TEXTURE_2D
 			);
 		}
 		// Metalness
-		shader.setUniform2f("metalnessFac", glm::vec2(material->getMetalness(),
-			1.0f-(float)bool(material->getMetalnessTexture())));
+		shader.setUniform1f(Uniforms::metalnessFac, material->getMetalness());
 		if (material->getMetalnessTexture()) {
 			GPUTexture* gpuTex = material->getMetalnessTexture()->getGPUTexture();
-			shader.setUniformTex("textureMetalness",
+			shader.setUniformTex(Uniforms::textureMetalness,
 				((GPUTexture_OpenGL*)gpuTex)->getGLTexID(),
 				1, GL_TEXTURE_2D
 			);
 		}
 		// Roughness
-		shader.setUniform2f("roughnessFac", glm::vec2(material->getRoughness(),
-			1.0f - (float)bool(material->getRoughnessTexture())));
+		shader.setUniform1f(Uniforms::roughnessFac, material->getRoughness());
 		if (material->getRoughnessTexture()) {
 			GPUTexture* gpuTex = material->getRoughnessTexture()->getGPUTexture();
-			shader.setUniformTex("textureRoughness",
+			shader.setUniformTex(Uniforms::textureRoughness,
 				((GPUTexture_OpenGL*)gpuTex)->getGLTexID(),
 				2, GL_TEXTURE_2D
 			);
 		}
 		// Normal
-		shader.setUniform1i("useNormalTex", (GLint)bool(material->getNormalTexture()));
 		if (material->getNormalTexture()) {
 			GPUTexture* gpuTex = material->getNormalTexture()->getGPUTexture();
-			shader.setUniformTex("textureNormal",
+			shader.setUniformTex(Uniforms::textureNormal,
 				((GPUTexture_OpenGL*)gpuTex)->getGLTexID(),
 				3, GL_TEXTURE_2D
 			);
 		}
-
-		// TODO: TEMP
-		if (material->wireframe) {
-			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		}
-		else {
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-		}
 	}
 	else {
-		shader.setUniform4f("colorDiffuse", glm::vec4(1.0f));
-		shader.setUniformTex("textureDiffuse",
+		shader.setUniform4f(Uniforms::colorDiffuse, glm::vec4(1.0f));
+		shader.setUniformTex(Uniforms::textureDiffuse,
 			0, 0, GL_TEXTURE_2D
 		);
 	}
 }
 
-static void renderSubtree(
-	Shader_OpenGL& shader, GameObject* obj,
-	const glm::mat4& viewMat, const glm::mat4 projMat
-) {
-
-	glm::mat4 mvMat = viewMat * obj->getModelMatrix();
-	glm::mat4 mvpMat = projMat * mvMat;
-	shader.setUniformMat4("mvMat", mvMat);
-	shader.setUniformMat4("normalMat", glm::inverse(glm::transpose(mvMat)));
-	shader.setUniformMat4("mvpMat", mvpMat);
-
-	obj->draw();
-
-	for (auto& child : obj->getChildren()) {
-		renderSubtree(shader, child.get(), viewMat, projMat);
-	}
-}
-
 void RP_Deferred_OpenGL::render(Scene* scene) {
 
 	// Pass 1: Render to gBuffer.
@@ -231,8 +228,6 @@ void RP_Deferred_OpenGL::render(Scene* scene) {
 	glEnable(GL_DEPTH_TEST);
 	glDisable(GL_BLEND);
 
-	this->gBufferShader.bind();
-
 	Ref<GO_Camera> activeCamera = scene->getActiveCamera();
 	glm::mat4 viewMatrix;
 	glm::mat4 projMatrix;
@@ -245,7 +240,17 @@ void RP_Deferred_OpenGL::render(Scene* scene) {
 		projMatrix = glm::mat4(1.0f);
 	}
 
-	renderSubtree(this->gBufferShader, scene->getRoot().get(), viewMatrix, projMatrix);
+	this->renderQueue.build(scene->getRoot().get());
+	// Each material draws with the variant for the textures it has.
+	struct GBufferSelector : public RenderQueue_OpenGL::ShaderSelector {
+		ShaderVariants_OpenGL& shaders;
+		GBufferSelector(ShaderVariants_OpenGL& shaders) : shaders(shaders) {}
+		Shader_OpenGL& select(Material* material) override {
+			return this->shaders.get(ShaderVariants_OpenGL::getMaterialKey(material));
+		}
+	};
+	GBufferSelector gBufferSelector(this->gBufferShaders);
+	this->renderQueue.draw(gBufferSelector, viewMatrix, projMatrix, bindMaterial);
 
 
 	// Pass 2: Render lights.
@@ -268,9 +273,10 @@ void RP_Deferred_OpenGL::render(Scene* scene) {
 	//this->renderPrimitive(Rectangle(-1.0f, -1.0f, 1.0f, 1.0f), nullptr);
 
 
-	this->lightShader.bind();
-	this->lightShader.setUniform2f("viewportSize", glm::vec2((float)this->width, (float)this->height));
-	this->lightShader.setUniform3f("numTiles", glm::vec3(this->numTiles));
+	Shader_OpenGL& lightShader = this->lightShaders.get((uint64_t)this->culling);
+	lightShader.bind();
+	lightShader.setUniform2f(Uniforms::viewportSize, glm::vec2((float)this->width, (float)this->height));
+	lightShader.setUniform3f(Uniforms::numTiles, glm::vec3(this->numTiles));
 
 	// Fullscreen quad matrix.
 	glm::mat4 mat;
@@ -278,17 +284,17 @@ void RP_Deferred_OpenGL::render(Scene* scene) {
 	mat[1] = glm::vec4(0.0f, 2.0f, 0.0f, 0.0f);
 	mat[2] = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
 	mat[3] = glm::vec4(-1.0f, -1.0f, 0.0f, 1.0f);
-	this->lightShader.setUniformMat4("mat", mat);
+	lightShader.setUniformMat4(Uniforms::mat, mat);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE);
 	glDisable(GL_DEPTH_TEST);
 	glDepthMask(GL_FALSE);
 
 
-	this->lightShader.setUniformTex("texturePos", this->gbPosTex, 0);
-	this->lightShader.setUniformTex("textureNormals", this->gbNormalTex, 1);
-	this->lightShader.setUniformTex("textureAlbedo", this->gbAlbedoTex, 2);
-	this->lightShader.setUniformTex("textureMetalRough", this->gbMetalRoughTex, 3);
+	lightShader.setUniformTex(Uniforms::texturePos, this->gbPosTex, 0);
+	lightShader.setUniformTex(Uniforms::textureNormals, this->gbNormalTex, 1);
+	lightShader.setUniformTex(Uniforms::textureAlbedo, this->gbAlbedoTex, 2);
+	lightShader.setUniformTex(Uniforms::textureMetalRough, this->gbMetalRoughTex, 3);
 
 	
 	this->updateLightsSSBO(scene, viewMatrix);
@@ -307,14 +313,14 @@ void RP_Deferred_OpenGL::render(Scene* scene) {
 		this->runClustersGPU(scene);
 	}
 
-	this->lightShader.bind();
+	lightShader.bind();
 
 
 	if (this->culling != LightCulling::RasterSphere) {
 
-		this->lightShader.setUniform1f("zNear", scene->getActiveCamera()->projectionParams.perspective.near);
-		this->lightShader.setUniform1f("zFar", scene->getActiveCamera()->projectionParams.perspective.far);
-		this->lightShader.setUniform2i("cullingMethod", glm::ivec2((GLint)this->culling, 0));
+		lightShader.setUniform1f(Uniforms::zNear, scene->getActiveCamera()->projectionParams.perspective.near);
+		lightShader.setUniform1f(Uniforms::zFar, scene->getActiveCamera()->projectionParams.perspective.far);
+		lightShader.setUniform2i(Uniforms::cullingMethod, glm::ivec2((GLint)this->culling, 0));
 		this->thisGraphics->primitives.rectangle->draw();
 
 	}
@@ -326,7 +332,7 @@ void RP_Deferred_OpenGL::render(Scene* scene) {
 		for (size_t i = 0; i < scene->lights.size(); i++) {
 			GO_Light* light = scene->lights[i];
 			// (method, light_index)
-			this->lightShader.setUniform2i("cullingMethod", glm::ivec2((GLint)LightCulling::RasterSphere, (GLint)i));
+			lightShader.setUniform2i(Uniforms::cullingMethod, glm::ivec2((GLint)LightCulling::RasterSphere, (GLint)i));
 			if (light->type == GO_Light::Type::Point) {
 				glDepthFunc(GL_GEQUAL);
 				glEnable(GL_DEPTH_TEST);
@@ -338,7 +344,7 @@ void RP_Deferred_OpenGL::render(Scene* scene) {
 				mat[2] = glm::vec4(0.0f, 0.0f, bs.radius, 0.0f);
 				mat[3] = glm::vec4(bs.position, 1.0f);
 				mat = projMatrix * viewMatrix * mat;
-				this->lightShader.setUniformMat4("mat", mat);
+				lightShader.setUniformMat4(Uniforms::mat, mat);
 				this->thisGraphics->primitives.sphere->draw();
 				glDepthFunc(GL_LEQUAL);
 				glDisable(GL_DEPTH_TEST);
@@ -351,7 +357,7 @@ void RP_Deferred_OpenGL::render(Scene* scene) {
 				mat[1] = glm::vec4(0.0f, 2.0f, 0.0f, 0.0f);
 				mat[2] = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
 				mat[3] = glm::vec4(-1.0f, -1.0f, 0.0f, 1.0f);
-				this->lightShader.setUniformMat4("mat", mat);
+				lightShader.setUniformMat4(Uniforms::mat, mat);
 				this->thisGraphics->primitives.rectangle->draw();
 				glEnable(GL_CULL_FACE);
 			}
@@ -365,29 +371,29 @@ void RP_Deferred_OpenGL::render(Scene* scene) {
 
 
 	// TEMP: until a gamma solution
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, ((Graphics_OpenGL*)this->thisGraphics)->getTargetFramebuffer());
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glDisable(GL_BLEND);
 	this->postShader.bind();
-	this->postShader.setUniformTex("textureMain", this->postTex);
+	this->postShader.setUniformTex(Uniforms::textureMain, this->postTex);
 	mat[0] = glm::vec4(2.0f, 0.0f, 0.0f, 0.0f);
 	mat[1] = glm::vec4(0.0f, 2.0f, 0.0f, 0.0f);
 	mat[2] = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
 	mat[3] = glm::vec4(-1.0f, -1.0f, 0.0f, 1.0f);
-	this->postShader.setUniformMat4("mat", mat);
+	this->postShader.setUniformMat4(Uniforms::mat, mat);
 	//glEnable(GL_FRAMEBUFFER_SRGB);
 	this->thisGraphics->primitives.rectangle->draw();
 	//glDisable(GL_FRAMEBUFFER_SRGB);
 	// The rest of this is to make sure the background color is drawn.
 	glBindFramebuffer(GL_READ_FRAMEBUFFER, this->gBuffer);
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, ((Graphics_OpenGL*)this->thisGraphics)->getTargetFramebuffer());
 	glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, this->width, this->height,
 		GL_DEPTH_BUFFER_BIT, GL_NEAREST);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, ((Graphics_OpenGL*)this->thisGraphics)->getTargetFramebuffer());
 	mat[3] = glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f);
 	this->rawShader.bind();
-	this->rawShader.setUniformMat4("mat", mat);
-	this->rawShader.setUniform4f("colorMain", glm::vec4(scene->backgroundColor, 1.0f));
+	this->rawShader.setUniformMat4(Uniforms::mat, mat);
+	this->rawShader.setUniform4f(Uniforms::colorMain, glm::vec4(scene->backgroundColor, 1.0f));
 	glEnable(GL_DEPTH_TEST);
 	this->thisGraphics->primitives.rectangle->draw();
 
@@ -398,10 +404,22 @@ void RP_Deferred_OpenGL::render(Scene* scene) {
 void RP_Deferred_OpenGL::renderMesh(Mesh* mesh) {
 	GPUMesh* gpuMesh = mesh->getGPUMesh();
 	if (gpuMesh) {
-		if (mesh->getMaterial()) {
-			bindMaterial(this->gBufferShader, mesh->getMaterial());
+		Shader_OpenGL& shader = this->gBufferShaders.get(
+			ShaderVariants_OpenGL::getMaterialKey(mesh->getMaterial().get()));
+		shader.bind();
+		Material* material = mesh->getMaterial().get();
+		if (material) {
+			bindMaterial(shader, material);
+		}
+		// Render queues set the fill mode themselves; this path has to do it here.
+		bool wireframe = material && material->wireframe;
+		if (wireframe) {
+			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 		}
 		gpuMesh->draw();
+		if (wireframe) {
+			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		}
 	}
 }
 
@@ -410,10 +428,10 @@ void RP_Deferred_OpenGL::renderPrimitive(
 ) {
 	this->rawShader.bind();
 	if (material) {
-		this->rawShader.setUniform4f("colorMain", material->getDiffuseColor());
+		this->rawShader.setUniform4f(Uniforms::colorMain, material->getDiffuseColor());
 		if (material->getDiffuseTexture()) {
 			GPUTexture* gpuTex = material->getDiffuseTexture()->getGPUTexture();
-			this->rawShader.setUniformTex("textureMain",
+			this->rawShader.setUniformTex(Uniforms::textureMain,
 				((GPUTexture_OpenGL*)gpuTex)->getGLTexID(),
 				0, GL_TEXTURE_2D
 			);
@@ -424,7 +442,7 @@ void RP_Deferred_OpenGL::renderPrimitive(
 	mat[1] = glm::vec4(0.0f, rect.widthHeight.y, 0.0f, 0.0f);
 	mat[2] = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
 	mat[3] = glm::vec4(rect.bottomLeft, 0.0f, 1.0f);
-	this->rawShader.setUniformMat4("mat", mat);
+	this->rawShader.setUniformMat4(Uniforms::mat, mat);
 	glDisable(GL_DEPTH_TEST);
 	this->thisGraphics->primitives.rectangle->draw();
 }
@@ -451,22 +469,9 @@ struct SSBOLight {
 void RP_Deferred_OpenGL::updateLightsSSBO(Scene* scene, glm::mat4 viewMatrix) {
 	if (!scene) return;
 	std::vector<GO_Light*>& lights = scene->lights;
-	if (this->lightsSSBO == 0 || this->lightsSSBONumLights != lights.size()) {
-		if (this->lightsSSBO != 0)
-			glDeleteBuffers(1, &this->lightsSSBO);
-		glGenBuffers(1, &this->lightsSSBO);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->lightsSSBO);
-		// +4 for ivec4 numLights
-		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::ivec4) + lights.size() * sizeof(SSBOLight), (void*)0, GL_DYNAMIC_DRAW);
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, this->lightsSSBOBinding, this->lightsSSBO);
-		this->lightsSSBONumLights = lights.size();
-	}
-	else {
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->lightsSSBO);
-	}
-
 	size_t len = sizeof(glm::ivec4) + lights.size() * sizeof(SSBOLight);
-	uint8_t* buf = new uint8_t[len];
+	// Written straight into the mapped buffer, so only write (never read) through buf.
+	uint8_t* buf = (uint8_t*)this->lightsSSBO.beginWrite(len);
 	// First element is number of lights.
 	((glm::ivec4*)buf)[0] = glm::ivec4((GLint)lights.size(), 0, 0, 0);
 	// Rest of the array is SSBOLight classes.
@@ -481,9 +486,7 @@ void RP_Deferred_OpenGL::updateLightsSSBO(Scene* scene, glm::mat4 viewMatrix) {
 		dst_light->color = glm::vec4(src_light->color, 0.0f);
 		dst_light->attenuation = glm::vec4(src_light->attenuation, 0.0f);
 	}
-	glBufferSubData(GL_SHADER_STORAGE_BUFFER, (GLintptr)0, (GLsizeiptr)len, buf);
-	delete[] buf;
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	this->lightsSSBO.endWrite();
 }
 
 
@@ -573,99 +576,42 @@ struct Frustum {
 
 
 
-static bool lightIntersectsFrustum(GO_Camera* camera, const Sphere& bs, float w,
-	glm::vec4 leftBottomRightTop, glm::vec2 nearFar) {
-	if (bs.position.z + bs.radius / w < nearFar.x || bs.position.z - bs.radius / w > nearFar.y) {
-		return false;
-	}
-	glm::vec2 radius2D = glm::vec2(
-		camera->projectionParams.perspective.aspect, 1.0f)
-		* bs.radius / w;
-	//return true;
-	glm::vec2 pos2D = glm::vec2(bs.position) / w;
-	//pos2D = 0.5f * pos2D + 0.5f;
-	//float screen_height = 2.0f * tan(camera->projectionParams.perspective.fovy / 2.0f);
-	//float screen_width = screen_height * camera->projectionParams.perspective.aspect;
-	//glm::vec2 wndSizeAtDepth = viewSpacePos.z * glm::vec2(screen_width, screen_height);
-	//glm::vec2 radius2D = glm::vec2(bs.radius) / wndSizeAtDepth;
-	//// Just do 2D bounding box comparison
-	glm::vec4 lbrt = glm::vec4(pos2D.x - radius2D.x, pos2D.y - radius2D.y, pos2D.x + radius2D.x, pos2D.y + radius2D.y);
-	return !(
-		lbrt.x >= leftBottomRightTop.z ||
-		lbrt.z <= leftBottomRightTop.x ||
-		lbrt.y >= leftBottomRightTop.w ||
-		lbrt.w <= leftBottomRightTop.y
-	);
-}
-
-
-
 void RP_Deferred_OpenGL::runTilesCPU(Scene* scene) {
 	GO_Camera* camera = scene->getActiveCamera().get();
 	if (camera == nullptr) {
 		return;
 	}
-	if (tileLightMapping.size() != (size_t)this->numTiles.x * this->numTiles.y * 2)
-		tileLightMapping.resize((size_t)this->numTiles.x * this->numTiles.y * 2);
-	this->lightsIndex.clear();
-
-	std::vector<GLint> tileLights;
-	tileLights.reserve(this->maxLightsPerTile);
 
-	glm::vec2 nearFar = glm::vec2(
-		camera->projectionParams.perspective.near,
-		camera->projectionParams.perspective.far
+	this->lightCuller.cullTiles(
+		*this->thisGraphics->getEngine()->getThreadPool(),
+		camera,
+		scene->lights,
+		this->numTiles,
+		this->tileLightMapping,
+		this->lightsIndex
 	);
 
-	lightVolumes.clear();
-	for (GO_Light* light : scene->lights) {
-		Sphere s;
-		s = light->getBoundingSphere();
-		glm::vec4 p = camera->getProjectionMatrix() * camera->getViewMatrix() * glm::vec4(s.position, 1.0f);
-		s.position = glm::vec3(p);
-		lightVolumes.push_back(std::pair<Sphere, float>(s, p.w));
-	}
-
-	// For each tile
-	for (size_t y = 0; y < this->numTiles.y; y++) {
-		for (size_t x = 0; x < this->numTiles.x; x++) {
-
-			glm::vec4 tileBounds = glm::vec4(
-				(float)x / (float)this->numTiles.x,
-				(float)y / (float)this->numTiles.y,
-				(float)(x + 1) / (float)this->numTiles.x,
-				(float)(y + 1) / (float)this->numTiles.y
-			);
-			tileLights.clear();
-
-			// For each light
-			for (GLint i = 0; i < (GLint)scene->lights.size(); i++) {
-				GO_Light* light = scene->lights[i];
-
-				// Detect if light intersects tile:
-				auto lv = lightVolumes[i];
-				if (light->type != GO_Light::Type::Point ||
-					lightIntersectsFrustum(camera, lv.first, lv.second, tileBounds, nearFar)) {
-					tileLights.push_back(i);
-				}
-
-			}
-
-			// Append the tile's lights to the global list and record indices.
-			this->tileLightMapping[2 * (y * this->numTiles.x + x)] = (GLint)this->lightsIndex.size();
-			this->tileLightMapping[2 * (y * this->numTiles.x + x) + 1] = (GLint)tileLights.size();
-			this->lightsIndex.insert(this->lightsIndex.end(), tileLights.begin(), tileLights.end());
-
-		}
-	}
-	
 	this->updateTileLightMappingSSBO();
 	this->updateLightsIndexSSBO();
-
 }
 
 void RP_Deferred_OpenGL::runClustersCPU(Scene* scene) {
+	GO_Camera* camera = scene->getActiveCamera().get();
+	if (camera == nullptr) {
+		return;
+	}
 
+	this->lightCuller.cullClusters(
+		*this->thisGraphics->getEngine()->getThreadPool(),
+		camera,
+		scene->lights,
+		this->numTiles,
+		this->tileLightMapping,
+		this->lightsIndex
+	);
+
+	this->updateTileLightMappingSSBO();
+	this->updateLightsIndexSSBO();
 }
 
 
@@ -690,17 +636,11 @@ void RP_Deferred_OpenGL::updateClustersSSBO(Scene* scene) {
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
 
-		// Load the compute shader if we haven't already
-		if (this->clusterGenShader.getID() == 0) {
-			this->clusterGenShader.readCompute(
-				"shaders/opengl/clustersgen.glsl"
-			);
-		}
 		this->clusterGenShader.bind();
-		this->clusterGenShader.setUniform1f("zNear", camera->projectionParams.perspective.near);
-		this->clusterGenShader.setUniform1f("zFar", camera->projectionParams.perspective.far);
+		this->clusterGenShader.setUniform1f(Uniforms::zNear, camera->projectionParams.perspective.near);
+		this->clusterGenShader.setUniform1f(Uniforms::zFar, camera->projectionParams.perspective.far);
 		glm::mat4 invProj = glm::inverse(camera->getProjectionMatrix());
-		this->clusterGenShader.setUniformMat4("inverseProjection", invProj);
+		this->clusterGenShader.setUniformMat4(Uniforms::inverseProjection, invProj);
 		glDispatchCompute((GLuint)this->numTiles.x, (GLuint)this->numTiles.y, (GLuint)this->numTiles.z);
 		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 	}
@@ -717,11 +657,6 @@ void RP_Deferred_OpenGL::runClustersGPU(Scene* scene) {
 	this->updateLightsIndexSSBO();
 	this->updateTileLightMappingSSBO();
 
-	if (this->clusterCullLightsShader.getID() == 0) {
-		this->clusterCullLightsShader.readCompute(
-			"shaders/opengl/clusterscull2.glsl"
-		);
-	}
 	this->clusterCullLightsShader.bind();
 	//glDispatchCompute(1, 1, 1);
 	glDispatchCompute((GLuint)this->numTiles.x, (GLuint)this->numTiles.y, (GLuint)this->numTiles.z);
@@ -1,6 +1,9 @@
 #pragma once
 #include "graphics/pipeline/rp_deferred.h"
 #include "graphics/graphics_opengl.h"
+#include "graphics/pipeline/lightculler_cpu.h"
+#include "graphics/pipeline/renderqueue_opengl.h"
+#include "graphics/pipeline/shadervariants_opengl.h"
 #include "geometry/sphere.h"
 
 
@@ -13,6 +16,9 @@ public:
 
 	virtual void resizeFramebuffer(size_t width, size_t height) override;
 
+	// Compiles the shader variants the scene's materials (and lights) need.
+	virtual void prepare(Scene* scene) override;
+
 	virtual void render(Scene* scene) override;
 
 	virtual void renderMesh(Mesh* mesh) override;
@@ -39,14 +45,17 @@ public:
 
 private:
 
-	Shader_OpenGL gBufferShader;
-	Shader_OpenGL lightShader;
+	ShaderVariants_OpenGL gBufferShaders;		// Keyed by material features.
+	ShaderVariants_OpenGL lightShaders;			// Keyed by culling method.
 	Shader_OpenGL rawShader;
 	Shader_OpenGL postShader;
 
 	GLsizei width = 0;
 	GLsizei height = 0;
 
+	// Everything to draw this frame, gathered once from the scene graph and shared by every pass.
+	RenderQueue_OpenGL renderQueue;
+
 	GLuint gBuffer = 0;
 	GLuint gbAlbedoTex = 0;
 	GLuint gbPosTex = 0;
@@ -57,9 +66,8 @@ private:
 	GLuint postFBO = 0;
 	GLuint postTex = 0;
 
-	GLuint lightsSSBO = 0;
-	size_t lightsSSBONumLights = 0;
 	static constexpr GLuint lightsSSBOBinding = 0;		// Must align with deferred_light.frag
+	RingBuffer_OpenGL lightsSSBO = RingBuffer_OpenGL(GL_SHADER_STORAGE_BUFFER, lightsSSBOBinding);
 	void updateLightsSSBO(Scene* scene, glm::mat4 viewMatrix);
 
 	// The SSBO storing mappings to ranges in lightsIndexSSBO (2 values per cluster, pos and len)
@@ -83,8 +91,8 @@ private:
 	void runTilesCPU(Scene* scene);
 	void runClustersCPU(Scene* scene);
 
-	// Cache light volumes to avoid reallocating memory.
-	std::vector<std::pair<Sphere, float>> lightVolumes;
+	// Keeps scratch buffers between frames for runTilesCPU and runClustersCPU.
+	LightCuller_CPU lightCuller;
 
 
 
@@ -1,5 +1,8 @@
 #include "graphics/pipeline/rp_forward_opengl.h"
+#include "graphics/pipeline/uniforms_opengl.h"
+#include "core/renderengine.h"
 #include "core/scene.h"
+#include "geometry/frustum.h"
 #include "objects/gameobject.h"
 #include "objects/go_camera.h"
 #include "utils/printutils.h"
@@ -7,136 +10,85 @@
 #include "glm/ext/matrix_clip_space.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 
+#include <algorithm>
 #include <iostream>
 
-#define MAX_SHADOW_MAPS 16
 #define SHADOW_MAP_SIZE 1024 // 256 for dolly vid
 #define SHADOW_MAP_TEX_INDEX 4 // larger than the highest active texture used for materials
+#define SHADOW_MOMENTS_TEX_INDEX 5
+#define SHADOW_STATIC_FRAMES 8 // frames a caster must stay still before it is cached with the static casters
 
 
-static void renderSubtree(
-	Shader_OpenGL& shader, GameObject* obj,
-	const glm::mat4& viewMat, const glm::mat4 projMat
-) {
-
-	glm::mat4 mMat = obj->getModelMatrix();
-	glm::mat4 mvMat = viewMat * mMat;
-	glm::mat4 mvpMat = projMat * mvMat;
-	shader.setUniformMat4("mMat", mMat);
-	shader.setUniformMat4("mvMat", mvMat);
-	shader.setUniformMat4("normalMat", glm::inverse(glm::transpose(mvMat)));
-	shader.setUniformMat4("mvpMat", mvpMat);
-
-	obj->draw();
-
-	for (auto& child : obj->getChildren()) {
-		renderSubtree(shader, child.get(), viewMat, projMat);
-	}
+// The view and projection a light's shadow map is drawn with.
+static glm::mat4 getLightViewMat(GO_Light* light) {
+	return glm::inverse(light->getModelMatrix());
+}
+static glm::mat4 getLightProjMat(GO_Light* light) {
+	return glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
 }
 
-
-class ShadowMap {
-private:
-
-	GLuint depthMapFBO = 0;
-	GLuint depthMap = 0;
-
-	GLsizei width;
-	GLsizei height;
-
-public:
-	
-	ShadowMap(
-		size_t width = SHADOW_MAP_SIZE,
-		size_t height = SHADOW_MAP_SIZE
-	) {
-		this->width = (GLsizei)width;
-		this->height = (GLsizei)height;
-		glGenFramebuffers(1, &this->depthMapFBO);
-		glGenTextures(1, &this->depthMap);
-		glBindTexture(GL_TEXTURE_2D, this->depthMap);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-			(GLsizei)width, (GLsizei)height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-		glBindFramebuffer(GL_FRAMEBUFFER, this->depthMapFBO);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->depthMap, 0);
-		glDrawBuffer(GL_NONE);
-		glReadBuffer(GL_NONE);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	}
-	ShadowMap(ShadowMap& other) { *this = other; }
-	ShadowMap(ShadowMap&& other) { *this = other; }
-	ShadowMap& operator=(ShadowMap& other) { return *this = std::move(other); }
-	ShadowMap& operator=(ShadowMap&& other) {
-		this->width = other.width;
-		this->height = other.height;
-		this->depthMapFBO = other.depthMapFBO;
-		this->depthMap = other.depthMap;
-		other.depthMapFBO = 0;
-		other.depthMap = 0;
-		return *this;
-	}
-
-	~ShadowMap() {
-		if (glIsFramebuffer(this->depthMapFBO)) {
-			glDeleteFramebuffers(1, &this->depthMapFBO);
-			this->depthMapFBO = 0;
-		}
-		if (glIsTexture(this->depthMap)) {
-			glDeleteTextures(1, &this->depthMap);
-			this->depthMap = 0;
-		}
-	}
-
-	GLuint getTexID() { return this->depthMap; }
-
-	static glm::mat4 lightToViewMat(GO_Light* light) {
-		return glm::inverse(light->getModelMatrix());
+// View depth <-> NDC depth, which works for any camera projection.
+static float getViewDepth(const glm::mat4& invProjMatrix, float ndcDepth) {
+	glm::vec4 p = invProjMatrix * glm::vec4(0.0f, 0.0f, ndcDepth, 1.0f);
+	return -p.z / p.w;
+}
+static float getNDCDepth(const glm::mat4& projMatrix, float viewDepth) {
+	glm::vec4 p = projMatrix * glm::vec4(0.0f, 0.0f, -viewDepth, 1.0f);
+	return p.z / p.w;
+}
+// World space corners of the slice of a camera's frustum between two view depths.
+static void getFrustumCorners(const glm::mat4& viewMatrix, const glm::mat4& projMatrix,
+	float nearDepth, float farDepth, glm::vec3 corners[8]) {
+	glm::mat4 invViewProj = glm::inverse(projMatrix * viewMatrix);
+	float ndcNear = getNDCDepth(projMatrix, nearDepth);
+	float ndcFar = getNDCDepth(projMatrix, farDepth);
+	for (int c = 0; c < 8; c++) {
+		glm::vec4 p = invViewProj * glm::vec4(
+			(c & 1) ? 1.0f : -1.0f,
+			(c & 2) ? 1.0f : -1.0f,
+			(c & 4) ? ndcFar : ndcNear,
+			1.0f
+		);
+		corners[c] = glm::vec3(p) / p.w;
 	}
+}
 
-	void renderSubtree(GO_Light* light, Shader_OpenGL& shader, GameObject* root) {
-		GLint currFBO, currCull;
-		GLint vp[4];
-		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &currFBO);
-		glGetIntegerv(GL_CULL_FACE_MODE, &currCull);
-		glGetIntegerv(GL_VIEWPORT, vp);
 
-		glm::mat4 proj = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
 
-		glViewport(0, 0, this->width, this->height);
-		glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-		glCullFace(GL_FRONT);
-		glClear(GL_DEPTH_BUFFER_BIT);
-		shader.bind();
-		::renderSubtree(shader, root, lightToViewMat(light), proj);
 
-		glViewport(vp[0], vp[1], (GLsizei)vp[2], (GLsizei)vp[3]);
-		glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)currFBO);
-		glCullFace((GLenum)currCull);
+// Variant keys for forwardShaders: material bits (0-7), shadow types (8-15), culling method (16-23).
+static uint64_t forwardKey(uint64_t materialKey, GLint shadowTypes, GLint culling) {
+	return (materialKey & ShaderVariants_OpenGL::MaterialMask) |
+		((uint64_t)(shadowTypes & 0xFF) << 8) | ((uint64_t)(culling & 0xFF) << 16);
+}
+static GLint getShadowTypes(const std::vector<GO_Light*>& lights) {
+	GLint shadowTypes = 0;
+	for (GO_Light* light : lights) {
+		if (light->shadowType != GO_Light::ShadowType::Disabled) {
+			shadowTypes |= 1 << (GLint)light->shadowType;
+		}
 	}
+	return shadowTypes;
+}
+static std::string forwardDefines(uint64_t key) {
+	return ShaderVariants_OpenGL::getMaterialDefines(key) +
+		"#define SHADOW_TYPES " + std::to_string((key >> 8) & 0xFF) + "\n" +
+		"#define CULLING_METHOD " + std::to_string((key >> 16) & 0xFF) + "\n";
+}
 
 
-};
-
-static std::vector<ShadowMap> shadowMaps;	// Max size is MAX_SHADOW_MAPS
-
-
-
-
-RP_Forward_OpenGL::RP_Forward_OpenGL(Graphics& graphics) : RP_Forward(graphics) {}
+RP_Forward_OpenGL::RP_Forward_OpenGL(Graphics& graphics) : RP_Forward(graphics),
+	shadowMaps(SHADOW_MAP_SIZE), staticShadowMaps(SHADOW_MAP_SIZE) {}
 
 
 void RP_Forward_OpenGL::init() {
 
 	std::cout << "RP_Forward_OpenGL::init()\n";
 
-	this->forwardShader.read(
+	this->forwardShaders.read(
 		"shaders/opengl/forward.vert",
-		"shaders/opengl/forward.frag"
+		"shaders/opengl/forward.frag",
+		forwardDefines
 	);
 	this->rawShader.read(
 		"shaders/opengl/raw.vert",
@@ -149,6 +101,15 @@ void RP_Forward_OpenGL::init() {
 	this->zprepassShader.read(
 		"shaders/opengl/zprepass.vert"
 	);
+	// Only used by some culling methods, but compiled up front so they never stall a frame.
+	this->clusterGenShader.readCompute(
+		"shaders/opengl/clustersgen.glsl"
+	);
+	this->clusterCullLightsShader.readCompute(
+		"shaders/opengl/clusterscull2.glsl"
+	);
+	this->hiZ.init();
+	this->shadowMaps.init();
 }
 
 void RP_Forward_OpenGL::resizeFramebuffer(size_t width, size_t height) {
@@ -170,6 +131,9 @@ void RP_Forward_OpenGL::resizeFramebuffer(size_t width, size_t height) {
 	if (glIsTexture(this->postTex)) {
 		glDeleteTextures(1, &this->postTex);
 	}
+	if (glIsTexture(this->postDepthTex)) {
+		glDeleteTextures(1, &this->postDepthTex);
+	}
 	glGenFramebuffers(1, &this->postFBO);
 	glBindFramebuffer(GL_FRAMEBUFFER, this->postFBO);
 	glGenTextures(1, &this->postTex);
@@ -179,76 +143,78 @@ void RP_Forward_OpenGL::resizeFramebuffer(size_t width, size_t height) {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->postTex, 0);
 
-	glGenRenderbuffers(1, &this->postDepthRB);
-	glBindRenderbuffer(GL_RENDERBUFFER, this->postDepthRB);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, this->width, this->height);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->postDepthRB);
+	// A texture rather than a renderbuffer, so the z-prepass depth can be read for occlusion culling.
+	glGenTextures(1, &this->postDepthTex);
+	glBindTexture(GL_TEXTURE_2D, this->postDepthTex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, this->width, this->height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->postDepthTex, 0);
 
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
 		std::cout << "Forward renderer: Failed to initialize preGamma buffer.\n";
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, ((Graphics_OpenGL*)this->thisGraphics)->getTargetFramebuffer());
+}
+
+
+void RP_Forward_OpenGL::prepare(Scene* scene) {
+	if (!scene) return;
+	this->shadowTypes = getShadowTypes(scene->lights);
+	this->renderQueue.build(scene->getRoot().get());
+	for (const RenderQueue_OpenGL::Item& item : this->renderQueue.getItems()) {
+		this->getForwardShader(item.material);
+	}
 }
 
 
-static void bindMaterial(Shader_OpenGL& shader, Ref<Material> material) {
+static void bindMaterial(Shader_OpenGL& shader, Material* material) {
 	// TODO: Support binding different types/more complex materials.
 	if (material) {
 		// Diffuse tex/color
-		shader.setUniform4f("colorDiffuse", material->getDiffuseColor());
+		shader.setUniform4f(Uniforms::colorDiffuse, material->getDiffuseColor());
 		if (material->getDiffuseTexture()) {
 			GPUTexture* gpuTex = material->getDiffuseTexture()->getGPUTexture();
-			shader.setUniformTex("textureDiffuse",
+			shader.setUniformTex(Uniforms::textureDiffuse,
 				((GPUTexture_OpenGL*)gpuTex)->getGLTexID(),
 				0, GL_TEXTURE_2D
 			);
 		}
 		// Metalness
-		shader.setUniform2f("metalnessFac", glm::vec2(material->getMetalness(),
-			1.0f - (float)bool(material->getMetalnessTexture())));
+		shader.setUniform1f(Uniforms::metalnessFac, material->getMetalness());
 		if (material->getMetalnessTexture()) {
 			GPUTexture* gpuTex = material->getMetalnessTexture()->getGPUTexture();
-			shader.setUniformTex("textureMetalness",
+			shader.setUniformTex(Uniforms::textureMetalness,
 				((GPUTexture_OpenGL*)gpuTex)->getGLTexID(),
 				1, GL_TEXTURE_2D
 			);
 		}
 		// Roughness
-		shader.setUniform2f("roughnessFac", glm::vec2(material->getRoughness(),
-			1.0f - (float)bool(material->getRoughnessTexture())));
+		shader.setUniform1f(Uniforms::roughnessFac, material->getRoughness());
 		if (material->getRoughnessTexture()) {
 			GPUTexture* gpuTex = material->getRoughnessTexture()->getGPUTexture();
-			shader.setUniformTex("textureRoughness",
+			shader.setUniformTex(Uniforms::textureRoughness,
 				((GPUTexture_OpenGL*)gpuTex)->getGLTexID(),
 				2, GL_TEXTURE_2D
 			);
 		}
 		// Normal
-		shader.setUniform1i("useNormalTex", (GLint)bool(material->getNormalTexture()));
 		if (material->getNormalTexture()) {
 			GPUTexture* gpuTex = material->getNormalTexture()->getGPUTexture();
-			shader.setUniformTex("textureNormal",
+			shader.setUniformTex(Uniforms::textureNormal,
 				((GPUTexture_OpenGL*)gpuTex)->getGLTexID(),
 				3, GL_TEXTURE_2D
 			);
 		}
 
-		shader.setUniform2i("metalRoughChannels",
+		shader.setUniform2i(Uniforms::metalRoughChannels,
 			(material->getRoughnessTexture() == material->getMetalnessTexture()) ?
 			glm::ivec2(2, 1) : glm::ivec2(0, 0)
 		);
-
-		// TODO: TEMP
-		if (material->wireframe) {
-			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		}
-		else {
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-		}
 	}
 	else {
-		shader.setUniform4f("colorDiffuse", glm::vec4(1.0f));
-		shader.setUniformTex("textureDiffuse",
+		shader.setUniform4f(Uniforms::colorDiffuse, glm::vec4(1.0f));
+		shader.setUniformTex(Uniforms::textureDiffuse,
 			0, 0, GL_TEXTURE_2D
 		);
 	}
@@ -284,43 +250,71 @@ void RP_Forward_OpenGL::render(Scene* scene) {
 	}
 
 
+	this->renderQueue.build(scene->getRoot().get());
+
 	this->zprepassShader.bind();
-	renderSubtree(this->zprepassShader, scene->getRoot().get(), viewMatrix, projMatrix);
+	this->renderQueue.draw(this->zprepassShader, viewMatrix, projMatrix,
+		nullptr, RenderQueue_OpenGL::Order::FrontToBack);
+
+	// Only the shading pass uses this; objects hidden from the camera can still cast visible shadows.
+	if (this->occlusionCulling) {
+		this->occlusionMask.assign(this->renderQueue.getItems().size(), 1);
+		this->hiZ.build(this->postDepthTex, this->width, this->height);
+		this->hiZ.cull(this->renderQueue.getWorldBounds(), projMatrix * viewMatrix, this->occlusionMask);
+	}
 
 
+	// Shadow maps first, so the lights SSBO points at this frame's layers.
+	this->updateShadowMaps(scene, viewMatrix, projMatrix);
 	this->updateLightsSSBO(scene, viewMatrix);
-	this->updateShadowMaps(scene);
-	if (this->culling == LightCulling::ClusteredGPU) {
+	if (this->culling == LightCulling::TiledCPU) {
+		this->runTilesCPU(scene);
+	}
+	else if (this->culling == LightCulling::ClusteredCPU) {
+		this->runClustersCPU(scene);
+	}
+	else if (this->culling == LightCulling::ClusteredGPU) {
 		this->runClustersGPU(scene);
 	}
 
-	this->forwardShader.bind();
-	this->forwardShader.setUniform1f("zNear", scene->getActiveCamera()->projectionParams.perspective.near);
-	this->forwardShader.setUniform1f("zFar", scene->getActiveCamera()->projectionParams.perspective.far);
-	this->forwardShader.setUniform2i("cullingMethod", glm::ivec2((GLint)this->culling, 0));
-	this->forwardShader.setUniform2f("viewportSize", glm::vec2((float)this->width, (float)this->height));
-	this->forwardShader.setUniform3f("numTiles", glm::vec3(this->numTiles));
-	updateShadowMapUniforms(this->forwardShader);
+	// Each material picks its variant; every variant used gets the pass's uniforms once.
+	struct ShadingSelector : public RenderQueue_OpenGL::ShaderSelector {
+		RP_Forward_OpenGL* pipeline;
+		Scene* scene;
+		ShadingSelector(RP_Forward_OpenGL* pipeline, Scene* scene) : pipeline(pipeline), scene(scene) {}
+		Shader_OpenGL& select(Material* material) override {
+			return this->pipeline->getForwardShader(material);
+		}
+		void prepare(Shader_OpenGL& shader) override {
+			shader.setUniform1f(Uniforms::zNear, this->scene->getActiveCamera()->projectionParams.perspective.near);
+			shader.setUniform1f(Uniforms::zFar, this->scene->getActiveCamera()->projectionParams.perspective.far);
+			shader.setUniform2f(Uniforms::viewportSize, glm::vec2((float)this->pipeline->width, (float)this->pipeline->height));
+			shader.setUniform3f(Uniforms::numTiles, glm::vec3(this->pipeline->numTiles));
+			this->pipeline->updateShadowMapUniforms(shader);
+		}
+	};
+	ShadingSelector shadingSelector(this, scene);
 
 	glDepthMask(GL_FALSE);
-	renderSubtree(this->forwardShader, scene->getRoot().get(), viewMatrix, projMatrix);
+	this->renderQueue.draw(shadingSelector, viewMatrix, projMatrix, bindMaterial,
+		RenderQueue_OpenGL::Order::State, this->occlusionCulling ? &this->occlusionMask : nullptr);
 	glDepthMask(GL_TRUE);
 
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
 
 	// Post stuff
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, ((Graphics_OpenGL*)this->thisGraphics)->getTargetFramebuffer());
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glDisable(GL_BLEND);
 	this->postShader.bind();
-	this->postShader.setUniformTex("textureMain", this->postTex);
+	this->postShader.setUniformTex(Uniforms::textureMain, this->postTex);
 	glm::mat4 mat;
 	mat[0] = glm::vec4(2.0f, 0.0f, 0.0f, 0.0f);
 	mat[1] = glm::vec4(0.0f, 2.0f, 0.0f, 0.0f);
 	mat[2] = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
 	mat[3] = glm::vec4(-1.0f, -1.0f, 0.0f, 1.0f);
-	this->postShader.setUniformMat4("mat", mat);
+	this->postShader.setUniformMat4(Uniforms::mat, mat);
 	this->thisGraphics->primitives.rectangle->draw();
 
 	this->thisGraphics->swapBuffers();
@@ -495,10 +489,21 @@ void RP_Forward_OpenGL::render(Scene* scene) {
 void RP_Forward_OpenGL::renderMesh(Mesh* mesh) {
 	GPUMesh* gpuMesh = mesh->getGPUMesh();
 	if (gpuMesh) {
-		if (mesh->getMaterial()) {
-			bindMaterial(this->forwardShader, mesh->getMaterial());
+		Shader_OpenGL& shader = this->getForwardShader(mesh->getMaterial().get());
+		shader.bind();
+		Material* material = mesh->getMaterial().get();
+		if (material) {
+			bindMaterial(shader, material);
+		}
+		// Render queues set the fill mode themselves; this path has to do it here.
+		bool wireframe = material && material->wireframe;
+		if (wireframe) {
+			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 		}
 		gpuMesh->draw();
+		if (wireframe) {
+			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		}
 	}
 }
 
@@ -507,10 +512,10 @@ void RP_Forward_OpenGL::renderPrimitive(
 ) {
 	this->rawShader.bind();
 	if (material) {
-		this->rawShader.setUniform4f("colorMain", material->getDiffuseColor());
+		this->rawShader.setUniform4f(Uniforms::colorMain, material->getDiffuseColor());
 		if (material->getDiffuseTexture()) {
 			GPUTexture* gpuTex = material->getDiffuseTexture()->getGPUTexture();
-			this->rawShader.setUniformTex("textureMain",
+			this->rawShader.setUniformTex(Uniforms::textureMain,
 				((GPUTexture_OpenGL*)gpuTex)->getGLTexID(),
 				0, GL_TEXTURE_2D
 			);
@@ -521,64 +526,336 @@ void RP_Forward_OpenGL::renderPrimitive(
 	mat[1] = glm::vec4(0.0f, rect.widthHeight.y, 0.0f, 0.0f);
 	mat[2] = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
 	mat[3] = glm::vec4(rect.bottomLeft, 0.0f, 1.0f);
-	this->rawShader.setUniformMat4("mat", mat);
+	this->rawShader.setUniformMat4(Uniforms::mat, mat);
 	glDisable(GL_DEPTH_TEST);
 	this->thisGraphics->primitives.rectangle->draw();
 }
 
 
 
-void RP_Forward_OpenGL::updateShadowMaps(Scene* scene) {
-	this->forwardShader.bind();
+Shader_OpenGL& RP_Forward_OpenGL::getForwardShader(Material* material) {
+	return this->forwardShaders.get(forwardKey(
+		ShaderVariants_OpenGL::getMaterialKey(material), this->shadowTypes, (GLint)this->culling));
+}
+
+
+
+void RP_Forward_OpenGL::updateShadowMaps(Scene* scene, const glm::mat4& viewMatrix, const glm::mat4& projMatrix) {
+	// Every light with shadows gets its layers, first-come first-serve,
+	// up to the maximum number of layers in an array texture.
+	GLint numCascades = std::clamp(this->numShadowCascades, 1, maxShadowCascades);
+	std::vector<GO_Light*> lights;
+	size_t numLayers = 0;
+	for (GO_Light* light : scene->lights) {
+		if (light->shadowType != GO_Light::ShadowType::Disabled) {
+			lights.push_back(light);
+			numLayers += (light->type == GO_Light::Type::Directional) ? numCascades : 1;
+		}
+	}
+	bool reallocated = this->shadowMaps.reserve((GLsizei)numLayers);
+	reallocated |= this->staticShadowMaps.reserve((GLsizei)numLayers);
 
-	std::vector<GO_Light*>& lights = scene->lights;
-	// Shadow maps are first-come first-serve.
-	// If there are more than MAX_SHADOW_MAPS lights with shadows enabled,
-	// only the first ones found will get shadow maps.
-	size_t shadow_map_index = 0;
+	this->shadowViews.clear();
+	this->shadowMapIndices.clear();
 	for (GO_Light* light : lights) {
-		if (light->shadowType != GO_Light::ShadowType::Disabled) {
-			if (shadow_map_index < MAX_SHADOW_MAPS) {
-				if (shadow_map_index >= shadowMaps.size()) {
-					shadowMaps.push_back(ShadowMap());
-				}
-				shadowMapIndices[light] = shadow_map_index;
-				shadowMaps[shadow_map_index].renderSubtree(
-					light,
+		size_t layers = (light->type == GO_Light::Type::Directional) ? numCascades : 1;
+		if (this->shadowViews.size() + layers > (size_t)this->shadowMaps.getNumLayers()) {
+			break;
+		}
+		this->shadowMapIndices[light] = this->shadowViews.size();
+		if (light->type == GO_Light::Type::Directional) {
+			this->addShadowCascades(light, viewMatrix, projMatrix);
+		}
+		else {
+			ShadowView view = {
+				light,
+				getLightViewMat(light),
+				getLightProjMat(light),
+				getLightProjMat(light),
+				glm::vec2(1.0f, 0.0f),
+				light->getScale(),
+				0.0f,
+				1
+			};
+			this->fitShadowDepth(view);
+			this->shadowViews.push_back(view);
+		}
+	}
+	this->shadowCaches.resize(this->shadowViews.size());
+	this->layerCasters.resize(this->shadowViews.size());
+
+	// Split the casters into static ones (still for a while), whose depth is cached per light,
+	// and dynamic ones, drawn over a copy of the cache every frame they are in the light's volume.
+	const std::vector<uint32_t>& staticFrames = this->renderQueue.getStaticFrames();
+	const std::vector<AABB>& bounds = this->renderQueue.getWorldBounds();
+	const std::vector<AABB>& prevBounds = this->renderQueue.getPrevWorldBounds();
+	bool itemsChanged = this->renderQueue.getItemsChanged();
+	std::swap(this->prevStaticCasters, this->staticCasters);
+	this->staticCasters.resize(staticFrames.size());
+	this->dynamicCasters.resize(staticFrames.size());
+	// Anywhere the set of static casters changed, and anywhere a dynamic caster is.
+	this->staticChanges.clear();
+	this->dynamicBounds.clear();
+	for (size_t i = 0; i < staticFrames.size(); i++) {
+		this->staticCasters[i] = staticFrames[i] >= SHADOW_STATIC_FRAMES;
+		this->dynamicCasters[i] = !this->staticCasters[i];
+		if (this->dynamicCasters[i]) {
+			this->dynamicBounds.push_back(bounds[i]);
+		}
+		if (!itemsChanged && this->staticCasters[i] != this->prevStaticCasters[i]) {
+			AABB change = bounds[i];
+			change.expand(prevBounds[i]);
+			this->staticChanges.push_back(change);
+		}
+	}
+	if (this->shadowViews.empty()) {
+		return;
+	}
+	auto anyInFrustum = [](const std::vector<AABB>& boxes, const Frustum& frustum) {
+		return std::any_of(boxes.begin(), boxes.end(),
+			[&frustum](const AABB& box) { return frustum.intersects(box); });
+	};
+
+	// Dynamic casters are drawn every frame anyway, so they are also culled against what the
+	// layer can receive on: a caster only matters if it overlaps the receivers across the
+	// light's direction, and is not entirely behind them. The receivers are the part of the
+	// view frustum that gets shadows, or for a cascade, only its own slice of it. Static
+	// casters are cached, so they are not culled this way.
+	float zNear;
+	float zFar;
+	this->getShadowDepthRange(projMatrix, zNear, zFar);
+	auto getLayerCasters = [&](size_t layer, std::vector<uint8_t>& casters) {
+		const ShadowView& view = this->shadowViews[layer];
+		bool cascaded = view.cascadeFar > 0.0f;
+		float sliceNear = (cascaded && view.numCascades == 0) ? this->shadowViews[layer - 1].cascadeFar : zNear;
+		float sliceFar = cascaded ? view.cascadeFar : zFar;
+		glm::vec3 corners[8];
+		getFrustumCorners(viewMatrix, projMatrix, sliceNear, sliceFar, corners);
+		AABB receivers;
+		for (int c = 0; c < 8; c++) {
+			receivers.expand(glm::vec3(view.viewMat * glm::vec4(corners[c], 1.0f)));
+		}
+		this->renderQueue.queryFrustum(Frustum(view.projMat * view.viewMat), this->casterQuery);
+		bool any = false;
+		casters.assign(bounds.size(), 0);
+		for (uint32_t i : this->casterQuery) {
+			if (!this->dynamicCasters[i]) {
+				continue;
+			}
+			// Light space looks down -z, so larger z is nearer the light.
+			AABB lightBox = bounds[i].transformed(view.viewMat);
+			casters[i] = lightBox.max.x >= receivers.min.x && lightBox.min.x <= receivers.max.x &&
+				lightBox.max.y >= receivers.min.y && lightBox.min.y <= receivers.max.y &&
+				lightBox.max.z >= receivers.min.z;
+			any |= (bool)casters[i];
+		}
+		return any;
+	};
+
+	// Re-render a layer's static casters only if its view, or the static casters in its volume, changed.
+	std::vector<uint8_t> renderStatic(this->shadowViews.size(), 0);
+	std::vector<uint8_t> renderDynamic(this->shadowViews.size(), 0);
+	bool anyStatic = false;
+	bool anyCopy = false;
+	for (size_t i = 0; i < this->shadowViews.size(); i++) {
+		const ShadowView& view = this->shadowViews[i];
+		ShadowCache& cache = this->shadowCaches[i];
+		glm::mat4 viewProjMat = view.projMat * view.viewMat;
+		Frustum frustum(viewProjMat);
+		renderStatic[i] = reallocated || itemsChanged || !cache.valid ||
+			cache.light != view.light || cache.viewProjMat != viewProjMat ||
+			anyInFrustum(this->staticChanges, frustum);
+		renderDynamic[i] = anyInFrustum(this->dynamicBounds, frustum) &&
+			getLayerCasters(i, this->layerCasters[i]);
+		// The layer needs a fresh copy of the cache if it changed, if dynamic casters are drawn
+		// over it, or if last frame's dynamic casters need to be erased.
+		bool copy = renderStatic[i] || renderDynamic[i] || cache.hasDynamic;
+		cache.light = view.light;
+		cache.viewProjMat = viewProjMat;
+		cache.valid = true;
+		cache.hasDynamic = renderDynamic[i];
+		cache.copied = copy;
+		anyStatic |= (bool)renderStatic[i];
+		anyCopy |= copy;
+	}
+
+	if (anyStatic) {
+		this->staticShadowMaps.begin();
+		for (size_t i = 0; i < this->shadowViews.size(); i++) {
+			if (renderStatic[i]) {
+				this->staticShadowMaps.render((GLsizei)i,
 					this->zprepassShader,	// re-use
-					scene->getRoot().get()
+					this->renderQueue,
+					this->shadowViews[i].viewMat,
+					this->shadowViews[i].projMat,
+					&this->staticCasters
 				);
-
-				if (++shadow_map_index >= MAX_SHADOW_MAPS)
-					break;
 			}
-			else {
-				shadowMapIndices.erase(light);
+		}
+		this->staticShadowMaps.end();
+	}
+	if (anyCopy) {
+		this->shadowMaps.begin();
+		for (size_t i = 0; i < this->shadowViews.size(); i++) {
+			if (!this->shadowCaches[i].copied) {
+				continue;
+			}
+			this->shadowMaps.copyLayer(this->staticShadowMaps, (GLsizei)i, (GLsizei)i);
+			if (renderDynamic[i]) {
+				this->shadowMaps.render((GLsizei)i,
+					this->zprepassShader,	// re-use
+					this->renderQueue,
+					this->shadowViews[i].viewMat,
+					this->shadowViews[i].projMat,
+					&this->layerCasters[i],
+					false
+				);
 			}
 		}
+		this->shadowMaps.end();
+	}
+
+	// Variance shadows sample the prefiltered moments of their layers instead of the depth.
+	bool anyMoments = std::any_of(this->shadowViews.begin(), this->shadowViews.end(),
+		[](const ShadowView& view) { return view.light->shadowType == GO_Light::ShadowType::VSM; });
+	if (anyMoments) {
+		bool refilter = this->shadowMaps.reserveMoments();
+		for (size_t i = 0; i < this->shadowViews.size(); i++) {
+			ShadowCache& cache = this->shadowCaches[i];
+			bool moments = this->shadowViews[i].light->shadowType == GO_Light::ShadowType::VSM;
+			if (moments && (refilter || cache.copied || !cache.hasMoments)) {
+				this->shadowMaps.filterMoments((GLsizei)i);
+			}
+			cache.hasMoments = moments;
+		}
 	}
-	// TODO: erase unused shadow maps
 }
 
-void RP_Forward_OpenGL::updateShadowMapUniforms(Shader_OpenGL& shader) {
-	for (auto& [light, index] : this->shadowMapIndices) {
-		if (index >= shadowMaps.size()) continue;
-		this->forwardShader.setUniformTex(
-			"shadowMaps[" + std::to_string(index) + "]",
-			shadowMaps[index].getTexID(),
-			SHADOW_MAP_TEX_INDEX + index, GL_TEXTURE_2D
-		);
-		this->forwardShader.setUniformMat4(
-			"shadowMapMats[" + std::to_string(index) + "]",
-			glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f) * ShadowMap::lightToViewMat(light)
-		);
-		this->forwardShader.setUniform3f(
-			"shadowScales[" + std::to_string(index) + "]",
-			light->getScale()
+void RP_Forward_OpenGL::addShadowCascades(GO_Light* light, const glm::mat4& viewMatrix, const glm::mat4& projMatrix) {
+	float zNear;
+	float zFar;
+	this->getShadowDepthRange(projMatrix, zNear, zFar);
+
+	// The light's orientation only, about the world origin. Cascades are translated within
+	// it in whole texels, so shadow edges don't crawl as the camera moves.
+	glm::vec3 dir = glm::normalize(light->getWorldSpaceDirection());
+	glm::vec3 up = (std::abs(dir.y) > 0.99f) ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), dir, up);
+	// Casters can't be nearer the light than the nearest point of the whole scene.
+	const std::vector<AABB>& bounds = this->renderQueue.getWorldBounds();
+	AABB sceneBounds = this->renderQueue.getTotalBounds();
+	float sceneTop = sceneBounds.isEmpty() ? -INFINITY : sceneBounds.transformed(lightView).max.z;
+
+	GLint numCascades = std::clamp(this->numShadowCascades, 1, maxShadowCascades);
+	float splitNear = zNear;
+	for (GLint k = 0; k < numCascades; k++) {
+		// Practical split scheme: a blend of uniform and logarithmic splits.
+		float t = (float)(k + 1) / (float)numCascades;
+		float uniformSplit = zNear + (zFar - zNear) * t;
+		float logSplit = (zNear > 0.0f) ? zNear * std::pow(zFar / zNear, t) : uniformSplit;
+		float splitFar = glm::mix(uniformSplit, logSplit, this->shadowCascadeLambda);
+
+		// Bound the slice of the view frustum with a sphere, whose size doesn't change as the
+		// camera turns, so neither does the cascade's texel size.
+		glm::vec3 corners[8];
+		getFrustumCorners(viewMatrix, projMatrix, splitNear, splitFar, corners);
+		glm::vec3 center = glm::vec3(0.0f);
+		for (int c = 0; c < 8; c++) {
+			center += corners[c] / 8.0f;
+		}
+		float radius = 0.0f;
+		for (int c = 0; c < 8; c++) {
+			radius = std::max(radius, glm::length(corners[c] - center));
+		}
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		// Snap the center to whole texels in light space.
+		float texel = 2.0f * radius / (float)this->shadowMaps.getSize();
+		glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+		lightCenter = glm::floor(lightCenter / texel) * texel;
+
+		// Light space looks down -z. Pull the near plane back to the casters (toward the light)
+		// that overlap the cascade, so objects outside the view still cast into it.
+		float zMin = lightCenter.z - radius;
+		float zMax = lightCenter.z + radius;
+		if (sceneTop > zMax) {
+			// Only casters between the cascade and the light, over its extent, can move it.
+			Frustum casterVolume(glm::ortho(
+				lightCenter.x - radius, lightCenter.x + radius,
+				lightCenter.y - radius, lightCenter.y + radius,
+				-sceneTop, -zMax
+			) * lightView);
+			this->renderQueue.queryFrustum(casterVolume, this->casterQuery);
+			for (uint32_t i : this->casterQuery) {
+				if (!bounds[i].isEmpty()) {
+					zMax = std::max(zMax, bounds[i].transformed(lightView).max.z);
+				}
+			}
+		}
+		zMax = std::ceil(zMax / texel) * texel;
+
+		glm::mat4 lightProj = glm::ortho(
+			lightCenter.x - radius, lightCenter.x + radius,
+			lightCenter.y - radius, lightCenter.y + radius,
+			-zMax, -zMin
 		);
+		this->shadowViews.push_back({
+			light,
+			lightView,
+			lightProj,
+			lightProj,					// Already fitted.
+			glm::vec2(1.0f, 0.0f),
+			glm::vec3(radius, radius, 0.5f * (zMax - zMin)),
+			splitFar,
+			(k == 0) ? numCascades : 0
+		});
+		splitNear = splitFar;
 	}
 }
 
+void RP_Forward_OpenGL::fitShadowDepth(ShadowView& view) {
+	// The light's volume spans z in [-1, 1] of its view space. Only casters write depth,
+	// so the map only has to cover the depth range of the casters inside the volume.
+	const std::vector<AABB>& bounds = this->renderQueue.getWorldBounds();
+	this->renderQueue.queryFrustum(Frustum(view.volumeProjMat * view.viewMat), this->casterQuery);
+	float zMin = INFINITY;
+	float zMax = -INFINITY;
+	for (uint32_t i : this->casterQuery) {
+		if (!bounds[i].isEmpty()) {
+			AABB lightBox = bounds[i].transformed(view.viewMat);
+			zMin = std::min(zMin, lightBox.min.z);
+			zMax = std::max(zMax, lightBox.max.z);
+		}
+	}
+	// Rounded out to 1/32 of the volume, so small movements don't invalidate the shadow cache.
+	zMin = std::max(std::floor(zMin * 16.0f) / 16.0f, -1.0f);
+	zMax = std::min(std::ceil(zMax * 16.0f) / 16.0f, 1.0f);
+	if (!(zMin < zMax)) {
+		return;
+	}
+	float mapNear = -zMax;
+	float mapFar = -zMin;
+	view.projMat = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, mapNear, mapFar);
+	// The volume's depth is 0.5 * (1 - z), and the map's is (-z - mapNear) / (mapFar - mapNear).
+	view.depthFit = glm::vec2(2.0f, -1.0f - mapNear) / (mapFar - mapNear);
+}
+
+void RP_Forward_OpenGL::getShadowDepthRange(const glm::mat4& projMatrix, float& zNear, float& zFar) {
+	glm::mat4 invProj = glm::inverse(projMatrix);
+	zNear = getViewDepth(invProj, -1.0f);
+	zFar = getViewDepth(invProj, 1.0f);
+	if (this->shadowDistance > 0.0f) {
+		zFar = std::min(zFar, this->shadowDistance);
+	}
+}
+
+void RP_Forward_OpenGL::updateShadowMapUniforms(Shader_OpenGL& shader) {
+	shader.setUniformTex(Uniforms::shadowMaps, this->shadowMaps.getTexID(),
+		SHADOW_MAP_TEX_INDEX, GL_TEXTURE_2D_ARRAY);
+	shader.setUniformTex(Uniforms::shadowMoments, this->shadowMaps.getMomentsTexID(),
+		SHADOW_MOMENTS_TEX_INDEX, GL_TEXTURE_2D_ARRAY);
+}
+
 
 
 
@@ -601,27 +878,28 @@ struct SSBOLight {
 	glm::vec4 attenuation;			// vec3
 };
 
+// One per shadow map layer, indexed by SSBOLight::typeShadowIndexRadius.z.
+struct SSBOShadowMap {
+	// View space to the shadow map's clip space.
+	glm::mat4 viewToShadow;
+	// Half extents of the shadow map's volume, in world space.
+	glm::vec4 scale;				// vec3
+	// View depth this cascade ends at (0 if not cascaded) (x),
+	// and the number of cascades starting at this map (y).
+	glm::vec4 cascade;				// vec2
+	// Maps depth in viewToShadow's volume to the map's (fitted) depth: depth * x + y.
+	glm::vec4 depthFit;				// vec2
+};
+
 void RP_Forward_OpenGL::updateLightsSSBO(Scene* scene, glm::mat4 viewMatrix) {
 	if (!scene) return;
 	std::vector<GO_Light*>& lights = scene->lights;
-	if (this->lightsSSBO == 0 || this->lightsSSBONumLights != lights.size()) {
-		if (this->lightsSSBO != 0)
-			glDeleteBuffers(1, &this->lightsSSBO);
-		glGenBuffers(1, &this->lightsSSBO);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->lightsSSBO);
-		// +4 for ivec4 numLights
-		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::ivec4) + lights.size() * sizeof(SSBOLight), (void*)0, GL_DYNAMIC_DRAW);
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, this->lightsSSBOBinding, this->lightsSSBO);
-		this->lightsSSBONumLights = lights.size();
-	}
-	else {
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->lightsSSBO);
-	}
-
 	size_t len = sizeof(glm::ivec4) + lights.size() * sizeof(SSBOLight);
-	uint8_t* buf = new uint8_t[len];
+	// Written straight into the mapped buffer, so only write (never read) through buf.
+	uint8_t* buf = (uint8_t*)this->lightsSSBO.beginWrite(len);
 	// First element is number of lights.
 	((glm::ivec4*)buf)[0] = glm::ivec4((GLint)lights.size(), 0, 0, 0);
+	this->shadowTypes = getShadowTypes(lights);
 	// Rest of the array is SSBOLight classes.
 	for (size_t i = 0; i < lights.size(); i++) {
 		GO_Light* src_light = lights[i];
@@ -638,9 +916,19 @@ void RP_Forward_OpenGL::updateLightsSSBO(Scene* scene, glm::mat4 viewMatrix) {
 		dst_light->color = glm::vec4(src_light->color, 0.0f);
 		dst_light->attenuation = glm::vec4(src_light->attenuation, 0.0f);
 	}
-	glBufferSubData(GL_SHADER_STORAGE_BUFFER, (GLintptr)0, (GLsizeiptr)len, buf);
-	delete[] buf;
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	this->lightsSSBO.endWrite();
+
+	glm::mat4 invViewMatrix = glm::inverse(viewMatrix);
+	size_t numShadowMaps = std::max(this->shadowViews.size(), (size_t)1);
+	SSBOShadowMap* shadowMaps = (SSBOShadowMap*)this->shadowMapsSSBO.beginWrite(numShadowMaps * sizeof(SSBOShadowMap));
+	for (size_t i = 0; i < this->shadowViews.size(); i++) {
+		const ShadowView& view = this->shadowViews[i];
+		shadowMaps[i].viewToShadow = view.volumeProjMat * view.viewMat * invViewMatrix;
+		shadowMaps[i].scale = glm::vec4(view.scale, 0.0f);
+		shadowMaps[i].cascade = glm::vec4(view.cascadeFar, (float)view.numCascades, 0.0f, 0.0f);
+		shadowMaps[i].depthFit = glm::vec4(view.depthFit, 0.0f, 0.0f);
+	}
+	this->shadowMapsSSBO.endWrite();
 }
 
 
@@ -731,99 +1019,42 @@ struct Frustum {
 
 
 
-static bool lightIntersectsFrustum(GO_Camera* camera, const Sphere& bs, float w,
-	glm::vec4 leftBottomRightTop, glm::vec2 nearFar) {
-	if (bs.position.z + bs.radius / w < nearFar.x || bs.position.z - bs.radius / w > nearFar.y) {
-		return false;
-	}
-	glm::vec2 radius2D = glm::vec2(
-		camera->projectionParams.perspective.aspect, 1.0f)
-		* bs.radius / w;
-	//return true;
-	glm::vec2 pos2D = glm::vec2(bs.position) / w;
-	//pos2D = 0.5f * pos2D + 0.5f;
-	//float screen_height = 2.0f * tan(camera->projectionParams.perspective.fovy / 2.0f);
-	//float screen_width = screen_height * camera->projectionParams.perspective.aspect;
-	//glm::vec2 wndSizeAtDepth = viewSpacePos.z * glm::vec2(screen_width, screen_height);
-	//glm::vec2 radius2D = glm::vec2(bs.radius) / wndSizeAtDepth;
-	//// Just do 2D bounding box comparison
-	glm::vec4 lbrt = glm::vec4(pos2D.x - radius2D.x, pos2D.y - radius2D.y, pos2D.x + radius2D.x, pos2D.y + radius2D.y);
-	return !(
-		lbrt.x >= leftBottomRightTop.z ||
-		lbrt.z <= leftBottomRightTop.x ||
-		lbrt.y >= leftBottomRightTop.w ||
-		lbrt.w <= leftBottomRightTop.y
-		);
-}
-
-
-
 void RP_Forward_OpenGL::runTilesCPU(Scene* scene) {
 	GO_Camera* camera = scene->getActiveCamera().get();
 	if (camera == nullptr) {
 		return;
 	}
-	if (tileLightMapping.size() != (size_t)this->numTiles.x * this->numTiles.y * 2)
-		tileLightMapping.resize((size_t)this->numTiles.x * this->numTiles.y * 2);
-	this->lightsIndex.clear();
-
-	std::vector<GLint> tileLights;
-	tileLights.reserve(this->maxLightsPerTile);
 
-	glm::vec2 nearFar = glm::vec2(
-		camera->projectionParams.perspective.near,
-		camera->projectionParams.perspective.far
+	this->lightCuller.cullTiles(
+		*this->thisGraphics->getEngine()->getThreadPool(),
+		camera,
+		scene->lights,
+		this->numTiles,
+		this->tileLightMapping,
+		this->lightsIndex
 	);
 
-	lightVolumes.clear();
-	for (GO_Light* light : scene->lights) {
-		Sphere s;
-		s = light->getBoundingSphere();
-		glm::vec4 p = camera->getProjectionMatrix() * camera->getViewMatrix() * glm::vec4(s.position, 1.0f);
-		s.position = glm::vec3(p);
-		lightVolumes.push_back(std::pair<Sphere, float>(s, p.w));
-	}
-
-	// For each tile
-	for (size_t y = 0; y < this->numTiles.y; y++) {
-		for (size_t x = 0; x < this->numTiles.x; x++) {
-
-			glm::vec4 tileBounds = glm::vec4(
-				(float)x / (float)this->numTiles.x,
-				(float)y / (float)this->numTiles.y,
-				(float)(x + 1) / (float)this->numTiles.x,
-				(float)(y + 1) / (float)this->numTiles.y
-			);
-			tileLights.clear();
-
-			// For each light
-			for (GLint i = 0; i < (GLint)scene->lights.size(); i++) {
-				GO_Light* light = scene->lights[i];
-
-				// Detect if light intersects tile:
-				const auto& lv = lightVolumes[i];
-				if (light->type != GO_Light::Type::Point ||
-					lightIntersectsFrustum(camera, lv.first, lv.second, tileBounds, nearFar)) {
-					tileLights.push_back(i);
-				}
-
-			}
-
-			// Append the tile's lights to the global list and record indices.
-			this->tileLightMapping[2 * (y * this->numTiles.x + x)] = (GLint)this->lightsIndex.size();
-			this->tileLightMapping[2 * (y * this->numTiles.x + x) + 1] = (GLint)tileLights.size();
-			this->lightsIndex.insert(this->lightsIndex.end(), tileLights.begin(), tileLights.end());
-
-		}
-	}
-
 	this->updateTileLightMappingSSBO();
 	this->updateLightsIndexSSBO();
-
 }
 
 void RP_Forward_OpenGL::runClustersCPU(Scene* scene) {
+	GO_Camera* camera = scene->getActiveCamera().get();
+	if (camera == nullptr) {
+		return;
+	}
+
+	this->lightCuller.cullClusters(
+		*this->thisGraphics->getEngine()->getThreadPool(),
+		camera,
+		scene->lights,
+		this->numTiles,
+		this->tileLightMapping,
+		this->lightsIndex
+	);
 
+	this->updateTileLightMappingSSBO();
+	this->updateLightsIndexSSBO();
 }
 
 
@@ -848,17 +1079,11 @@ void RP_Forward_OpenGL::updateClustersSSBO(Scene* scene) {
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
 
-		// Load the compute shader if we haven't already
-		if (this->clusterGenShader.getID() == 0) {
-			this->clusterGenShader.readCompute(
-				"shaders/opengl/clustersgen.glsl"
-			);
-		}
 		this->clusterGenShader.bind();
-		this->clusterGenShader.setUniform1f("zNear", camera->projectionParams.perspective.near);
-		this->clusterGenShader.setUniform1f("zFar", camera->projectionParams.perspective.far);
+		this->clusterGenShader.setUniform1f(Uniforms::zNear, camera->projectionParams.perspective.near);
+		this->clusterGenShader.setUniform1f(Uniforms::zFar, camera->projectionParams.perspective.far);
 		glm::mat4 invProj = glm::inverse(camera->getProjectionMatrix());
-		this->clusterGenShader.setUniformMat4("inverseProjection", invProj);
+		this->clusterGenShader.setUniformMat4(Uniforms::inverseProjection, invProj);
 		glDispatchCompute((GLuint)this->numTiles.x, (GLuint)this->numTiles.y, (GLuint)this->numTiles.z);
 		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 	}
@@ -875,11 +1100,6 @@ void RP_Forward_OpenGL::runClustersGPU(Scene* scene) {
 	this->updateLightsIndexSSBO();
 	this->updateTileLightMappingSSBO();
 
-	if (this->clusterCullLightsShader.getID() == 0) {
-		this->clusterCullLightsShader.readCompute(
-			"shaders/opengl/clusterscull2.glsl"
-		);
-	}
 	this->clusterCullLightsShader.bind();
 	//glDispatchCompute(1, 1, 1);
 	glDispatchCompute((GLuint)this->numTiles.x, (GLuint)this->numTiles.y, (GLuint)this->numTiles.z);
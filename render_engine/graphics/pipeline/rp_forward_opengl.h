@@ -1,6 +1,11 @@
 #pragma once
 #include "graphics/pipeline/rp_forward.h"
 #include "graphics/graphics_opengl.h"
+#include "graphics/pipeline/hiz_opengl.h"
+#include "graphics/pipeline/lightculler_cpu.h"
+#include "graphics/pipeline/renderqueue_opengl.h"
+#include "graphics/pipeline/shadervariants_opengl.h"
+#include "graphics/pipeline/shadowmaps_opengl.h"
 #include "geometry/sphere.h"
 #include "objects/go_light.h"
 
@@ -14,6 +19,9 @@ public:
 
 	virtual void resizeFramebuffer(size_t width, size_t height) override;
 
+	// Compiles the shader variants the scene's materials (and lights) need.
+	virtual void prepare(Scene* scene) override;
+
 	virtual void render(Scene* scene) override;
 
 	virtual void renderMesh(Mesh* mesh) override;
@@ -35,11 +43,24 @@ public:
 	// (X,Y,Z) For tiled (instead of clustered), third element should be 1.
 	glm::ivec3 numTiles = glm::ivec3(80, 45, 32);
 	GLint maxLightsPerTile = 64;
+	// Skip shading meshes that are hidden behind the z-prepass depth (see HiZ_OpenGL).
+	bool occlusionCulling = false;
+
+	// Directional lights split the camera's view depth into this many shadow maps (cascades),
+	// each fitted to its slice of the view frustum. Clamped to [1, maxShadowCascades].
+	GLint numShadowCascades = 4;
+	static constexpr GLint maxShadowCascades = 8;
+	// Blends the cascade splits between uniform (0) and logarithmic (1) in view depth.
+	float shadowCascadeLambda = 0.75f;
+	// View depth the last cascade ends at, or 0 for the camera's far plane.
+	float shadowDistance = 0.0f;
 
 
 private:
 
-	Shader_OpenGL forwardShader;
+	// forward.frag, specialized by material features, the shadow types in use and the culling method.
+	ShaderVariants_OpenGL forwardShaders;
+	Shader_OpenGL& getForwardShader(Material* material);
 	Shader_OpenGL rawShader;
 	Shader_OpenGL postShader;
 	Shader_OpenGL zprepassShader;
@@ -47,21 +68,77 @@ private:
 	GLsizei width = 0;
 	GLsizei height = 0;
 
+	// Everything to draw this frame, gathered once from the scene graph and shared by every pass.
+	RenderQueue_OpenGL renderQueue;
+
 
 	GLuint postFBO = 0;
 	GLuint postTex = 0;
-	GLuint postDepthRB = 0;
-
-
-	std::unordered_map<GO_Light*, size_t> shadowMapIndices;	// light -> index into shadowMaps (static in rp_forward_opengl.cpp)
-	void updateShadowMaps(Scene* scene);
+	GLuint postDepthTex = 0;		// Sampled by hiZ after the z-prepass.
+
+	HiZ_OpenGL hiZ;
+	std::vector<uint8_t> occlusionMask;		// Per renderQueue item, 0 if occluded.
+
+
+	/*
+	* Shadow maps are cached per layer: staticShadowMaps keeps the depth of the casters that
+	* have not moved for a while, and is only redrawn where the layer's view or those casters
+	* change. Each frame a layer of shadowMaps (what forward.frag samples) is a copy of its
+	* static layer, with any dynamic casters in its volume drawn over it. Layers with neither
+	* a changed cache nor dynamic casters are skipped entirely.
+	*
+	* Directional lights use numShadowCascades consecutive layers, other lights one.
+	* Layers of variance (GO_Light::ShadowType::VSM) lights also get their moments filtered
+	* whenever they are redrawn.
+	*/
+	ShadowMaps_OpenGL shadowMaps;
+	ShadowMaps_OpenGL staticShadowMaps;
+	struct ShadowView {
+		GO_Light* light;
+		glm::mat4 viewMat;
+		glm::mat4 projMat;		// What the map is drawn with, fitted to the casters' depth.
+		glm::mat4 volumeProjMat;	// The light's volume, which receivers are tested against.
+		glm::vec2 depthFit;		// Maps volumeProjMat's depth to projMat's: depth * x + y.
+		glm::vec3 scale;		// Half extents of the view's volume, in world space.
+		float cascadeFar;		// View depth this cascade ends at, or 0 if the light is not cascaded.
+		GLint numCascades;		// Layers the light uses from this one on (1 if not cascaded, 0 past its first).
+	};
+	std::vector<ShadowView> shadowViews;						// Per layer of shadowMaps.
+	std::unordered_map<GO_Light*, size_t> shadowMapIndices;	// Light -> first layer of shadowMaps.
+	// Appends a directional light's cascades to shadowViews.
+	void addShadowCascades(GO_Light* light, const glm::mat4& viewMatrix, const glm::mat4& projMatrix);
+	// Narrows view.projMat to the depth range of the casters in the light's volume.
+	void fitShadowDepth(ShadowView& view);
+	// The camera's view depths that receive shadows.
+	void getShadowDepthRange(const glm::mat4& projMatrix, float& zNear, float& zFar);
+	struct ShadowCache {
+		GO_Light* light = nullptr;					// The light the static layer was drawn for.
+		glm::mat4 viewProjMat = glm::mat4(1.0f);	// The layer's view at the time.
+		bool valid = false;
+		bool hasDynamic = false;					// Whether the shadowMaps layer has dynamic casters in it.
+		bool copied = false;						// Whether the shadowMaps layer is redrawn this frame.
+		bool hasMoments = false;					// Whether the layer's moments are filtered from its depth.
+	};
+	std::vector<ShadowCache> shadowCaches;						// Per layer.
+	// Masks over the render queue's items, and scratch bounds for invalidation.
+	std::vector<uint8_t> staticCasters;
+	std::vector<uint8_t> prevStaticCasters;
+	std::vector<uint8_t> dynamicCasters;
+	std::vector<std::vector<uint8_t>> layerCasters;			// Per layer, the dynamic casters it draws.
+	std::vector<AABB> staticChanges;
+	std::vector<AABB> dynamicBounds;
+	std::vector<uint32_t> casterQuery;						// Scratch for renderQueue.queryFrustum().
+	void updateShadowMaps(Scene* scene, const glm::mat4& viewMatrix, const glm::mat4& projMatrix);
 	void updateShadowMapUniforms(Shader_OpenGL& shader);
 
 
-	GLuint lightsSSBO = 0;
-	size_t lightsSSBONumLights = 0;
 	static constexpr GLuint lightsSSBOBinding = 0;		// Must align with deferred_light.frag
+	RingBuffer_OpenGL lightsSSBO = RingBuffer_OpenGL(GL_SHADER_STORAGE_BUFFER, lightsSSBOBinding);
+	static constexpr GLuint shadowMapsSSBOBinding = 8;		// Must align with forward.frag
+	RingBuffer_OpenGL shadowMapsSSBO = RingBuffer_OpenGL(GL_SHADER_STORAGE_BUFFER, shadowMapsSSBOBinding);
+	// Also writes shadowMapsSSBO, so must come after updateShadowMaps().
 	void updateLightsSSBO(Scene* scene, glm::mat4 viewMatrix);
+	GLint shadowTypes = 0;		// Bit n is set if a light uses GO_Light::ShadowType n (updated with the SSBO).
 
 
 	// The SSBO storing mappings to ranges in lightsIndexSSBO (2 values per cluster, pos and len)
@@ -85,8 +162,8 @@ private:
 	void runTilesCPU(Scene* scene);
 	void runClustersCPU(Scene* scene);
 
-	// Cache light volumes to avoid reallocating memory.
-	std::vector<std::pair<Sphere, float>> lightVolumes;
+	// Keeps scratch buffers between frames for runTilesCPU and runClustersCPU.
+	LightCuller_CPU lightCuller;
 
 
 
@@ -1,4 +1,5 @@
 #include "graphics/pipeline/rp_temp_opengl.h"
+#include "graphics/pipeline/uniforms_opengl.h"
 #include "core/scene.h"
 #include "objects/gameobject.h"
 #include "objects/go_camera.h"
@@ -18,18 +19,18 @@ void RP_Temp_OpenGL::init() {
 static void bindMaterial(Shader_OpenGL& shader, Ref<Material> material) {
 	// TODO: Support binding different types/more complex materials.
 	if (material) {
-		shader.setUniform4f("colorDiffuse", material->getDiffuseColor());
+		shader.setUniform4f(Uniforms::colorDiffuse, material->getDiffuseColor());
 		if (material->getDiffuseTexture()) {
 			GPUTexture* gpuTex = material->getDiffuseTexture()->getGPUTexture();
-			shader.setUniformTex("textureDiffuse",
+			shader.setUniformTex(Uniforms::textureDiffuse,
 				((GPUTexture_OpenGL*)gpuTex)->getGLTexID(),
 				0, GL_TEXTURE_2D
 			);
 		}
 	}
 	else {
-		shader.setUniform4f("colorDiffuse", glm::vec4(1.0f));
-		shader.setUniformTex("textureDiffuse",
+		shader.setUniform4f(Uniforms::colorDiffuse, glm::vec4(1.0f));
+		shader.setUniformTex(Uniforms::textureDiffuse,
 			0, 0, GL_TEXTURE_2D
 		);
 	}
@@ -43,12 +44,12 @@ static void renderSubtree(
 	glm::mat4 mvMat = viewMat * obj->getModelMatrix();
 	// TODO: Get perspective matrix from active camera.
 	glm::mat4 mvpMat = projMat * mvMat;
-	shader.setUniformMat4("mvMat", mvMat);
-	shader.setUniformMat4("normalMat", glm::inverse(glm::transpose(mvMat)));
-	shader.setUniformMat4("mvpMat", mvpMat);
+	shader.setUniformMat4(Uniforms::mvMat, mvMat);
+	shader.setUniformMat4(Uniforms::normalMat, glm::inverse(glm::transpose(mvMat)));
+	shader.setUniformMat4(Uniforms::mvpMat, mvpMat);
 	// TODO: Get camera pos/dir.
-	shader.setUniform3f("cameraPos", glm::vec3(0.0f));
-	shader.setUniform3f("cameraDir", glm::vec3(0.0f, 0.0f, -1.0f));
+	shader.setUniform3f(Uniforms::cameraPos, glm::vec3(0.0f));
+	shader.setUniform3f(Uniforms::cameraDir, glm::vec3(0.0f, 0.0f, -1.0f));
 
 	obj->draw();
 
@@ -63,8 +64,8 @@ void RP_Temp_OpenGL::render(Scene* scene) {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	this->tempShader.bind();
-	this->tempShader.setUniform1f("specularShininess", 6.0f);
-	this->tempShader.setUniform1f("specular", 1.0f);
+	this->tempShader.setUniform1f(Uniforms::specularShininess, 6.0f);
+	this->tempShader.setUniform1f(Uniforms::specular, 1.0f);
 
 	Ref<GO_Camera> activeCamera = scene->getActiveCamera();
 	glm::mat4 viewMatrix;
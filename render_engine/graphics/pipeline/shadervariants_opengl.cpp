@@ -0,0 +1,120 @@
+#include "graphics/pipeline/shadervariants_opengl.h"
+#include "utils/platform.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+
+ShaderVariants_OpenGL::~ShaderVariants_OpenGL() {
+	this->clear();
+}
+
+
+void ShaderVariants_OpenGL::read(std::filesystem::path vertPath, std::filesystem::path fragPath, DefinesFunc defines) {
+	this->clear();
+	this->vertCode = readFile(vertPath, "Vert Shader");
+	this->fragCode = readFile(fragPath, "Frag Shader");
+	this->defines = defines;
+}
+
+Shader_OpenGL& ShaderVariants_OpenGL::get(uint64_t key) {
+	auto it = this->variants.find(key);
+	if (it != this->variants.end()) {
+		return it->second;
+	}
+	std::string defines = this->defines ? this->defines(key) : std::string();
+	Shader_OpenGL& shader = this->variants[key];
+	shader.compile(
+		injectDefines(this->vertCode, defines),
+		injectDefines(this->fragCode, defines)
+	);
+	return shader;
+}
+
+size_t ShaderVariants_OpenGL::getNumVariants() {
+	return this->variants.size();
+}
+
+void ShaderVariants_OpenGL::clear() {
+	for (auto& [key, shader] : this->variants) {
+		shader.clear();
+	}
+	this->variants.clear();
+}
+
+
+std::string ShaderVariants_OpenGL::injectDefines(const std::string& code, const std::string& defines) {
+	if (defines.empty()) {
+		return code;
+	}
+	// #version must come first, and #extension before anything that is not a directive.
+	size_t pos = 0;
+	bool pastVersion = false;
+	while (pos < code.size()) {
+		size_t end = code.find('\n', pos);
+		end = (end == std::string::npos) ? code.size() : end + 1;
+		std::string line = code.substr(pos, end - pos);
+		size_t start = line.find_first_not_of(" \t\r\n");
+		if (start == std::string::npos) {
+			pos = end;
+			continue;
+		}
+		if (line.compare(start, 8, "#version") == 0) {
+			pastVersion = true;
+		}
+		else if (!pastVersion || line.compare(start, 10, "#extension") != 0) {
+			break;
+		}
+		pos = end;
+	}
+	if (!pastVersion) {
+		pos = 0;
+	}
+	std::string result = code.substr(0, pos);
+	if (!result.empty() && result.back() != '\n') {
+		result += '\n';
+	}
+	// Keep compile errors pointing at the lines of the source file.
+	size_t numLines = std::count(result.begin(), result.end(), '\n');
+	return result + defines + "#line " + std::to_string(numLines + 1) + "\n" + code.substr(pos);
+}
+
+
+uint64_t ShaderVariants_OpenGL::getMaterialKey(Material* material) {
+	if (material == nullptr) {
+		return 0;
+	}
+	uint64_t key = 0;
+	if (material->getDiffuseTexture()) key |= DiffuseTex;
+	if (material->getMetalnessTexture()) key |= MetalnessTex;
+	if (material->getRoughnessTexture()) key |= RoughnessTex;
+	if (material->getNormalTexture()) key |= NormalTex;
+	return key;
+}
+
+std::string ShaderVariants_OpenGL::getMaterialDefines(uint64_t key) {
+	std::string defines;
+	if (key & DiffuseTex) defines += "#define HAS_DIFFUSE_TEX\n";
+	if (key & MetalnessTex) defines += "#define HAS_METALNESS_TEX\n";
+	if (key & RoughnessTex) defines += "#define HAS_ROUGHNESS_TEX\n";
+	if (key & NormalTex) defines += "#define HAS_NORMAL_TEX\n";
+	return defines;
+}
+
+
+std::string ShaderVariants_OpenGL::readFile(const std::filesystem::path& path, const std::string& type) {
+	std::stringstream code;
+	std::string line;
+	std::ifstream file;
+
+	file.open(path);
+	if (!file.is_open()) {
+		Utils::Platform::errorMessage(type, "Could not find file");
+	}
+	while (std::getline(file, line)) {
+		code << line << "\n";
+	}
+	file.close();
+	return code.str();
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "graphics/graphics_opengl.h"
+#include "graphics/material.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+
+/*
+* A set of shader programs compiled from the same source files with different #defines,
+* so features that are fixed for a draw (light culling method, shadow methods, which
+* material textures are present) are compiled in instead of branched on per fragment.
+*
+* Each variant is identified by a 64-bit key. The owner packs whatever it needs into
+* the key, and the DefinesFunc given to read() turns a key back into #define lines.
+* A variant is compiled the first time get() asks for its key, and kept until clear().
+*
+* The material bits are shared by every pipeline, so a key's low byte can be filled
+* with getMaterialKey() and expanded with getMaterialDefines().
+*/
+class ShaderVariants_OpenGL {
+public:
+
+	// Returns the #define lines for the variant identified by key.
+	using DefinesFunc = std::string(*)(uint64_t key);
+
+	// Material feature bits, kept in the low byte of a key.
+	enum MaterialKey : uint64_t {
+		DiffuseTex = 1 << 0,
+		MetalnessTex = 1 << 1,
+		RoughnessTex = 1 << 2,
+		NormalTex = 1 << 3,
+		MaterialMask = 0xFF,
+	};
+
+	ShaderVariants_OpenGL() = default;
+	ShaderVariants_OpenGL(const ShaderVariants_OpenGL& other) = delete;
+	ShaderVariants_OpenGL& operator=(const ShaderVariants_OpenGL& other) = delete;
+	~ShaderVariants_OpenGL();
+
+	// Loads the source files. Nothing is compiled until get().
+	void read(std::filesystem::path vertPath, std::filesystem::path fragPath, DefinesFunc defines);
+
+	// Returns the variant for key, compiling it if this is the first use.
+	Shader_OpenGL& get(uint64_t key);
+
+	size_t getNumVariants();
+
+	// Deletes every compiled variant. The sources are kept.
+	void clear();
+
+	// Inserts defines after the #version line (and any #extension lines directly after it).
+	static std::string injectDefines(const std::string& code, const std::string& defines);
+
+	// The MaterialKey bits for material, which may be null.
+	static uint64_t getMaterialKey(Material* material);
+	static std::string getMaterialDefines(uint64_t key);
+
+private:
+
+	std::string vertCode;
+	std::string fragCode;
+	DefinesFunc defines = nullptr;
+
+	std::unordered_map<uint64_t, Shader_OpenGL> variants;
+
+	static std::string readFile(const std::filesystem::path& path, const std::string& type);
+
+};
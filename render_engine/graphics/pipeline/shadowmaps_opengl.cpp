@@ -0,0 +1,216 @@
+#include "graphics/pipeline/shadowmaps_opengl.h"
+#include "graphics/pipeline/uniforms_opengl.h"
+
+#include <algorithm>
+
+
+ShadowMaps_OpenGL::ShadowMaps_OpenGL(GLsizei size) : size(size) {}
+
+ShadowMaps_OpenGL::~ShadowMaps_OpenGL() {
+	this->clear();
+}
+
+
+void ShadowMaps_OpenGL::init() {
+	this->momentsShader.readCompute(
+		"shaders/opengl/shadow_moments.glsl"
+	);
+}
+
+
+bool ShadowMaps_OpenGL::reserve(GLsizei numLayers) {
+	if (numLayers <= this->numLayers) {
+		return false;
+	}
+	// Grow geometrically, since every reallocation throws away the contents.
+	numLayers = std::min(std::max(numLayers, 2 * this->numLayers), getMaxLayers());
+	if (numLayers <= this->numLayers) {
+		return false;
+	}
+
+	GLint prevFBO = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFBO);
+	if (this->fbo == 0) {
+		glGenFramebuffers(1, &this->fbo);
+	}
+	if (this->texID != 0) {
+		glDeleteTextures(1, &this->texID);
+	}
+	glGenTextures(1, &this->texID);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, this->texID);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F,
+		this->size, this->size, numLayers, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	this->numLayers = numLayers;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, this->texID, 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)prevFBO);
+	return true;
+}
+
+
+void ShadowMaps_OpenGL::begin() {
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &this->prevFBO);
+	glGetIntegerv(GL_CULL_FACE_MODE, &this->prevCullFace);
+	glGetIntegerv(GL_VIEWPORT, this->prevViewport);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+	glViewport(0, 0, this->size, this->size);
+	glCullFace(GL_FRONT);
+}
+
+void ShadowMaps_OpenGL::render(GLsizei layer, Shader_OpenGL& shader, RenderQueue_OpenGL& queue,
+	const glm::mat4& viewMat, const glm::mat4& projMat,
+	const std::vector<uint8_t>* itemMask, bool clearFirst) {
+	if (layer < 0 || layer >= this->numLayers) {
+		return;
+	}
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, this->texID, 0, layer);
+	if (clearFirst) {
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
+	shader.bind();
+	queue.draw(shader, viewMat, projMat, nullptr, RenderQueue_OpenGL::Order::State, itemMask);
+}
+
+void ShadowMaps_OpenGL::end() {
+	glViewport(this->prevViewport[0], this->prevViewport[1],
+		(GLsizei)this->prevViewport[2], (GLsizei)this->prevViewport[3]);
+	glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)this->prevFBO);
+	glCullFace((GLenum)this->prevCullFace);
+}
+
+void ShadowMaps_OpenGL::copyLayer(ShadowMaps_OpenGL& src, GLsizei srcLayer, GLsizei dstLayer) {
+	if (srcLayer < 0 || srcLayer >= src.numLayers || dstLayer < 0 || dstLayer >= this->numLayers ||
+		src.size != this->size) {
+		return;
+	}
+	glCopyImageSubData(
+		src.texID, GL_TEXTURE_2D_ARRAY, 0, 0, 0, srcLayer,
+		this->texID, GL_TEXTURE_2D_ARRAY, 0, 0, 0, dstLayer,
+		this->size, this->size, 1
+	);
+}
+
+
+bool ShadowMaps_OpenGL::reserveMoments() {
+	if (this->numMomentsLayers == this->numLayers) {
+		return false;
+	}
+	if (!this->momentsLayerViews.empty()) {
+		glDeleteTextures((GLsizei)this->momentsLayerViews.size(), this->momentsLayerViews.data());
+		this->momentsLayerViews.clear();
+	}
+	if (this->momentsTexID != 0) {
+		glDeleteTextures(1, &this->momentsTexID);
+		this->momentsTexID = 0;
+	}
+	this->numMomentsLayers = this->numLayers;
+	if (this->numLayers == 0) {
+		return true;
+	}
+
+	GLsizei numLevels = 1;
+	while ((this->size >> numLevels) > 0) {
+		numLevels++;
+	}
+	glGenTextures(1, &this->momentsTexID);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, this->momentsTexID);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, numLevels, GL_RGBA32F, this->size, this->size, this->numLayers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	this->momentsLayerViews.resize(this->numLayers);
+	glGenTextures(this->numLayers, this->momentsLayerViews.data());
+	for (GLsizei layer = 0; layer < this->numLayers; layer++) {
+		glTextureView(this->momentsLayerViews[layer], GL_TEXTURE_2D, this->momentsTexID,
+			GL_RGBA32F, 0, numLevels, (GLuint)layer, 1);
+	}
+
+	if (this->blurTexID == 0) {
+		glGenTextures(1, &this->blurTexID);
+		glBindTexture(GL_TEXTURE_2D, this->blurTexID);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, this->size, this->size);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	return true;
+}
+
+void ShadowMaps_OpenGL::filterMoments(GLsizei layer) {
+	if (layer < 0 || layer >= this->numMomentsLayers || this->momentsTexID == 0) {
+		return;
+	}
+	this->momentsShader.bind();
+	this->momentsShader.setUniform1i(Uniforms::shadowLayer, (GLint)layer);
+	this->momentsShader.setUniformTex(Uniforms::shadowMaps, this->texID, 0, GL_TEXTURE_2D_ARRAY);
+	glBindImageTexture(0, this->blurTexID, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+	glBindImageTexture(1, this->momentsTexID, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	GLuint numGroups = (GLuint)(this->size + 7) / 8;
+	for (GLint pass = 0; pass < 2; pass++) {
+		this->momentsShader.setUniform1i(Uniforms::blurPass, pass);
+		glDispatchCompute(numGroups, numGroups, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+	glBindImageTexture(1, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+
+	// Through the layer's view, so only its own chain is downsampled, not the whole array's.
+	glBindTexture(GL_TEXTURE_2D, this->momentsLayerViews[layer]);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+GLuint ShadowMaps_OpenGL::getTexID() {
+	return this->texID;
+}
+GLuint ShadowMaps_OpenGL::getMomentsTexID() {
+	return this->momentsTexID;
+}
+GLsizei ShadowMaps_OpenGL::getSize() {
+	return this->size;
+}
+GLsizei ShadowMaps_OpenGL::getNumLayers() {
+	return this->numLayers;
+}
+GLsizei ShadowMaps_OpenGL::getMaxLayers() {
+	GLint maxLayers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	return (GLsizei)maxLayers;
+}
+
+
+void ShadowMaps_OpenGL::clear() {
+	if (glIsFramebuffer(this->fbo)) {
+		glDeleteFramebuffers(1, &this->fbo);
+	}
+	if (glIsTexture(this->texID)) {
+		glDeleteTextures(1, &this->texID);
+	}
+	if (!this->momentsLayerViews.empty()) {
+		glDeleteTextures((GLsizei)this->momentsLayerViews.size(), this->momentsLayerViews.data());
+		this->momentsLayerViews.clear();
+	}
+	if (glIsTexture(this->momentsTexID)) {
+		glDeleteTextures(1, &this->momentsTexID);
+	}
+	if (glIsTexture(this->blurTexID)) {
+		glDeleteTextures(1, &this->blurTexID);
+	}
+	this->fbo = 0;
+	this->texID = 0;
+	this->numLayers = 0;
+	this->momentsTexID = 0;
+	this->blurTexID = 0;
+	this->numMomentsLayers = 0;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "graphics/graphics_opengl.h"
+#include "graphics/pipeline/renderqueue_opengl.h"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+
+/*
+* Depth maps for every light with shadows, stored as the layers of one GL_TEXTURE_2D_ARRAY.
+*
+* Shaders sample any light's map through a single texture unit, indexed by layer, so the
+* number of shadowed lights is only limited by GL_MAX_ARRAY_TEXTURE_LAYERS. All layers are
+* drawn through one FBO: begin() binds it once, render() attaches and draws each layer,
+* and end() restores the state begin() found.
+*
+* For prefiltered (variance) shadows, filterMoments() turns a layer into exponential variance
+* moments, blurred with a separable compute filter, in a second RGBA32F array with mipmaps.
+* Receivers can then take a single filtered fetch instead of many depth comparisons.
+* The moments array is only allocated once a layer is filtered.
+*/
+class ShadowMaps_OpenGL {
+public:
+
+	ShadowMaps_OpenGL(GLsizei size = 1024);
+	ShadowMaps_OpenGL(const ShadowMaps_OpenGL& other) = delete;
+	ShadowMaps_OpenGL& operator=(const ShadowMaps_OpenGL& other) = delete;
+	~ShadowMaps_OpenGL();
+
+	// Compiles the moments filter. Must be called before filterMoments().
+	void init();
+
+	// Makes sure there are at least numLayers layers (up to getMaxLayers()).
+	// Growing reallocates the array, so every layer must be redrawn afterwards.
+	// Returns true if it did.
+	bool reserve(GLsizei numLayers);
+
+	void begin();
+	// Draws queue into layer with a depth-only shader, seen through projMat * viewMat.
+	// itemMask is passed on to queue.draw(). If clearFirst is false, the layer's depth is
+	// kept and drawn over (e.g. after copyLayer()).
+	void render(GLsizei layer, Shader_OpenGL& shader, RenderQueue_OpenGL& queue,
+		const glm::mat4& viewMat, const glm::mat4& projMat,
+		const std::vector<uint8_t>* itemMask = nullptr, bool clearFirst = true);
+	void end();
+
+	// Copies srcLayer of src (which must be the same size) into dstLayer. Needs no begin().
+	void copyLayer(ShadowMaps_OpenGL& src, GLsizei srcLayer, GLsizei dstLayer);
+
+	// Makes the moments array match the depth array. Returns true if it was (re)allocated,
+	// in which case every layer that is sampled as moments must be filtered again.
+	bool reserveMoments();
+	// Writes the blurred moments of a layer's depth into the moments array, and rebuilds
+	// that layer's mipmaps (outside begin()/end()). Other layers are left untouched.
+	void filterMoments(GLsizei layer);
+
+	GLuint getTexID();
+	GLuint getMomentsTexID();
+	GLsizei getSize();
+	GLsizei getNumLayers();
+	static GLsizei getMaxLayers();
+
+	void clear();
+
+private:
+
+	GLuint fbo = 0;
+	GLuint texID = 0;
+	GLsizei size;
+	GLsizei numLayers = 0;
+
+	Shader_OpenGL momentsShader;
+	GLuint momentsTexID = 0;
+	GLuint blurTexID = 0;			// One layer of moments, between the two blur passes.
+	// A GL_TEXTURE_2D view of each layer of momentsTexID, so its mipmaps can be built alone.
+	std::vector<GLuint> momentsLayerViews;
+	GLsizei numMomentsLayers = 0;
+
+	// State saved by begin().
+	GLint prevFBO = 0;
+	GLint prevCullFace = GL_BACK;
+	GLint prevViewport[4] = { 0, 0, 0, 0 };
+
+};
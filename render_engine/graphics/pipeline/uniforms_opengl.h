@@ -0,0 +1,54 @@
+#pragma once
+#include "graphics/graphics_opengl.h"
+
+
+/*
+* Interned names of the uniforms set by the OpenGL pipelines.
+* Shaders resolve each one to a location once, so setting them per draw is just an array lookup.
+*/
+namespace Uniforms {
+	inline const UniformID blurPass("blurPass");
+	inline const UniformID cameraDir("cameraDir");
+	inline const UniformID cameraPos("cameraPos");
+	inline const UniformID clayColor("clayColor");
+	inline const UniformID claySpecular("claySpecular");
+	inline const UniformID claySpecularShininess("claySpecularShininess");
+	inline const UniformID colorDiffuse("colorDiffuse");
+	inline const UniformID colorMain("colorMain");
+	inline const UniformID copyDepth("copyDepth");
+	inline const UniformID cullingMethod("cullingMethod");
+	inline const UniformID depthTexture("depthTexture");
+	inline const UniformID hiZ("hiZ");
+	inline const UniformID hiZLevels("hiZLevels");
+	inline const UniformID inverseProjection("inverseProjection");
+	inline const UniformID mat("mat");
+	inline const UniformID metalnessFac("metalnessFac");
+	inline const UniformID metalRoughChannels("metalRoughChannels");
+	inline const UniformID mvMat("mvMat");
+	inline const UniformID mvpMat("mvpMat");
+	inline const UniformID normalMat("normalMat");
+	inline const UniformID numBoxes("numBoxes");
+	inline const UniformID numTiles("numTiles");
+	inline const UniformID objectIndex("objectIndex");
+	inline const UniformID roughnessFac("roughnessFac");
+	inline const UniformID shadowLayer("shadowLayer");
+	inline const UniformID shadowMaps("shadowMaps");
+	inline const UniformID shadowMoments("shadowMoments");
+	inline const UniformID specular("specular");
+	inline const UniformID specularShininess("specularShininess");
+	inline const UniformID textureAlbedo("textureAlbedo");
+	inline const UniformID textureDiffuse("textureDiffuse");
+	inline const UniformID textureMain("textureMain");
+	inline const UniformID textureMetalness("textureMetalness");
+	inline const UniformID textureMetalRough("textureMetalRough");
+	inline const UniformID textureNormal("textureNormal");
+	inline const UniformID textureNormals("textureNormals");
+	inline const UniformID texturePos("texturePos");
+	inline const UniformID textureRoughness("textureRoughness");
+	inline const UniformID viewMat("viewMat");
+	inline const UniformID viewNormalMat("viewNormalMat");
+	inline const UniformID viewportSize("viewportSize");
+	inline const UniformID viewProjMat("viewProjMat");
+	inline const UniformID zFar("zFar");
+	inline const UniformID zNear("zNear");
+}
@@ -3,10 +3,16 @@
 
 
 Texture::Texture(TextureID id, RenderEngine* engine) :
-	Datablock(id), thisGraphics(engine->getGraphics()) {}
+	Datablock(id), thisEngine(engine), thisGraphics(engine->getGraphics()) {}
 Texture::~Texture() {
 	if (this->gpuTexture) {
-		delete this->gpuTexture;
+		// Deleted on the render thread, unless Graphics is already gone.
+		if (Graphics* graphics = this->thisEngine->getGraphics()) {
+			graphics->releaseTexture(this->gpuTexture);
+		}
+		else {
+			delete this->gpuTexture;
+		}
 		this->gpuTexture = nullptr;
 	}
 }
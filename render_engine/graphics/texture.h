@@ -1,5 +1,5 @@
 #pragma once
-#include "core/Datablock.h"
+#include "core/datablock.h"
 
 #include <cstdint>
 #include <filesystem>
@@ -45,6 +45,7 @@ public:
 
 private:
 
+	RenderEngine* thisEngine;
 	Graphics* thisGraphics;
 	GPUTexture* gpuTexture = nullptr;
 
@@ -57,7 +57,8 @@ void InputContext::_keyCallback(int key, int scancode, int action, int mods) {
 
 
 bool InputContext::getKeyState(int glfw_keycode) {
-	if (thisEngine->getGraphics()) {
+	// Headless engines have no window to poll.
+	if (thisEngine->getGraphics() && thisEngine->getGraphics()->getWindow()) {
 		return glfwGetKey(thisEngine->getGraphics()->getWindow(), glfw_keycode) == GLFW_PRESS;
 	}
 	return false;
@@ -26,9 +26,6 @@ using json = nlohmann::json;
 #define PI 3.141592653589f
 
 
-RenderEngine engine;
-
-
 class Moving : public Component {
 public:
     glm::vec3 v;
@@ -44,7 +41,7 @@ public:
     }
 
     void evaluate(float deltaTime) override {
-        this->go->deltaPosition(cos(this->phase) * this->v);
+        this->go->deltaPosition(std::cos(this->phase) * this->v);
         constexpr float speed = 0.1f;
         this->phase += speed;
     }
@@ -92,6 +89,7 @@ public:
 
 
 void spawnLights(Scene* scene, size_t num_lights) {
+    RenderEngine& engine = *scene->getEngine();
 
     std::vector<GameObject*> lightSpawns;
 
@@ -165,6 +163,7 @@ void spawnLights(Scene* scene, size_t num_lights) {
 
 
 void setupDemoScene(std::string path, Scene* scene, size_t num_lights, std::string force_shadows, bool pivoting, bool changerad) {
+    RenderEngine& engine = *scene->getEngine();
 
     scene->backgroundColor = 0.1f * glm::vec3(0.5f, 0.6f, 1.0f); //1.3f * glm::vec3(0.5f, 0.6f, 1.0f);
 
@@ -221,6 +220,8 @@ void setupDemoScene(std::string path, Scene* scene, size_t num_lights, std::stri
                     L->shadowType = GO_Light::ShadowType::FilteredPCF;
                 else if (n.length() >= 5 && n.substr(n.length() - 5) == "_pcss")
                     L->shadowType = GO_Light::ShadowType::PCSS;
+                else if (n.length() >= 4 && n.substr(n.length() - 4) == "_vsm")
+                    L->shadowType = GO_Light::ShadowType::VSM;
                 else if (n.length() >= 9 && n.substr(n.length() - 9) == "_raymarch") {
                     L->shadowType = GO_Light::ShadowType::RayMarching;
                     //L->radius *= 0.25f; // not ideal :/
@@ -268,6 +269,11 @@ int main(int argc, char* argv[]) {
     std::filesystem::path render_dir;
     std::filesystem::path campose_file;
     bool interactive = true;
+    bool headless = false;
+    bool multiDrawIndirect = false;
+    bool occlusionCulling = false;
+    bool shaderCache = true;
+    GLint shadowCascades = 4;
 
     srand(1);
 
@@ -365,12 +371,46 @@ int main(int argc, char* argv[]) {
         else if (args[i] == "--changerad") {
             changerad = true;
         }
+        else if (args[i] == "--headless") {
+            headless = true;
+        }
+        else if (args[i] == "--mdi") {
+            multiDrawIndirect = true;
+        }
+        else if (args[i] == "--hiz") {
+            occlusionCulling = true;
+        }
+        else if (args[i] == "--no-shader-cache") {
+            shaderCache = false;
+        }
+        else if (args[i] == "--cascades") {
+            if (++i == args.size())
+                argsError();
+            shadowCascades = (GLint)std::stoi(args[i]);
+        }
         else {
             std::cout << "Unknown argument: " << args[i] << "\n";
             argsError();
         }
     }
 
+    if (headless && interactive) {
+        std::cout << "--headless requires --eval\n";
+        argsError();
+    }
+
+    // Constructed after parsing, since headless changes how the context is created.
+    RenderEngine engine(Graphics::Backend::NONE, headless);
+    if (!engine.getGraphics()) {
+        std::cout << "Failed to initialize graphics\n";
+        return 1;
+    }
+
+    // Before the pipeline is set, since that compiles its shaders.
+    if (!shaderCache) {
+        Shader_OpenGL::setBinaryCacheDir("");
+    }
+
     engine.getGraphics()->setRenderPipeline(pipeline);
     RenderPipeline* gpipeline = engine.getGraphics()->getRenderPipeline();
     if (pipeline_name == "deferred-none")
@@ -428,9 +468,24 @@ int main(int argc, char* argv[]) {
         ((RP_Forward_OpenGL*)gpipeline)->maxLightsPerTile = maxLightsPerTile;
     }
 
+    if (occlusionCulling) {
+        if (pipeline == RenderPipelineType::Forward)
+            ((RP_Forward_OpenGL*)gpipeline)->occlusionCulling = true;
+        else
+            std::cout << "--hiz is only supported by the forward pipelines\n";
+    }
+    if (pipeline == RenderPipelineType::Forward) {
+        ((RP_Forward_OpenGL*)gpipeline)->numShadowCascades = shadowCascades;
+    }
+
     std::cout << "lights: " << num_lights << "\n";
     std::cout << "pipeline: " << pipeline_name << "\n";
 
+    // Must come before the scene is loaded, since only meshes uploaded afterwards use the arena.
+    if (multiDrawIndirect && !((Graphics_OpenGL*)engine.getGraphics())->enableMultiDrawIndirect()) {
+        std::cout << "Multi-draw indirect is not supported, drawing meshes individually\n";
+    }
+
      
     Ref<Scene> scene = engine.createScene();
     setupDemoScene(scene_path, scene.get(), num_lights, force_shadows, pivoting, changerad);
@@ -1,8 +1,14 @@
 #include "objects/gameobject.h"
+#include "core/transformhierarchy.h"
+
+#include <atomic>
 
 
 GameObject::GameObject(GameObjectID id, RenderEngine* engine) : Datablock(id) {}
 GameObject::~GameObject() {
+	if (this->transformHierarchy) {
+		this->transformHierarchy->detach(this);
+	}
 	this->clearComponents();
 }
 
@@ -112,6 +118,7 @@ void GameObject::clearLocalTransform() {
 	this->transform.clear();
 }
 void GameObject::setLocalMatrix(const glm::mat4& mat) {
+	this->setModelMatrixDirty();
 	this->transform.fromMatrix(mat);
 }
 glm::mat4 GameObject::getLocalMatrix() {
@@ -126,18 +133,43 @@ glm::mat4 GameObject::getParentMatrix() {
 }
 
 void GameObject::setModelMatrixDirty() {
-	this->modelMatrixDirty = true;
-	for (Ref<GameObject>& child : this->children) {
-		child->setModelMatrixDirty();
+	this->localVersion++;
+	if (this->transformHierarchy) {
+		this->transformHierarchy->markDirty(this->transformIndex);
 	}
 }
 glm::mat4 GameObject::getModelMatrix() {
-	if (this->modelMatrixDirty) {
-		this->modelMatrix = this->getParentMatrix() * this->getLocalMatrix();
+	uint64_t version;
+	return this->getModelMatrix(version);
+}
+glm::mat4 GameObject::getModelMatrix(uint64_t& version) {
+	if (this->transformHierarchy) {
+		// Only the first call after a change does any work.
+		this->transformHierarchy->update();
+		version = this->transformHierarchy->getWorldVersion(this->transformIndex);
+		return this->transformHierarchy->getWorldMatrix(this->transformIndex);
 	}
+	glm::mat4 parentMatrix(1.0f);
+	uint64_t parentVersion = 0;
+	if (auto p = this->parent.elevate()) {
+		parentMatrix = p->getModelMatrix(parentVersion);
+	}
+	if (this->localVersion != this->modelLocalVersion || parentVersion != this->modelParentVersion) {
+		this->modelMatrix = parentMatrix * this->getLocalMatrix();
+		this->modelLocalVersion = this->localVersion;
+		this->modelParentVersion = parentVersion;
+		this->modelVersion = newModelVersion();
+	}
+	version = this->modelVersion;
 	return this->modelMatrix;
 }
 
+uint64_t GameObject::newModelVersion() {
+	// Atomic, since hierarchies may be updated while worker threads read matrices.
+	static std::atomic<uint64_t> nextVersion{ 1 };
+	return nextVersion++;
+}
+
 
 void GameObject::setParent(Ref<GameObject> parent, bool adjustTransform) {
 	// Guaranteed by the Datablock implementation to be non-null.
@@ -149,7 +181,7 @@ void GameObject::setParent(Ref<GameObject> parent, bool adjustTransform) {
 			return;
 		}
 		auto& pchildren = p->children;
-		pchildren.erase(std::find_if(pchildren.begin(), pchildren.begin(),
+		pchildren.erase(std::find_if(pchildren.begin(), pchildren.end(),
 			[this](Ref<GameObject>& r) { return r.get() == this; }
 		));
 	}
@@ -158,6 +190,12 @@ void GameObject::setParent(Ref<GameObject> parent, bool adjustTransform) {
 		return;
 	}
 
+	// Leaving the old parent's scene, if any. Until the new parent's scene rebuilds its
+	// hierarchy, getModelMatrix() multiplies through the parents instead.
+	if (this->transformHierarchy) {
+		this->transformHierarchy->detach(this);
+	}
+
 	// Do not assign the new parent until after adjusting the transform.
 	// This ensures the correct model matrix is returned from this->getModelMatrix().
 	if (parent) {
@@ -173,6 +211,11 @@ void GameObject::setParent(Ref<GameObject> parent, bool adjustTransform) {
 		this->transform.fromMatrix(this->getModelMatrix());
 	}
 	this->parent = parent.weak();
+	if (parent && parent->transformHierarchy) {
+		parent->transformHierarchy->invalidate();
+	}
+	// The world matrix changes with the parent, or the local transform was adjusted.
+	this->setModelMatrixDirty();
 	// TODO: Cycle detection, at least in some debug mode.
 }
 void GameObject::clearParent(bool adjustTransform) {
@@ -317,3 +360,7 @@ bool GameObject::moveComponentToLast(int index) {
 void GameObject::draw() {
 	// TODO: Perhaps a default axes render for some debug mode?
 }
+
+Mesh* GameObject::getMesh() {
+	return nullptr;
+}
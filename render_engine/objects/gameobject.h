@@ -3,6 +3,7 @@
 #include "core/datablock.h"
 #include "core/transform.h"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -11,6 +12,8 @@ DATABLOCK_ID(GameObject);
 
 class RenderEngine;
 class Scene;
+class Mesh;
+class TransformHierarchy;
 
 
 /*
@@ -75,11 +78,20 @@ public:
 
 	glm::mat4 getParentMatrix();
 
-	// Recursively sets the modelMatrixDirty flag for all children.
+	// Records that the local transform changed. O(1): descendants are not visited, they
+	// notice the change the next time their model matrix is read.
 	virtual void setModelMatrixDirty();
 	// The model matrix is the final matrix used for the display of the object.
 	// Model = Parent * Local
+	// For objects in a scene, this reads the scene's TransformHierarchy, updating it first
+	// if anything changed since the last update.
 	glm::mat4 getModelMatrix();
+	// Also returns the matrix's version, which changes whenever the matrix may have.
+	// Use it to cache anything derived from the model matrix (see GO_Camera).
+	glm::mat4 getModelMatrix(uint64_t& version);
+
+	// A new, never before used version for a model matrix.
+	static uint64_t newModelVersion();
 
 
 	/*
@@ -106,7 +118,7 @@ public:
 	// Returns the added component, or nullptr on failure.
 	template<typename Type, typename... Args>
 	Type* addComponentFirst(Args... args) {
-		this->addComponent(0, args);
+		return this->addComponentIndex<Type>(0, args...);
 	}
 	template<typename Type, typename... Args>
 	Type* addComponent(Args... args) {
@@ -188,6 +200,10 @@ public:
 	*/
 	virtual void draw();
 
+	// The mesh this object draws, if any.
+	// Pipelines that gather draws into a render queue use this instead of draw().
+	virtual Mesh* getMesh();
+
 
 protected:
 
@@ -206,13 +222,26 @@ protected:
 
 	/*
 	* The final model matrix for this object, after the scene graph is fully resolved.
-	* This matrix is cached and only recomputed when necessary; hence the dirty flag.
-	* setModelMatrixDirty() recursively sets the dirty flag of all children too.
-	* Use getModelMatrix() to check the dirty flag and recompute if needed.
+	* This matrix is cached and only recomputed when necessary, which is tracked with
+	* versions instead of dirty flags: localVersion is bumped by setModelMatrixDirty(),
+	* and getModelMatrix() recomputes only if it, or the version of the parent's model
+	* matrix, differs from when modelMatrix was computed. Each recompute takes a new
+	* modelVersion, which is what this object's children compare against in turn.
 	*/
-	bool modelMatrixDirty = true;
+	uint64_t localVersion = 1;
+	uint64_t modelLocalVersion = 0;
+	uint64_t modelParentVersion = 0;
+	uint64_t modelVersion = 0;
 	glm::mat4 modelMatrix = glm::mat4(1.0f);
 
+	/*
+	* While this object is in a scene, its world matrix is kept by the scene's
+	* TransformHierarchy at transformIndex, and modelMatrix above is unused.
+	* Assigned by the hierarchy; null otherwise.
+	*/
+	TransformHierarchy* transformHierarchy = nullptr;
+	uint32_t transformIndex = 0;
+
 
 	WeakRef<GameObject> parent = nullptr;
 	std::vector<Ref<GameObject>> children;
@@ -221,4 +250,6 @@ protected:
 	std::vector<Component*> components;
 
 
+	friend class TransformHierarchy;
+
 };
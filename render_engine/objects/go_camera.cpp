@@ -17,16 +17,13 @@ std::string GO_Camera::getTypeName() {
 	return "Camera";
 }
 
-void GO_Camera::setModelMatrixDirty() {
-	this->viewMatrixDirty = true;
-	GameObject::setModelMatrixDirty();
-}
-
-
 const glm::mat4& GO_Camera::getViewMatrix() {
-	if (this->viewMatrixDirty) {
-		this->viewMatrix = glm::inverse(this->getModelMatrix());
-		this->viewMatrixDirty = false;
+	// The model matrix also changes when an ancestor moves, so compare versions.
+	uint64_t version;
+	glm::mat4 modelMatrix = this->getModelMatrix(version);
+	if (version != this->viewMatrixVersion) {
+		this->viewMatrix = glm::inverse(modelMatrix);
+		this->viewMatrixVersion = version;
 	}
 	return this->viewMatrix;
 }
@@ -12,12 +12,6 @@ public:
 	virtual ~GO_Camera() override = default;
 	virtual std::string getTypeName() override;
 
-	/*
-	* Recursively sets the dirty flag for all children.
-	* We override this so we can also set the dirty flag for the view matrix.
-	*/
-	virtual void setModelMatrixDirty() override;
-
 
 	/*
 	* Camera properties.
@@ -106,6 +100,7 @@ public:
 	glm::mat4 projectionMatrix = glm::mat4(1.0f);
 
 	glm::mat4 viewMatrix = glm::mat4(1.0f);
-	bool viewMatrixDirty = true;
+	// The version of the model matrix viewMatrix was computed from.
+	uint64_t viewMatrixVersion = 0;
 
 };
\ No newline at end of file
@@ -25,6 +25,7 @@ public:
 		PCSS = 4,
 		RayMarching = 5,
 		DisabledClip = 6,	// TEMP; disabled with boundary clipping
+		VSM = 7,			// Exponential variance shadow maps, prefiltered once per map
 	};
 
 	virtual void setScene(Ref<Scene> scene) override;
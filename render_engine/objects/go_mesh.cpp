@@ -15,6 +15,10 @@ void GO_Mesh::draw() {
 	}
 }
 
+Mesh* GO_Mesh::getMesh() {
+	return this->mesh.get();
+}
+
 void GO_Mesh::assignMesh(const Ref<Mesh>& mesh) {
 	this->mesh = mesh;
 }
\ No newline at end of file
@@ -14,6 +14,7 @@ public:
 	virtual std::string getTypeName() override;
 
 	virtual void draw() override;
+	virtual Mesh* getMesh() override;
 
 	void assignMesh(const Ref<Mesh>& mesh);
 
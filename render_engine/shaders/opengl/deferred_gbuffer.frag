@@ -12,15 +12,17 @@ uniform vec4 colorDiffuse;
 
 // The metalness texture/value.
 uniform sampler2D textureMetalness;
-uniform vec2 metalnessFac;		// first: value, second: active (1.0 if use value, 0.0 if use texture)
+uniform float metalnessFac;		// Used without HAS_METALNESS_TEX.
 
 // The roughness texture/value.
 uniform sampler2D textureRoughness;
-uniform vec2 roughnessFac;		// first: value, second: active (1.0 if use value, 0.0 if use texture)
+uniform float roughnessFac;		// Used without HAS_ROUGHNESS_TEX.
 
-// The normal texture/flag.
+// The normal texture.
 uniform sampler2D textureNormal;
-uniform int useNormalTex;
+
+// Which of the material's textures are present is compiled in:
+// HAS_DIFFUSE_TEX, HAS_METALNESS_TEX, HAS_ROUGHNESS_TEX and HAS_NORMAL_TEX.
 
 
 
@@ -43,35 +45,37 @@ in attribs {
 void main() {
 
 	// Sample the diffuse color.
+#ifdef HAS_DIFFUSE_TEX
 	vec3 diffuseColor = mix(
 		texture(textureDiffuse, fs_in.uv).rgb,
 		colorDiffuse.rgb,
 		colorDiffuse.a
 	);
+#else
+	vec3 diffuseColor = colorDiffuse.rgb;
+#endif
 
 	// Sample the metalness.
-	float metalness = mix(
-		texture(textureMetalness, fs_in.uv).r,
-		metalnessFac.r,
-		metalnessFac.g
-	);
+#ifdef HAS_METALNESS_TEX
+	float metalness = texture(textureMetalness, fs_in.uv).r;
+#else
+	float metalness = metalnessFac;
+#endif
 
 	// Sample the roughness.
-	float roughness = mix(
-		texture(textureRoughness, fs_in.uv).r,
-		roughnessFac.r,
-		roughnessFac.g
-	);
+#ifdef HAS_ROUGHNESS_TEX
+	float roughness = texture(textureRoughness, fs_in.uv).r;
+#else
+	float roughness = roughnessFac;
+#endif
 
 	// Sample the normal.
-	vec3 normal;
-	if (useNormalTex == 1) {
-		vec3 normalMap = 2.0 * texture(textureNormal, fs_in.uv).xyz - 1.0;
-		normal = normalize(fs_in.TBN * normalMap);
-	}
-	else {
-		normal = normalize(fs_in.normal);
-	}
+#ifdef HAS_NORMAL_TEX
+	vec3 normalMap = 2.0 * texture(textureNormal, fs_in.uv).xyz - 1.0;
+	vec3 normal = normalize(fs_in.TBN * normalMap);
+#else
+	vec3 normal = normalize(fs_in.normal);
+#endif
 	
 	outPosition = fs_in.position;
 	outNormals = normal;
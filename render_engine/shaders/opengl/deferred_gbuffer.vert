@@ -1,4 +1,5 @@
-#version 330 core
+#version 430 core
+#extension GL_ARB_shader_draw_parameters : enable
 
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
@@ -6,12 +7,33 @@ layout (location = 2) in vec3 tangent;
 layout (location = 3) in vec3 bitangent;
 layout (location = 4) in vec2 uv;
 
-// Model-view matrix.
-uniform mat4 mvMat;
-// Normal matrix, based on model matrix.
-uniform mat4 normalMat;
-// Model-view-projection matrix.
-uniform mat4 mvpMat;
+// Per-object transforms, written once per frame by RenderQueue_OpenGL.
+struct ObjectTransform {
+	mat4 mMat;
+	// Normal matrix in world space, inverse(transpose(mMat)).
+	mat4 normalMat;
+};
+layout(std430, binding = 5) readonly buffer ObjectTransforms {
+	ObjectTransform objects[];
+};
+// Index into objects[] of the first instance being drawn.
+// Only read without ARB_shader_draw_parameters; otherwise each draw's baseInstance is used.
+uniform int objectIndex;
+
+int firstObject() {
+#ifdef GL_ARB_shader_draw_parameters
+	return gl_BaseInstanceARB;
+#else
+	return objectIndex;
+#endif
+}
+
+// View matrix for this pass.
+uniform mat4 viewMat;
+// Normal matrix for this pass's view, inverse(transpose(viewMat)).
+uniform mat4 viewNormalMat;
+// View-projection matrix for this pass.
+uniform mat4 viewProjMat;
 
 // This is the data we're sending to the fragment shader.
 // "attribs" is the name of the data block (must match in frag shader).
@@ -27,6 +49,11 @@ out attribs {
 
 
 void main() {
+	ObjectTransform object = objects[firstObject() + gl_InstanceID];
+	mat4 mMat = object.mMat;
+	mat4 mvMat = viewMat * mMat;
+	mat4 normalMat = viewNormalMat * object.normalMat;
+
 	vs_out.position = (mvMat * vec4(position, 1.0)).xyz;
 	vs_out.normal = normalize((normalMat * vec4(normal, 0.0)).xyz);
 	vs_out.tangent = normalize((normalMat * vec4(tangent, 0.0)).xyz);
@@ -39,5 +66,5 @@ void main() {
 	vec3 N = normalize(vec3(normalMat * vec4(normal, 0.0)));
 	vs_out.TBN = mat3(T, B, N);
 
-	gl_Position = mvpMat * vec4(position, 1.0);
+	gl_Position = viewProjMat * (mMat * vec4(position, 1.0));
 }
\ No newline at end of file
@@ -38,12 +38,16 @@ struct Light {
 };
 
 
-// First elem is culling method, second is meta
+// The culling method is compiled in as CULLING_METHOD (see ShaderVariants_OpenGL):
 // None=0
 // BoundingSphere=1
-// RasterSphere=2 [meta is light index]
+// RasterSphere=2
 // Tiled=3
-// Clustered=4
+// Clustered=4 (CPU) or 6 (GPU)
+#ifndef CULLING_METHOD
+#define CULLING_METHOD 0
+#endif
+// First elem is unused, second is meta (for RasterSphere, the light index).
 uniform ivec2 cullingMethod;
 
 
@@ -257,7 +261,8 @@ void main() {
 
 	vec4 color = vec4(0.0, 0.0, 0.0, 1.0);
 
-	if (cullingMethod.x == 0) {
+#if CULLING_METHOD == 0
+	{
 		// None
 		for (int i = 0; i < numLights.x; i++) {
 			color += vec4(processLight(
@@ -270,7 +275,8 @@ void main() {
 			), 0.0);
 		}
 	}
-	else if (cullingMethod.x == 1) {
+#elif CULLING_METHOD == 1
+	{
 		// BoundingSphere
 		for (int i = 0; i < numLights.x; i++) {
 			Light l = getLightData(i);
@@ -290,7 +296,8 @@ void main() {
 			), 0.0);
 		}
 	}
-	else if (cullingMethod.x == 2) {
+#elif CULLING_METHOD == 2
+	{
 		// RasterSphere
 		int lightIdx = cullingMethod.y;
 		color += vec4(processLight(
@@ -302,9 +309,10 @@ void main() {
 			normal
 		), 0.0);
 	}
-	else if (cullingMethod.x == 3) {
+#elif CULLING_METHOD == 3
+	{
 		// Tiled
-		ivec2 tileCoord = ivec2(floor(uv * numTiles.xy));
+		ivec2 tileCoord = ivec2(floor(gl_FragCoord.xy / viewportSize * numTiles.xy));
 		int startIdx = tileLightMapping[2 * (tileCoord.y * int(numTiles.x) + tileCoord.x)];
 		int numIdxs =  tileLightMapping[2 * (tileCoord.y * int(numTiles.x) + tileCoord.x) + 1];
 		for (int i = 0; i < numIdxs; i++) {
@@ -320,8 +328,9 @@ void main() {
 			), 0.0);
 		}
 	}
-	else if (cullingMethod.x == 6) {
-		// Clustered
+#elif CULLING_METHOD == 4 || CULLING_METHOD == 6
+	{
+		// Clustered (CPU or GPU)
 		float scale = numTiles.z / log2(zFar / zNear);
 		float bias = -(numTiles.z * log2(zNear) / log2(zFar / zNear));
 		uint zTile     = uint(max(log2(-position.z) * scale + bias, 0.0));
@@ -345,9 +354,9 @@ void main() {
 			), 0.0);
 		}
 	}
-	else {
-		color += vec4(1.0, 0.0, 1.0, 0.0);
-	}
+#else
+	color += vec4(1.0, 0.0, 1.0, 0.0);
+#endif
 	
 	outColor = color;
 
@@ -1,6 +1,5 @@
 #version 430 core
 
-#define MAX_SHADOW_MAPS 16 // Must sync with forward.vert and rp_forward_opengl.cpp.
 #define SHADOW_BIAS 0.003 // 0.01 for 256 map size; 0.001 for 2048 map size
 #define SHADOW_OOB_LIT false
 #define RAYCAST_STEPS 64 // 64 for "high quality"
@@ -8,6 +7,16 @@
 #define DETERMINISTIC_SAMPLES false
 #define PCSS_NUM_SAMPLES_BASE 6
 #define PCSS_NUM_SAMPLES (PCSS_NUM_SAMPLES_BASE * PCSS_NUM_SAMPLES_BASE)
+// Must match shadow_moments.glsl.
+#define EVSM_EXPONENTS vec2(40.0, 5.0)
+#define EVSM_MIN_VARIANCE 0.0001
+#define EVSM_LIGHT_BLEEDING 0.3
+
+// Bit n is set if any light uses GO_Light::ShadowType n; the others are compiled out.
+#ifndef SHADOW_TYPES
+#define SHADOW_TYPES 254
+#endif
+#define HAS_SHADOW_TYPE(t) ((SHADOW_TYPES & (1 << (t))) != 0)
 
 layout (location = 0) out vec4 outColor;
 
@@ -19,15 +28,17 @@ uniform vec4 colorDiffuse;
 
 // The metalness texture/value.
 uniform sampler2D textureMetalness;
-uniform vec2 metalnessFac;		// first: value, second: active (1.0 if use value, 0.0 if use texture)
+uniform float metalnessFac;		// Used without HAS_METALNESS_TEX.
 
 // The roughness texture/value.
 uniform sampler2D textureRoughness;
-uniform vec2 roughnessFac;		// first: value, second: active (1.0 if use value, 0.0 if use texture)
+uniform float roughnessFac;		// Used without HAS_ROUGHNESS_TEX.
 
-// The normal texture/flag.
+// The normal texture.
 uniform sampler2D textureNormal;
-uniform int useNormalTex;
+
+// Which of the material's textures are present is compiled in:
+// HAS_DIFFUSE_TEX, HAS_METALNESS_TEX, HAS_ROUGHNESS_TEX and HAS_NORMAL_TEX.
 
 // Which channels the metalness/roughness textures should use
 // (in case they're in a shared texture.)
@@ -41,10 +52,29 @@ uniform float zNear;
 uniform float zFar;
 
 
-// Shadow Maps
-uniform sampler2D shadowMaps[MAX_SHADOW_MAPS];
-// Shadow map bounds (scales)
-uniform vec3 shadowScales[MAX_SHADOW_MAPS];
+// Shadow maps, one layer per light with shadows, or one per cascade for directional lights.
+// Lights store their (first) layer in typeShadowIndexRadius.z.
+uniform sampler2DArray shadowMaps;
+// Blurred, mipmapped EVSM moments of the same layers, for lights with variance shadows.
+uniform sampler2DArray shadowMoments;
+
+// Per shadow map data, indexed the same as the layers of shadowMaps.
+struct ShadowMap {
+	// View space to the shadow map's clip space.
+	mat4 viewToShadow;
+	// Half extents of the shadow map's volume, in world space.
+	vec4 scale;					// vec3
+	// View depth this cascade ends at (0 if not cascaded) (x),
+	// and the number of cascades starting at this map (y).
+	vec4 cascade;				// vec2
+	// Maps depth in viewToShadow's volume to the map's (fitted) depth: depth * x + y.
+	vec4 depthFit;				// vec2
+};
+// Binding must align with rp_forward_opengl.h
+layout(std430, binding = 8) readonly buffer shadowMapsSSBO
+{
+	ShadowMap shadowMapData[];
+};
 
 
 
@@ -70,12 +100,16 @@ struct Light {
 };
 
 
-// First elem is culling method, second is meta
+// The culling method is compiled in as CULLING_METHOD (see ShaderVariants_OpenGL):
 // None=0
 // BoundingSphere=1
-// RasterSphere=2 [meta is light index]
+// RasterSphere=2
 // Tiled=3
-// Clustered=4
+// Clustered=4 (CPU) or 6 (GPU)
+#ifndef CULLING_METHOD
+#define CULLING_METHOD 0
+#endif
+// First elem is unused, second is meta (for RasterSphere, the light index).
 uniform ivec2 cullingMethod;
 
 
@@ -91,7 +125,6 @@ in attribs {
 	vec3 position;
 	vec2 uv;
 	mat3 TBN;
-	vec4 shadowMapCoords[MAX_SHADOW_MAPS];
 } fs_in;
 
 
@@ -159,12 +192,14 @@ vec2 rand2(vec2 uv, float seed) {
 ///////////////////////////////////
 
 float sampleShadow(int idx, vec2 uv, float depth, vec3 normal, vec3 dirToLight) {
-	float shadowZ = texture(shadowMaps[idx], uv).r;
+	float shadowZ = texture(shadowMaps, vec3(uv, idx)).r;
 	shadowZ += SHADOW_BIAS / (dot(normal, dirToLight) + 0.1);
 	return (depth > shadowZ) ? 0.0 : 1.0;
 }
 
 vec2 PCSS_SAMPLES[PCSS_NUM_SAMPLES];
+// The samples only depend on the fragment, so every light shares one set.
+bool PCSS_SAMPLES_READY = false;
 void PCSS_GenSamples();
 float PCSS_PenumbraSize(float zReceiver, float zBlocker);
 vec2 PCSS_FindBlocker(float radius, int idx, vec2 uv, float zReceiver);
@@ -180,7 +215,7 @@ float computeShadowBasic(int idx, vec3 UVZ, float r, vec3 n, vec3 d) {
 float computeShadowPCF(int idx, vec3 UVZ, float r, vec3 n, vec3 d) {
 	int rad = 1;
 
-	vec2 texelStep = 1.0 / vec2(textureSize(shadowMaps[idx], 0).xy);
+	vec2 texelStep = 1.0 / vec2(textureSize(shadowMaps, 0).xy);
 	float total = 0.0;
 	for (int x = -rad; x <= rad; x++) {
 		for (int y = -rad; y <= rad; y++) {
@@ -193,7 +228,7 @@ float computeShadowPCF(int idx, vec3 UVZ, float r, vec3 n, vec3 d) {
 
 
 float computeShadowFilteredPCF(int idx, vec3 UVZ, float r, vec3 n, vec3 d) {
-	float radius = 0.01 / length(shadowScales[idx]);
+	float radius = 0.01 / length(shadowMapData[idx].scale.xyz);
 	PCSS_GenSamples();
 	float total = 0.0;
 	for (int i = 0; i < PCSS_NUM_SAMPLES; i++) {
@@ -209,7 +244,7 @@ float computeShadowPCSS(int idx, vec3 UVZ, float r, vec3 n, vec3 d) {
 	// Convert radians to the depth map's texture space (assumes uniform light scale)
 	// Multiply this by a depth value to get a lateral displacement
 	// TODO: Find a better method than manually scaling to match the other methods :/
-	r = tan(0.5 * r) / length(shadowScales[idx]);
+	r = tan(0.5 * r) / length(shadowMapData[idx].scale.xyz);
 
 	// STEP 1: blocker search
 	vec2 ret = PCSS_FindBlocker(r * UVZ.z, idx, UVZ.xy, UVZ.z);
@@ -227,6 +262,49 @@ float computeShadowPCSS(int idx, vec3 UVZ, float r, vec3 n, vec3 d) {
 
 
 
+// Upper bound on the fraction of the filter region that is lit at depth t (Chebyshev's inequality).
+float chebyshevUpperBound(vec2 moments, float t, float minVariance) {
+	if (t <= moments.x)
+		return 1.0;
+	float variance = max(moments.y - moments.x * moments.x, minVariance);
+	float d = t - moments.x;
+	float pMax = variance / (variance + d * d);
+	// Cut off the tail, which is where light bleeding comes from.
+	return clamp((pMax - EVSM_LIGHT_BLEEDING) / (1.0 - EVSM_LIGHT_BLEEDING), 0.0, 1.0);
+}
+
+// Screen-space derivatives of fs_in.position, taken at the top of main() while control
+// flow is still uniform. Implicit derivatives are undefined inside the per-light branches.
+vec3 positionDdx;
+vec3 positionDdy;
+
+// The derivative of a view-space position's shadow map UV, along view-space offset dp.
+vec2 shadowUVDerivative(int idx, vec4 c, vec3 dp) {
+	vec4 dc = shadowMapData[idx].viewToShadow * vec4(dp, 0.0);
+	return 0.5 * (dc.xy * c.w - c.xy * dc.w) / (c.w * c.w);
+}
+
+float computeShadowVSM(int idx, vec3 UVZ, float r, vec3 n, vec3 d) {
+	// One trilinear fetch of the prefiltered moments, with the gradients carried through
+	// this layer's projection from the ones taken in uniform control flow.
+	vec4 c = shadowMapData[idx].viewToShadow * vec4(fs_in.position, 1.0);
+	vec2 gradX = shadowUVDerivative(idx, c, positionDdx);
+	vec2 gradY = shadowUVDerivative(idx, c, positionDdy);
+	vec4 moments = textureGrad(shadowMoments, vec3(UVZ.xy, idx), gradX, gradY);
+	float depth = UVZ.z - SHADOW_BIAS / (dot(n, d) + 0.1);
+	float x = 2.0 * depth - 1.0;
+	float pos = exp(EVSM_EXPONENTS.x * x);
+	float neg = -exp(-EVSM_EXPONENTS.y * x);
+	// Scale the minimum variance into each warped space.
+	vec2 minVariance = EVSM_MIN_VARIANCE * EVSM_EXPONENTS * EVSM_EXPONENTS * vec2(pos * pos, neg * neg);
+	return min(
+		chebyshevUpperBound(moments.xy, pos, minVariance.x),
+		chebyshevUpperBound(moments.zw, neg, minVariance.y)
+	);
+}
+
+
+
 float ParallaxRaycast(int idx, vec3 source, vec3 outDir);
 
 float computeShadowRayMarching(int idx, vec3 UVZ, float r, vec3 n, vec3 d) {
@@ -266,7 +344,7 @@ float ParallaxRaycast(int idx, vec3 source, vec3 outDir)
 		p += outDir;
 		if (p.z <= 0.0)
 			return 1.0;
-		float shadowZ = texture(shadowMaps[idx], p.xy).r;
+		float shadowZ = texture(shadowMaps, vec3(p.xy, idx)).r;
 		if (p.z > shadowZ && p.z - shadowZ < RAYCAST_SURFACE_THICKNESS)
 			return 0.0;
 	}
@@ -302,6 +380,10 @@ vec2 poissonDisk[16] = {
 
 
 void PCSS_GenSamples() {
+	if (PCSS_SAMPLES_READY) {
+		return;
+	}
+	PCSS_SAMPLES_READY = true;
 	int n = 0;
 	for (int i = 0; i < PCSS_NUM_SAMPLES_BASE; i++) {
 		for (int j = 0; j < PCSS_NUM_SAMPLES_BASE; j++) {
@@ -322,7 +404,7 @@ vec2 PCSS_FindBlocker(float radius, int idx, vec2 uv, float zReceiver) {
 
 	for( int i = 0; i < PCSS_NUM_SAMPLES; ++i ) {	// num samples
 		// Don't use shadow sampling helper because this isn't for a shadow (we don't want bias)
-		float shadowMapDepth = texture(shadowMaps[idx], uv + PCSS_SAMPLES[i] * radius).r;
+		float shadowMapDepth = texture(shadowMaps, vec3(uv + PCSS_SAMPLES[i] * radius, idx)).r;
 		if (shadowMapDepth < zReceiver) {
 			blockerSum += shadowMapDepth;
 			numBlockers++;
@@ -480,38 +562,73 @@ vec3 processLight(
 	}
 
 	float shadowFac = 1.0;
+#if SHADOW_TYPES != 0
 	float shadowType = round(light.typeShadowIndexRadius.y);
-	if (shadowType != 0.0) {
-		int shadowIdx = int(round(light.typeShadowIndexRadius.z));
+	int shadowIdx = int(round(light.typeShadowIndexRadius.z));
+	if (shadowType != 0.0 && shadowIdx >= 0) {
+		// Use the first cascade that reaches past the fragment.
+		int lastCascade = shadowIdx + int(round(shadowMapData[shadowIdx].cascade.y)) - 1;
+		while (shadowIdx < lastCascade && -position.z > shadowMapData[shadowIdx].cascade.x) {
+			shadowIdx++;
+		}
+		if (shadowMapData[shadowIdx].cascade.x > 0.0 && -position.z > shadowMapData[shadowIdx].cascade.x) {
+			// Past the last cascade.
+			shadowType = 0.0;
+		}
+	}
+	if (shadowType != 0.0 && shadowIdx >= 0) {
 		float radius = light.typeShadowIndexRadius.w;
-		vec4 c = fs_in.shadowMapCoords[shadowIdx];
+		vec4 c = shadowMapData[shadowIdx].viewToShadow * vec4(position, 1.0);
 		vec3 UVZ = (c.xyz / c.w) * 0.5 + 0.5;
-		if (UVZ.x < 0.0 || UVZ.x > 1.0 ||
+		bool outside = UVZ.x < 0.0 || UVZ.x > 1.0 ||
 			UVZ.y < 0.0 || UVZ.y > 1.0 ||
-			UVZ.z < 0.0 || UVZ.z > 1.0) {
+			UVZ.z < 0.0 || UVZ.z > 1.0;
+		// The map only covers the depth of its casters. Receivers in front of all of them
+		// clamp to 0 (lit), and receivers behind all of them to 1 (shadowed where covered).
+		vec2 depthFit = shadowMapData[shadowIdx].depthFit.xy;
+		UVZ.z = clamp(UVZ.z * depthFit.x + depthFit.y, 0.0, 1.0);
+		if (outside) {
 			/* Outside the shadow map */
 			shadowFac = SHADOW_OOB_LIT ? 1.0 : 0.0;
 			return vec3(0.0);
 		}
+#if HAS_SHADOW_TYPE(1)
 		else if (shadowType == 1.0) {	// Basic
 			shadowFac = computeShadowBasic(shadowIdx, UVZ, radius, normal, dirToLight);
 		}
+#endif
+#if HAS_SHADOW_TYPE(2)
 		else if (shadowType == 2.0) {	// PCF
 			shadowFac = computeShadowPCF(shadowIdx, UVZ, radius, normal, dirToLight);
 		}
+#endif
+#if HAS_SHADOW_TYPE(3)
 		else if (shadowType == 3.0) {	// FilteredPCF
 			shadowFac = computeShadowFilteredPCF(shadowIdx, UVZ, radius, normal, dirToLight);
 		}
+#endif
+#if HAS_SHADOW_TYPE(4)
 		else if (shadowType == 4.0) {	// PCSS
 			shadowFac = computeShadowPCSS(shadowIdx, UVZ, radius, normal, dirToLight);
 		}
+#endif
+#if HAS_SHADOW_TYPE(5)
 		else if (shadowType == 5.0) {	// Ray Marching
 			shadowFac = computeShadowRayMarching(shadowIdx, UVZ, radius, normal, dirToLight);
 		}
+#endif
+#if HAS_SHADOW_TYPE(6)
 		else if (shadowType == 6.0) {	// DisabledClip
 			shadowFac = 1.0;
 		}
+#endif
+#if HAS_SHADOW_TYPE(7)
+		else if (shadowType == 7.0) {	// VSM
+			shadowFac = computeShadowVSM(shadowIdx, UVZ, radius, normal, dirToLight);
+		}
+#endif
 	}
+#endif
 
 	// Optimization only works when nearby pixels are also fully in shadow
 	// (otherwise instructions after the branch are still run.)
@@ -580,39 +697,44 @@ vec4 getBoundingSphere(Light light) {
 
 void main() {
 
+	positionDdx = dFdx(fs_in.position);
+	positionDdy = dFdy(fs_in.position);
+
 	// MATERIALS
 
 	// Sample the diffuse color.
+#ifdef HAS_DIFFUSE_TEX
 	vec3 albedo = mix(
 		texture(textureDiffuse, fs_in.uv).rgb,
 		colorDiffuse.rgb,
 		colorDiffuse.a
 	);
+#else
+	vec3 albedo = colorDiffuse.rgb;
+#endif
 	albedo = pow(albedo, vec3(2.2));
 
 	// Sample the metalness.
-	float metalness = mix(
-		texture(textureMetalness, fs_in.uv)[metalRoughChannels.x],
-		metalnessFac.r,
-		metalnessFac.g
-	);
+#ifdef HAS_METALNESS_TEX
+	float metalness = texture(textureMetalness, fs_in.uv)[metalRoughChannels.x];
+#else
+	float metalness = metalnessFac;
+#endif
 
 	// Sample the roughness.
-	float roughness = mix(
-		texture(textureRoughness, fs_in.uv)[metalRoughChannels.y],	// TODO: Don't know why it's inverted :/
-		roughnessFac.r,
-		roughnessFac.g
-	);
+#ifdef HAS_ROUGHNESS_TEX
+	float roughness = texture(textureRoughness, fs_in.uv)[metalRoughChannels.y];	// TODO: Don't know why it's inverted :/
+#else
+	float roughness = roughnessFac;
+#endif
 
 	// Sample the normal.
-	vec3 normal;
-	if (useNormalTex == 1) {
-		vec3 normalMap = 2.0 * texture(textureNormal, fs_in.uv).xyz - 1.0;
-		normal = normalize(fs_in.TBN * normalMap);
-	}
-	else {
-		normal = normalize(fs_in.TBN[2]);		// TBN[2] == normal
-	}
+#ifdef HAS_NORMAL_TEX
+	vec3 normalMap = 2.0 * texture(textureNormal, fs_in.uv).xyz - 1.0;
+	vec3 normal = normalize(fs_in.TBN * normalMap);
+#else
+	vec3 normal = normalize(fs_in.TBN[2]);		// TBN[2] == normal
+#endif
 
 	
 	// LIGHTING
@@ -620,7 +742,8 @@ void main() {
 
 	vec4 color = vec4(0.0, 0.0, 0.0, 1.0);
 
-	if (cullingMethod.x == 0) {
+#if CULLING_METHOD == 0
+	{
 		// None
 		for (int i = 0; i < numLights.x; i++) {
 			color += vec4(processLight(
@@ -633,7 +756,8 @@ void main() {
 			), 0.0);
 		}
 	}
-	else if (cullingMethod.x == 1) {
+#elif CULLING_METHOD == 1
+	{
 		// BoundingSphere
 		for (int i = 0; i < numLights.x; i++) {
 			Light l = getLightData(i);
@@ -653,7 +777,8 @@ void main() {
 			), 0.0);
 		}
 	}
-	else if (cullingMethod.x == 2) {
+#elif CULLING_METHOD == 2
+	{
 		// RasterSphere
 		int lightIdx = cullingMethod.y;
 		color += vec4(processLight(
@@ -665,9 +790,10 @@ void main() {
 			normal
 		), 0.0);
 	}
-	else if (cullingMethod.x == 3) {
+#elif CULLING_METHOD == 3
+	{
 		// Tiled
-		ivec2 tileCoord = ivec2(floor(fs_in.uv * numTiles.xy));
+		ivec2 tileCoord = ivec2(floor(gl_FragCoord.xy / viewportSize * numTiles.xy));
 		int startIdx = tileLightMapping[2 * (tileCoord.y * int(numTiles.x) + tileCoord.x)];
 		int numIdxs =  tileLightMapping[2 * (tileCoord.y * int(numTiles.x) + tileCoord.x) + 1];
 		for (int i = 0; i < numIdxs; i++) {
@@ -685,8 +811,9 @@ void main() {
 				color += 0.01 * vec4(light.color.rgb, 0.0);
 		}
 	}
-	else if (cullingMethod.x == 6) {
-		// Clustered
+#elif CULLING_METHOD == 4 || CULLING_METHOD == 6
+	{
+		// Clustered (CPU or GPU)
 		float scale = numTiles.z / log2(zFar / zNear);
 		float bias = -(numTiles.z * log2(zNear) / log2(zFar / zNear));
 		uint zTile     = uint(max(log2(-fs_in.position.z) * scale + bias, 0.0));
@@ -710,9 +837,9 @@ void main() {
 			), 0.0);
 		}
 	}
-	else {
-		color += vec4(1.0, 0.0, 1.0, 0.0);
-	}
+#else
+	color += vec4(1.0, 0.0, 1.0, 0.0);
+#endif
 	
 	outColor = color;
 
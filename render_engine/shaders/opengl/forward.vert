@@ -1,6 +1,5 @@
 #version 430 core
-
-#define MAX_SHADOW_MAPS 16
+#extension GL_ARB_shader_draw_parameters : enable
 
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
@@ -8,17 +7,33 @@ layout (location = 2) in vec3 tangent;
 layout (location = 3) in vec3 bitangent;
 layout (location = 4) in vec2 uv;
 
-// Model matrix.
-uniform mat4 mMat;
-// Model-view matrix.
-uniform mat4 mvMat;
-// Normal matrix, based on model matrix.
-uniform mat4 normalMat;
-// Model-view-projection matrix.
-uniform mat4 mvpMat;
+// Per-object transforms, written once per frame by RenderQueue_OpenGL.
+struct ObjectTransform {
+	mat4 mMat;
+	// Normal matrix in world space, inverse(transpose(mMat)).
+	mat4 normalMat;
+};
+layout(std430, binding = 5) readonly buffer ObjectTransforms {
+	ObjectTransform objects[];
+};
+// Index into objects[] of the first instance being drawn.
+// Only read without ARB_shader_draw_parameters; otherwise each draw's baseInstance is used.
+uniform int objectIndex;
+
+int firstObject() {
+#ifdef GL_ARB_shader_draw_parameters
+	return gl_BaseInstanceARB;
+#else
+	return objectIndex;
+#endif
+}
 
-// Shadow map matrices (world-to-shadow, including projection)
-uniform mat4 shadowMapMats[MAX_SHADOW_MAPS];
+// View matrix for this pass.
+uniform mat4 viewMat;
+// Normal matrix for this pass's view, inverse(transpose(viewMat)).
+uniform mat4 viewNormalMat;
+// View-projection matrix for this pass.
+uniform mat4 viewProjMat;
 
 // This is the data we're sending to the fragment shader.
 // "attribs" is the name of the data block (must match in frag shader).
@@ -27,11 +42,15 @@ out attribs {
 	vec3 position;
 	vec2 uv;
 	mat3 TBN;
-	vec4 shadowMapCoords[MAX_SHADOW_MAPS];
 } vs_out;
 
 
 void main() {
+	ObjectTransform object = objects[firstObject() + gl_InstanceID];
+	mat4 mMat = object.mMat;
+	mat4 mvMat = viewMat * mMat;
+	mat4 normalMat = viewNormalMat * object.normalMat;
+
 	vs_out.position = (mvMat * vec4(position, 1.0)).xyz;
 	vs_out.uv = uv;
 
@@ -41,10 +60,5 @@ void main() {
 	vec3 N = normalize(vec3(normalMat * vec4(normal, 0.0)));
 	vs_out.TBN = mat3(T, B, N);
 
-	// Transform point to shadow map spaces.
-	for (int i = 0; i < MAX_SHADOW_MAPS; i++) {
-		vs_out.shadowMapCoords[i] = shadowMapMats[i] * mMat * vec4(position, 1.0);
-	}
-
-	gl_Position = mvpMat * vec4(position, 1.0);
+	gl_Position = viewProjMat * (mMat * vec4(position, 1.0));
 }
\ No newline at end of file
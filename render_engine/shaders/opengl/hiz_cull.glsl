@@ -0,0 +1,71 @@
+#version 430 core
+layout(local_size_x = 64) in;
+
+// World-space bounds to test, as written by HiZ_OpenGL::cull().
+struct Box {
+	vec4 minPoint;
+	vec4 maxPoint;
+};
+layout(std430, binding = 6) readonly buffer HiZBoxes {
+	Box boxes[];
+};
+// 1 if the box may be visible, 0 if it is certainly hidden behind the depth in hiZ.
+layout(std430, binding = 7) writeonly buffer HiZVisibility {
+	uint visibility[];
+};
+
+uniform int numBoxes;
+uniform mat4 viewProjMat;
+// The pyramid from hiz_downsample.glsl; each texel is the farthest depth it covers.
+uniform sampler2D hiZ;
+uniform int hiZLevels;
+
+
+void main() {
+	int i = int(gl_GlobalInvocationID.x);
+	if (i >= numBoxes) {
+		return;
+	}
+	Box box = boxes[i];
+	if (any(greaterThan(box.minPoint.xyz, box.maxPoint.xyz))) {
+		visibility[i] = 1;
+		return;
+	}
+
+	// Screen rectangle and nearest depth of the box, from its 8 corners.
+	vec3 ndcMin = vec3(1.0);
+	vec3 ndcMax = vec3(-1.0);
+	for (int c = 0; c < 8; c++) {
+		vec3 corner = mix(box.minPoint.xyz, box.maxPoint.xyz, vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1));
+		vec4 clip = viewProjMat * vec4(corner, 1.0);
+		if (clip.w <= 0.0) {
+			// Crosses the camera plane, so the projection is unbounded. Assume visible.
+			visibility[i] = 1;
+			return;
+		}
+		vec3 ndc = clip.xyz / clip.w;
+		ndcMin = min(ndcMin, ndc);
+		ndcMax = max(ndcMax, ndc);
+	}
+	float nearest = ndcMin.z * 0.5 + 0.5;
+
+	// Level 0 texels covered, then the level at which that is at most 2x2 texels.
+	ivec2 size0 = textureSize(hiZ, 0);
+	ivec2 p0 = clamp(ivec2(floor((ndcMin.xy * 0.5 + 0.5) * vec2(size0))), ivec2(0), size0 - 1);
+	ivec2 p1 = clamp(ivec2(floor((ndcMax.xy * 0.5 + 0.5) * vec2(size0))), ivec2(0), size0 - 1);
+	int span = max(p1.x - p0.x, p1.y - p0.y) + 1;
+	int level = min(int(ceil(log2(float(span)))), hiZLevels - 1);
+
+	// Texel s of a level lands in texel min(s / 2, size - 1) of the next (see hiz_downsample.glsl).
+	ivec2 levelSize = textureSize(hiZ, level);
+	ivec2 t0 = min(p0 >> level, levelSize - 1);
+	ivec2 t1 = min(p1 >> level, levelSize - 1);
+	float farthest = 0.0;
+	for (int y = t0.y; y <= t1.y; y++) {
+		for (int x = t0.x; x <= t1.x; x++) {
+			farthest = max(farthest, texelFetch(hiZ, ivec2(x, y), level).r);
+		}
+	}
+
+	visibility[i] = (nearest <= farthest) ? 1 : 0;
+}
@@ -0,0 +1,43 @@
+#version 430 core
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// Builds one level of the Hi-Z pyramid, where each texel is the farthest depth it covers.
+// With copyDepth set, level 0 is copied from depthTexture; otherwise srcLevel is reduced 2x2.
+uniform int copyDepth;
+uniform sampler2D depthTexture;
+layout(r32f, binding = 0) uniform readonly image2D srcLevel;
+layout(r32f, binding = 1) uniform writeonly image2D dstLevel;
+
+
+void main() {
+	ivec2 dst = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 dstSize = imageSize(dstLevel);
+	if (dst.x >= dstSize.x || dst.y >= dstSize.y) {
+		return;
+	}
+
+	if (copyDepth != 0) {
+		imageStore(dstLevel, dst, vec4(texelFetch(depthTexture, dst, 0).r));
+		return;
+	}
+
+	// The last row/column also covers the extra source texel when the source size is odd,
+	// so every source texel is covered by exactly one destination texel.
+	ivec2 srcSize = imageSize(srcLevel);
+	ivec2 srcMin = dst * 2;
+	ivec2 srcMax = min(srcMin + 1, srcSize - 1);
+	if (dst.x == dstSize.x - 1) {
+		srcMax.x = srcSize.x - 1;
+	}
+	if (dst.y == dstSize.y - 1) {
+		srcMax.y = srcSize.y - 1;
+	}
+
+	float farthest = 0.0;
+	for (int y = srcMin.y; y <= srcMax.y; y++) {
+		for (int x = srcMin.x; x <= srcMax.x; x++) {
+			farthest = max(farthest, imageLoad(srcLevel, ivec2(x, y)).r);
+		}
+	}
+	imageStore(dstLevel, dst, vec4(farthest));
+}
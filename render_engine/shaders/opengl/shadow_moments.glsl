@@ -0,0 +1,56 @@
+#version 430 core
+layout(local_size_x = 8, local_size_y = 8) in;
+
+#define BLUR_RADIUS 4
+// Must match forward.frag.
+#define EVSM_EXPONENTS vec2(40.0, 5.0)
+
+// Turns one layer of the shadow map array into exponential variance shadow map moments,
+// blurred with a separable Gaussian:
+// pass 0 warps layer of shadowMaps and blurs it horizontally into blurMoments,
+// pass 1 blurs blurMoments vertically into layer of moments.
+uniform int blurPass;
+uniform int shadowLayer;
+uniform sampler2DArray shadowMaps;
+layout(rgba32f, binding = 0) uniform image2D blurMoments;
+layout(rgba32f, binding = 1) uniform writeonly image2DArray moments;
+
+
+// (e^(c+ x), e^(c+ x)^2, -e^(-c- x), e^(-c- x)^2) with depth remapped to x in [-1, 1].
+vec4 warpDepth(float depth) {
+	float x = 2.0 * depth - 1.0;
+	float pos = exp(EVSM_EXPONENTS.x * x);
+	float neg = -exp(-EVSM_EXPONENTS.y * x);
+	return vec4(pos, pos * pos, neg, neg * neg);
+}
+
+
+void main() {
+	ivec2 dst = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 size = imageSize(blurMoments);
+	if (dst.x >= size.x || dst.y >= size.y) {
+		return;
+	}
+
+	ivec2 dir = (blurPass == 0) ? ivec2(1, 0) : ivec2(0, 1);
+	const float sigma = 0.5 * float(BLUR_RADIUS);
+	vec4 total = vec4(0.0);
+	float totalWeight = 0.0;
+	for (int i = -BLUR_RADIUS; i <= BLUR_RADIUS; i++) {
+		ivec2 src = clamp(dst + i * dir, ivec2(0), size - 1);
+		float weight = exp(-float(i * i) / (2.0 * sigma * sigma));
+		vec4 value = (blurPass == 0) ?
+			warpDepth(texelFetch(shadowMaps, ivec3(src, shadowLayer), 0).r) :
+			imageLoad(blurMoments, src);
+		total += weight * value;
+		totalWeight += weight;
+	}
+	total /= totalWeight;
+
+	if (blurPass == 0) {
+		imageStore(blurMoments, dst, total);
+	}
+	else {
+		imageStore(moments, ivec3(dst, shadowLayer), total);
+	}
+}
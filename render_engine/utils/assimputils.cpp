@@ -1,4 +1,4 @@
-#include "utils/assimpUtils.h"
+#include "utils/assimputils.h"
 
 #include "glm/gtc/quaternion.hpp"
 #include "glm/gtc/type_ptr.hpp"
@@ -0,0 +1,34 @@
+#include "utils/platform.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <chrono>
+#include <iostream>
+#include <thread>
+#endif
+
+
+namespace Utils {
+	namespace Platform {
+
+		void sleep(uint32_t milliseconds) {
+#ifdef _WIN32
+			Sleep((DWORD)milliseconds);
+#else
+			std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+#endif
+		}
+
+		void errorMessage(const std::string& title, const std::string& message) {
+#ifdef _WIN32
+			MessageBoxA(NULL, message.c_str(), title.c_str(), MB_OK | MB_ICONERROR);
+#else
+			std::cerr << "[" << title << "] " << message << std::endl;
+#endif
+		}
+
+	}
+}
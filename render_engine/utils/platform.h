@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+
+/*
+* Thin wrappers around the few OS-specific calls the engine makes, so that the
+* rest of the code never needs to include platform headers like Windows.h.
+*/
+namespace Utils {
+	namespace Platform {
+
+		// Blocks the calling thread for the given number of milliseconds.
+		void sleep(uint32_t milliseconds);
+
+		// Reports an error to the user.
+		// On Windows this is a message box; elsewhere it is printed to stderr.
+		void errorMessage(const std::string& title, const std::string& message);
+
+	}
+}
@@ -0,0 +1,89 @@
+#include "utils/threadpool.h"
+
+
+ThreadPool::ThreadPool() : ThreadPool(
+	std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0
+) {}
+
+ThreadPool::ThreadPool(size_t numWorkers) {
+	this->workers.reserve(numWorkers);
+	for (size_t i = 0; i < numWorkers; i++) {
+		this->workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->wakeCondition.notify_all();
+	for (std::thread& worker : this->workers) {
+		worker.join();
+	}
+}
+
+size_t ThreadPool::getNumThreads() {
+	return this->workers.size() + 1;
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+	if (count == 0) {
+		return;
+	}
+	if (this->workers.empty() || count == 1) {
+		for (size_t i = 0; i < count; i++) {
+			fn(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->job = &fn;
+		this->jobCount = count;
+		this->nextIndex = 0;
+		this->activeWorkers = this->workers.size();
+		this->generation++;
+	}
+	this->wakeCondition.notify_all();
+
+	this->runIndices(fn, count);
+
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->doneCondition.wait(lock, [this]() { return this->activeWorkers == 0; });
+	this->job = nullptr;
+}
+
+void ThreadPool::workerLoop() {
+	uint64_t seenGeneration = 0;
+	while (true) {
+		const std::function<void(size_t)>* fn = nullptr;
+		size_t count = 0;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->wakeCondition.wait(lock, [&]() {
+				return this->stopping || this->generation != seenGeneration;
+			});
+			if (this->stopping) {
+				return;
+			}
+			seenGeneration = this->generation;
+			fn = this->job;
+			count = this->jobCount;
+		}
+
+		this->runIndices(*fn, count);
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+		if (--this->activeWorkers == 0) {
+			this->doneCondition.notify_one();
+		}
+	}
+}
+
+void ThreadPool::runIndices(const std::function<void(size_t)>& fn, size_t count) {
+	for (size_t i = this->nextIndex.fetch_add(1); i < count; i = this->nextIndex.fetch_add(1)) {
+		fn(i);
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/*
+* A fixed set of worker threads for data-parallel loops, such as CPU light culling.
+* The pool is owned by RenderEngine; see RenderEngine::getThreadPool().
+* 
+* parallelFor() does not return until every index has been processed. The calling
+* thread works alongside the workers, so a pool with no workers simply runs the
+* loop inline. parallelFor() must not be called from inside a parallelFor() job.
+*/
+class ThreadPool {
+public:
+
+	// By default, creates one worker per hardware thread, minus the calling thread.
+	ThreadPool();
+	ThreadPool(size_t numWorkers);
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool(ThreadPool&&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	ThreadPool& operator=(ThreadPool&&) = delete;
+	~ThreadPool();
+
+	// The number of threads that run jobs, including the calling thread.
+	size_t getNumThreads();
+
+	// Calls fn(i) for every i in [0, count), distributed across all threads.
+	void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+private:
+
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+
+	// The current job. Guarded by mutex, except nextIndex which is claimed atomically.
+	const std::function<void(size_t)>* job = nullptr;
+	size_t jobCount = 0;
+	std::atomic<size_t> nextIndex = 0;
+	size_t activeWorkers = 0;
+	uint64_t generation = 0;
+	bool stopping = false;
+
+	void workerLoop();
+	void runIndices(const std::function<void(size_t)>& fn, size_t count);
+
+};